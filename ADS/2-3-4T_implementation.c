@@ -2,6 +2,11 @@
 #include <stdlib.h>
 #include <stdbool.h>
 #include <time.h>
+#include "perf_counters.h"
+#include "op_counters.h"
+#include "latency_histogram.h"
+#include "tree_stats.h"
+#include "snapshot.h"
 
 // Enum to distinguish node types
 typedef enum {
@@ -17,6 +22,8 @@ typedef struct Node {
     struct Node *child1, *child2, *child3, *child4;  // Up to 4 children
 } Node;
 
+OpCounters opCounters;  // Structural counters for the tree being benchmarked
+
 // Create a 2-node
 Node* createTwoNode(int key) {
     Node* newNode = (Node*)malloc(sizeof(Node));
@@ -70,25 +77,60 @@ Node* createFourNode(int key1, int key2, int key3) {
     return newNode;
 }
 
-// Split a 4-node
+// Key i and child i of a node, so splits can work on positions
+int* keyAt(Node* node, int i) {
+    return i == 0 ? &node->key1 : i == 1 ? &node->key2 : &node->key3;
+}
+
+Node** childAt(Node* node, int i) {
+    switch (i) {
+        case 0: return &node->child1;
+        case 1: return &node->child2;
+        case 2: return &node->child3;
+        default: return &node->child4;
+    }
+}
+
+// Cut a 4-node in two: node keeps its smallest key and two left children,
+// the returned 2-node takes the largest key and two right children, and
+// *middle receives the key that has to move up
+Node* splitNode(Node* node, int* middle) {
+    COUNT_OP(opCounters, splits);
+    Node* right = createTwoNode(node->key3);
+    right->child1 = node->child3;
+    right->child2 = node->child4;
+
+    *middle = node->key2;
+    node->type = TWO_NODE;
+    node->key2 = node->key3 = 0;
+    node->child3 = node->child4 = NULL;
+    return right;
+}
+
+// Split the 4-node at child slot i of parent, which must not be a 4-node
+// itself; the middle key moves up into parent
+void splitChild(Node* parent, int i) {
+    int middle;
+    Node* right = splitNode(*childAt(parent, i), &middle);
+
+    // Open a gap at key i and child i + 1 of parent
+    int keys = parent->type + 1;
+    for (int k = keys; k > i; k--) {
+        *keyAt(parent, k) = *keyAt(parent, k - 1);
+        *childAt(parent, k + 1) = *childAt(parent, k);
+    }
+    *keyAt(parent, i) = middle;
+    *childAt(parent, i + 1) = right;
+    parent->type++;
+}
+
+// Split a 4-node root: the tree grows by one level
 Node* splitFourNode(Node* node) {
-    // Create a new 2-node as parent with middle key
-    Node* parent = createTwoNode(node->key2);
-    
-    // Left child becomes a 2-node with the smallest key
-    Node* leftChild = createTwoNode(node->key1);
-    leftChild->child1 = node->child1;
-    leftChild->child2 = node->child2;
-    
-    // Right child becomes a 2-node with the largest key
-    Node* rightChild = createTwoNode(node->key3);
-    rightChild->child1 = node->child3;
-    rightChild->child2 = node->child4;
-    
-    // Connect parent to children
-    parent->child1 = leftChild;
-    parent->child2 = rightChild;
-    
+    int middle;
+    Node* right = splitNode(node, &middle);
+    Node* parent = createTwoNode(middle);
+    parent->child1 = node;
+    parent->child2 = right;
     return parent;
 }
 
@@ -96,6 +138,8 @@ Node* splitFourNode(Node* node) {
 Node* search(Node* root, int key) {
     if (root == NULL) return NULL;
 
+    COUNT_OP(opCounters, comparisons);
+
     // 2-node case
     if (root->type == TWO_NODE) {
         if (key == root->key1) return root;
@@ -125,92 +169,55 @@ Node* search(Node* root, int key) {
     return NULL;
 }
 
-// Insertion helper to handle node splitting
-Node* insertNonFull(Node* root, int key) {
+// Insert in a single pass from the root down. Every 4-node met on the way
+// is split before descending into it, so the parent always has room for
+// the promoted key and no split ever has to travel back up.
+Node* insert(Node* root, int key) {
+    // Empty tree
+    if (root == NULL) {
+        return createTwoNode(key);
+    }
+
     // If root is a 4-node, split it first
     if (root->type == FOUR_NODE) {
         root = splitFourNode(root);
     }
 
-    // 2-node case
-    if (root->type == TWO_NODE) {
-        if (key < root->key1) {
-            if (root->child1 == NULL) {
-                // Insert at leaf
-                if (key < root->key1) {
-                    root->key2 = root->key1;
-                    root->key1 = key;
-                    root->type = THREE_NODE;
-                } else {
-                    root->key2 = key;
-                    root->type = THREE_NODE;
-                }
-            } else {
-                // Recursive insertion
-                root->child1 = insertNonFull(root->child1, key);
-            }
-        } else {
-            if (root->child2 == NULL) {
-                // Insert at leaf
-                root->key2 = key;
-                root->type = THREE_NODE;
-            } else {
-                // Recursive insertion
-                root->child2 = insertNonFull(root->child2, key);
+    Node* node = root;
+    for (;;) {
+        COUNT_OP(opCounters, comparisons);
+
+        // Position of key among the node's keys
+        int keys = node->type + 1, i = 0;
+        while (i < keys && key > *keyAt(node, i)) i++;
+        if (i < keys && key == *keyAt(node, i)) return root;  // Duplicate not allowed
+
+        // Leaf: shift the larger keys right and drop the key in
+        if (node->child1 == NULL) {
+            for (int k = keys; k > i; k--) {
+                *keyAt(node, k) = *keyAt(node, k - 1);
             }
+            *keyAt(node, i) = key;
+            node->type++;
+            return root;
         }
-    }
-    // 3-node case
-    else if (root->type == THREE_NODE) {
-        if (key < root->key1) {
-            if (root->child1 == NULL) {
-                // Convert to 4-node
-                root->key3 = root->key2;
-                root->key2 = root->key1;
-                root->key1 = key;
-                root->type = FOUR_NODE;
-            } else {
-                // Recursive insertion
-                root->child1 = insertNonFull(root->child1, key);
-            }
-        } else if (key > root->key2) {
-            if (root->child3 == NULL) {
-                // Convert to 4-node
-                root->key3 = key;
-                root->type = FOUR_NODE;
-            } else {
-                // Recursive insertion
-                root->child3 = insertNonFull(root->child3, key);
-            }
-        } else {
-            if (root->child2 == NULL) {
-                // Convert to 4-node
-                root->key3 = root->key2;
-                root->key2 = key;
-                root->type = FOUR_NODE;
-            } else {
-                // Recursive insertion
-                root->child2 = insertNonFull(root->child2, key);
-            }
+
+        if ((*childAt(node, i))->type == FOUR_NODE) {
+            splitChild(node, i);
+            if (key == *keyAt(node, i)) return root;
+            if (key > *keyAt(node, i)) i++;
         }
+        node = *childAt(node, i);
     }
-    
-    return root;
 }
 
-// Main insertion function
-Node* insert(Node* root, int key) {
-    // Empty tree
-    if (root == NULL) {
-        return createTwoNode(key);
-    }
-    
-    // If root is a 4-node, split it first
-    if (root->type == FOUR_NODE) {
-        root = splitFourNode(root);
-    }
-    
-    return insertNonFull(root, key);
+void freeTree(Node* root) {
+    if (root == NULL) return;
+    freeTree(root->child1);
+    freeTree(root->child2);
+    freeTree(root->child3);
+    freeTree(root->child4);
+    free(root);
 }
 
 // Find the minimum key in the subtree
@@ -221,117 +228,148 @@ int findMin(Node* node) {
     return node->key1;
 }
 
-// Delete operation
+// Find the maximum key in the subtree
+int findMax(Node* node) {
+    while (node->child1 != NULL) {
+        node = *childAt(node, node->type + 1);
+    }
+    return *keyAt(node, node->type);
+}
+
+// Drop key i (and, for internal nodes, child i + 1) from a node that has
+// more than one key
+void removeKey(Node* node, int i) {
+    int keys = node->type + 1;
+    for (int k = i; k < keys - 1; k++) {
+        *keyAt(node, k) = *keyAt(node, k + 1);
+        *childAt(node, k + 1) = *childAt(node, k + 2);
+    }
+    *keyAt(node, keys - 1) = 0;
+    *childAt(node, keys) = NULL;
+    node->type--;
+}
+
+// Fold the 2-node children i and i + 1 and the key between them into a
+// 4-node at child i. The parent loses that key; when it was a 2-node (only
+// possible at the root) it is left without keys and the caller replaces it.
+void mergeChildren(Node* node, int i) {
+    COUNT_OP(opCounters, merges);
+    Node* left = *childAt(node, i);
+    Node* right = *childAt(node, i + 1);
+
+    left->type = FOUR_NODE;
+    left->key2 = *keyAt(node, i);
+    left->key3 = right->key1;
+    left->child3 = right->child1;
+    left->child4 = right->child2;
+    free(right);
+
+    if (node->type == TWO_NODE) {
+        node->child2 = NULL;
+        return;
+    }
+    removeKey(node, i);
+    *childAt(node, i) = left;
+}
+
+// Rotate a key from the left sibling through the parent into 2-node child i
+void borrowFromLeft(Node* node, int i) {
+    COUNT_OP(opCounters, borrows);
+    Node* child = *childAt(node, i);
+    Node* sibling = *childAt(node, i - 1);
+    int last = sibling->type;
+
+    child->type = THREE_NODE;
+    child->key2 = child->key1;
+    child->key1 = *keyAt(node, i - 1);
+    child->child3 = child->child2;
+    child->child2 = child->child1;
+    child->child1 = *childAt(sibling, last + 1);
+
+    *keyAt(node, i - 1) = *keyAt(sibling, last);
+    *keyAt(sibling, last) = 0;
+    *childAt(sibling, last + 1) = NULL;
+    sibling->type--;
+}
+
+// Rotate a key from the right sibling through the parent into 2-node child i
+void borrowFromRight(Node* node, int i) {
+    COUNT_OP(opCounters, borrows);
+    Node* child = *childAt(node, i);
+    Node* sibling = *childAt(node, i + 1);
+
+    child->type = THREE_NODE;
+    child->key2 = *keyAt(node, i);
+    child->child3 = sibling->child1;
+
+    *keyAt(node, i) = sibling->key1;
+    sibling->child1 = sibling->child2;
+    removeKey(sibling, 0);
+}
+
+// Delete in a single pass from the root down, mirroring insert: before
+// descending into a 2-node it is given a second key, by borrowing from a
+// sibling or by merging with one. The key is then always removed from a
+// leaf that can spare it, and the tree only shrinks at the root, so every
+// leaf stays at the same depth.
 Node* delete(Node* root, int key) {
-    if (root == NULL) return NULL;
+    Node* node = root;
+    while (node != NULL) {
+        COUNT_OP(opCounters, comparisons);
 
-    // 2-node case
-    if (root->type == TWO_NODE) {
-        if (key == root->key1) {
-            // If leaf, simply delete
-            if (root->child1 == NULL) {
-                free(root);
+        int keys = node->type + 1, i = 0;
+        while (i < keys && key > *keyAt(node, i)) i++;
+        bool found = i < keys && key == *keyAt(node, i);
+
+        if (node->child1 == NULL) {
+            if (!found) return root;
+            if (keys == 1) {
+                // Only the root can be a lone 2-node leaf here
+                free(node);
                 return NULL;
             }
-            
-            // Find inorder successor
-            int successor = findMin(root->child2);
-            root->key1 = successor;
-            root->child2 = delete(root->child2, successor);
-        } else if (key < root->key1) {
-            root->child1 = delete(root->child1, key);
-        } else {
-            root->child2 = delete(root->child2, key);
-        }
-        return root;
-    }
-    
-    // 3-node case
-    if (root->type == THREE_NODE) {
-        // Locate the key and appropriate child
-        if (key == root->key1) {
-            // If leaf, remove key1
-            if (root->child1 == NULL) {
-                root->key1 = root->key2;
-                root->type = TWO_NODE;
-                return root;
-            }
-            
-            // Find inorder successor
-            int successor = findMin(root->child2);
-            root->key1 = successor;
-            root->child2 = delete(root->child2, successor);
-        } else if (key == root->key2) {
-            // If leaf, remove key2
-            if (root->child1 == NULL) {
-                root->type = TWO_NODE;
-                root->key2 = 0;
-                return root;
-            }
-            
-            // Find inorder successor
-            int successor = findMin(root->child3);
-            root->key2 = successor;
-            root->child3 = delete(root->child3, successor);
-        } else if (key < root->key1) {
-            root->child1 = delete(root->child1, key);
-        } else {
-            root->child3 = delete(root->child3, key);
+            removeKey(node, i);
+            return root;
         }
-        return root;
-    }
-    
-    // 4-node case
-    if (root->type == FOUR_NODE) {
-        if (key == root->key1) {
-            // If leaf, remove key1
-            if (root->child1 == NULL) {
-                root->key1 = root->key2;
-                root->key2 = root->key3;
-                root->type = THREE_NODE;
-                return root;
+
+        if (found) {
+            // Replace the key by its predecessor or successor, taken from a
+            // child that can spare a key, or merge the two children around it
+            Node* left = *childAt(node, i);
+            Node* right = *childAt(node, i + 1);
+            if (left->type != TWO_NODE) {
+                key = findMax(left);
+                *keyAt(node, i) = key;
+                node = left;
+                continue;
             }
-            
-            // Find inorder successor
-            int successor = findMin(root->child2);
-            root->key1 = successor;
-            root->child2 = delete(root->child2, successor);
-        } else if (key == root->key2) {
-            // If leaf, remove key2
-            if (root->child1 == NULL) {
-                root->key2 = root->key3;
-                root->type = THREE_NODE;
-                return root;
+            if (right->type != TWO_NODE) {
+                key = findMin(right);
+                *keyAt(node, i) = key;
+                node = right;
+                continue;
             }
-            
-            // Find inorder successor
-            int successor = findMin(root->child3);
-            root->key2 = successor;
-            root->child3 = delete(root->child3, successor);
-        } else if (key == root->key3) {
-            // If leaf, remove key3
-            if (root->child1 == NULL) {
-                root->type = THREE_NODE;
-                root->key3 = 0;
-                return root;
+            mergeChildren(node, i);
+        } else if ((*childAt(node, i))->type == TWO_NODE) {
+            if (i > 0 && (*childAt(node, i - 1))->type != TWO_NODE) {
+                borrowFromLeft(node, i);
+            } else if (i < keys && (*childAt(node, i + 1))->type != TWO_NODE) {
+                borrowFromRight(node, i);
+            } else if (i < keys) {
+                mergeChildren(node, i);
+            } else {
+                mergeChildren(node, --i);
             }
-            
-            // Find inorder successor
-            int successor = findMin(root->child4);
-            root->key3 = successor;
-            root->child4 = delete(root->child4, successor);
-        } else if (key < root->key1) {
-            root->child1 = delete(root->child1, key);
-        } else if (key > root->key3) {
-            root->child4 = delete(root->child4, key);
-        } else if (key < root->key2) {
-            root->child2 = delete(root->child2, key);
-        } else {
-            root->child3 = delete(root->child3, key);
         }
-        return root;
+
+        Node* next = *childAt(node, i);
+        if (node->child2 == NULL) {
+            // The root gave its last key to a merge: its only child takes over
+            free(node);
+            root = next;
+        }
+        node = next;
     }
-    
     return root;
 }
 
@@ -366,8 +404,151 @@ void inorderTraversal(Node* root) {
     }
 }
 
+const char* nodeTypeNames[] = { "TWO_NODE", "THREE_NODE", "FOUR_NODE" };
+
+// Walk the tree and report its memory footprint, shape and node fill
+void collectTreeStats(Node* node, int depth, TreeStats* stats) {
+    if (node == NULL) return;
+    treeStatsAddNode(stats, node, sizeof(Node), depth, node->type + 1);
+    stats->nodesByType[node->type]++;
+    collectTreeStats(node->child1, depth + 1, stats);
+    collectTreeStats(node->child2, depth + 1, stats);
+    collectTreeStats(node->child3, depth + 1, stats);
+    collectTreeStats(node->child4, depth + 1, stats);
+}
+
+TreeStats treeStats(Node* root) {
+    TreeStats stats;
+    treeStatsInit(&stats);
+    stats.nodeTypeCount = 3;
+    collectTreeStats(root, 0, &stats);
+    treeStatsFinish(&stats);
+    return stats;
+}
+
+// Stream the keys in order into a snapshot writer
+void writeSnapshot(Node* node, SnapshotWriter* writer) {
+    if (node == NULL) return;
+    writeSnapshot(node->child1, writer);
+    snapshotAppend(writer, node->key1);
+    writeSnapshot(node->child2, writer);
+    if (node->type == TWO_NODE) return;
+    snapshotAppend(writer, node->key2);
+    writeSnapshot(node->child3, writer);
+    if (node->type == THREE_NODE) return;
+    snapshotAppend(writer, node->key3);
+    writeSnapshot(node->child4, writer);
+}
+
+int saveSnapshot(Node* root, const char* path) {
+    SnapshotWriter* writer = snapshotBegin(path);
+    if (writer == NULL) return -1;
+    writeSnapshot(root, writer);
+    return snapshotFinish(writer);
+}
+
+// Fewest and most levels a 2-3-4 tree of n keys fits in: h levels of
+// 4-nodes hold 4^h - 1 keys, h levels of 2-nodes 2^h - 1
+void heightBounds(long n, int* lowest, int* highest) {
+    *lowest = *highest = 0;
+    for (long full = 0; full < n; full = 4 * full + 3) (*lowest)++;
+    for (long sparse = 1; sparse <= n; sparse = 2 * sparse + 1) (*highest)++;
+}
+
+// Print how the tree's nodes split into 2-, 3- and 4-nodes
+void printNodeMix(const TreeStats* stats) {
+    double total = stats->nodeCount ? (double)stats->nodeCount : 1.0;
+    printf("  node mix: 2-nodes=%.1f%%, 3-nodes=%.1f%%, 4-nodes=%.1f%%\n",
+           100.0 * stats->nodesByType[TWO_NODE] / total, 100.0 * stats->nodesByType[THREE_NODE] / total,
+           100.0 * stats->nodesByType[FOUR_NODE] / total);
+}
+
+// Insert 0..n-1 in increasing order for growing n. The insert splits every
+// 4-node on its way down, before it knows whether the leaf has room, so it
+// never has to climb back up. Sorted keys always take the rightmost path,
+// which is split again and again; the splits per insertion and the node
+// mix show what that eager splitting costs next to the height it buys.
+void benchmarkSortedInsertion() {
+    printf("\nSorted insertion scaling:\n");
+    for (int n = 1000; n <= 1000000; n *= 10) {
+        Node* root = NULL;
+        resetOpCounters(&opCounters);
+        uint64_t start = nowNanos();
+        for (int k = 0; k < n; k++) {
+            root = insert(root, k);
+        }
+        uint64_t elapsed = nowNanos() - start;
+        TreeStats stats = treeStats(root);
+        int lowest, highest;
+        heightBounds(n, &lowest, &highest);
+        printf("%d keys: %.1f ns per insertion, height=%d (%d with every node full, %d with none)\n",
+               n, (double)elapsed / n, stats.height, lowest, highest);
+        printNodeMix(&stats);
+        printOpCounters("Sorted insertion", &opCounters, n);
+        freeTree(root);
+    }
+}
+
+// Delete-heavy churn: build a tree of n even keys and replace each of them,
+// in scattered order, by a new odd key. Like the insert, the delete works
+// in one pass down: every 2-node it is about to enter first borrows a key
+// from a sibling or merges with one, so the key always comes out of a leaf
+// that can spare it. The height and node mix after n replacements show
+// whether that keeps the tree as compact as the inserts built it.
+void benchmarkChurn() {
+    printf("\nDelete/insert churn:\n");
+    for (int n = 1000; n <= 1000000; n *= 10) {
+        Node* root = NULL;
+        for (int k = 0; k < n; k++) {
+            root = insert(root, 2 * k);
+        }
+
+        resetOpCounters(&opCounters);
+        uint64_t start = nowNanos();
+        for (int k = 0; k < n; k++) {
+            root = delete(root, 2 * (int)(((long long)k * 7919) % n));
+            root = insert(root, 2 * (n + k) + 1);
+        }
+        uint64_t elapsed = nowNanos() - start;
+        TreeStats stats = treeStats(root);
+        int lowest, highest;
+        heightBounds(stats.keyCount, &lowest, &highest);
+        printf("%d replacements: %.1f ns per delete+insert, height=%d (%d with every node full, %d with none), keys=%ld\n",
+               n, (double)elapsed / n, stats.height, lowest, highest, stats.keyCount);
+        printNodeMix(&stats);
+        printOpCounters("Churn", &opCounters, n);
+        freeTree(root);
+    }
+}
+
+// Replay the file's operations on a scratch tree with a clock read around
+// each one, outside the windows the hardware counters cover
+void recordLatencies(FILE* file, LatencyHistogram latency[]) {
+    Node* root = NULL;
+    int number;
+    rewind(file);
+    while (fscanf(file, "%d,", &number) == 1) {
+        uint64_t opStart = nowNanos();
+        root = insert(root, number);
+        histogramRecord(&latency[OP_INSERT], nowNanos() - opStart);
+    }
+
+    uint64_t opStart = nowNanos();
+    search(root, 500);
+    histogramRecord(&latency[OP_SEARCH], nowNanos() - opStart);
+
+    opStart = nowNanos();
+    root = delete(root, 500);
+    histogramRecord(&latency[OP_DELETE], nowNanos() - opStart);
+    freeTree(root);
+}
+
 void processFiles(const char* files[], int fileCount) {
     Node* root = NULL;
+    PerfCounters counters;
+    perfOpen(&counters);
+    static LatencyHistogram latency[OP_TYPE_COUNT], totalLatency[OP_TYPE_COUNT];
+    for (int op = 0; op < OP_TYPE_COUNT; op++) histogramInit(&totalLatency[op]);
 
     for (int i = 0; i < fileCount; i++) {
         FILE* file = fopen(files[i], "r");
@@ -381,18 +562,39 @@ void processFiles(const char* files[], int fileCount) {
         int number, nodeCount = 0;
         clock_t start, end;
 
+        for (int op = 0; op < OP_TYPE_COUNT; op++) histogramInit(&latency[op]);
+
         // Insertion time
+        resetOpCounters(&opCounters);
         start = clock();
+        perfStart(&counters);
         while (fscanf(file, "%d,", &number) == 1) {
             root = insert(root, number);
             nodeCount++;
         }
+        perfStop(&counters);
         end = clock();
         printf("Insertion time for %d nodes: %f seconds\n", nodeCount, ((double)(end - start)) / CLOCKS_PER_SEC);
+        perfReport(&counters, "Insertion", nodeCount);
+        printOpCounters("Insertion", &opCounters, nodeCount);
+        TreeStats stats = treeStats(root);
+        printTreeStats(&stats, nodeTypeNames, 3);
+
+        // Snapshot the tree and serve the same lookups from the mapped image
+        char snapshotPath[256];
+        snprintf(snapshotPath, sizeof(snapshotPath), "%s.snap", files[i]);
+        start = clock();
+        int saved = saveSnapshot(root, snapshotPath);
+        end = clock();
+        printf("Snapshot write time: %f seconds\n", ((double)(end - start)) / CLOCKS_PER_SEC);
+        if (saved == 0) snapshotBenchmark(snapshotPath, 500, 250, 750);
 
         // Search time for node with value 500
+        resetOpCounters(&opCounters);
         start = clock();
+        perfStart(&counters);
         Node* foundNode = search(root, 500);
+        perfStop(&counters);
         end = clock();
         if (foundNode != NULL) {
             printf("Node with value 500 found.\n");
@@ -400,16 +602,34 @@ void processFiles(const char* files[], int fileCount) {
             printf("Node with value 500 not found.\n");
         }
         printf("Search time for node with value 500: %f seconds\n", ((double)(end - start)) / CLOCKS_PER_SEC);
+        perfReport(&counters, "Search", 1);
+        printOpCounters("Search", &opCounters, 1);
 
         // Deletion time for node with value 500
+        resetOpCounters(&opCounters);
         start = clock();
+        perfStart(&counters);
         root = delete(root, 500);
+        perfStop(&counters);
         end = clock();
         printf("Deletion time for node with value 500: %f seconds\n", ((double)(end - start)) / CLOCKS_PER_SEC);
+        perfReport(&counters, "Deletion", 1);
+        printOpCounters("Deletion", &opCounters, 1);
+
+        recordLatencies(file, latency);
+        for (int op = 0; op < OP_TYPE_COUNT; op++) {
+            histogramPrint(&latency[op], opTypeNames[op]);
+            histogramMerge(&totalLatency[op], &latency[op]);
+        }
 
         fclose(file);
+        freeTree(root);
         root = NULL; // Reset the tree for the next file
     }
+
+    printf("\nLatency over all files:\n");
+    for (int op = 0; op < OP_TYPE_COUNT; op++) histogramPrint(&totalLatency[op], opTypeNames[op]);
+    perfClose(&counters);
 }
 
 int main() {
@@ -422,6 +642,8 @@ int main() {
     };
 
     processFiles(files, 4);
+    benchmarkSortedInsertion();
+    benchmarkChurn();
 
     return 0;
 }
\ No newline at end of file
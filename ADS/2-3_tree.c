@@ -2,6 +2,11 @@
 #include <stdlib.h>
 #include <stdbool.h>
 #include <time.h>
+#include "perf_counters.h"
+#include "op_counters.h"
+#include "latency_histogram.h"
+#include "tree_stats.h"
+#include "snapshot.h"
 
 // Enum to distinguish node types
 typedef enum {
@@ -16,8 +21,7 @@ typedef struct Node {
     struct Node *left, *middle, *right;
 } Node;
 
-// Forward declaration of the delete function
-Node* delete(Node* root, int key);
+OpCounters opCounters;  // Structural counters for the tree being benchmarked
 
 // Create a new 2-node
 Node* createTwoNode(int key) {
@@ -61,6 +65,8 @@ int findMin(Node* node) {
 Node* search(Node* root, int key) {
     if (root == NULL) return NULL;
 
+    COUNT_OP(opCounters, comparisons);
+
     // For 2-node
     if (root->type == TWO_NODE) {
         if (key == root->key1) return root;
@@ -75,187 +81,259 @@ Node* search(Node* root, int key) {
     return search(root->middle, key);
 }
 
-// Helper function to borrow a key or merge nodes
-Node* balanceAfterDeletion(Node* parent, Node* child, bool isLeft) {
-    Node* sibling;
+// Turn node into a 2-node holding key with the given children
+void setTwoNode(Node* node, int key, Node* left, Node* right) {
+    node->type = TWO_NODE;
+    node->key1 = key;
+    node->key2 = 0;
+    node->left = left;
+    node->middle = NULL;
+    node->right = right;
+}
 
-    // Determine which sibling to look at
-    if (isLeft) {
-        sibling = parent->type == TWO_NODE ? parent->right : parent->middle;
-    } else {
-        sibling = parent->type == TWO_NODE ? parent->left : parent->middle;
+// Turn node into a 3-node holding key1 < key2 with the given children
+void setThreeNode(Node* node, int key1, int key2, Node* left, Node* middle, Node* right) {
+    node->type = THREE_NODE;
+    node->key1 = key1;
+    node->key2 = key2;
+    node->left = left;
+    node->middle = middle;
+    node->right = right;
+}
+
+// Insert key below node. When node overflows it is split: node keeps the
+// lower half, *promotedRight receives a new node with the upper half and
+// *promotedKey the key that has to move up into the parent.
+Node* insertNode(Node* node, int key, int* promotedKey, Node** promotedRight) {
+    *promotedRight = NULL;
+    COUNT_OP(opCounters, comparisons);
+
+    if (key == node->key1 || (node->type == THREE_NODE && key == node->key2)) {
+        return node;  // Duplicate not allowed
     }
 
-    // If sibling is a 3-node, we can borrow a key
-    if (sibling->type == THREE_NODE) {
-        // Restructure to balance
-        if (parent->type == TWO_NODE) {
-            if (isLeft) {
-                child->key1 = parent->key1;
-                parent->key1 = sibling->key2;
-                child->right = sibling->right;
-                sibling->type = TWO_NODE;
-                sibling->right = NULL;
-            } else {
-                child->key1 = parent->key1;
-                parent->key1 = sibling->key1;
-                child->left = sibling->right;
-                sibling->type = TWO_NODE;
-                sibling->right = sibling->middle;
-                sibling->middle = NULL;
-            }
-        } else {
-            // More complex restructuring for 3-node parent
-            if (isLeft) {
-                child->key1 = parent->key1;
-                parent->key1 = sibling->key2;
-                child->right = sibling->right;
-                sibling->type = TWO_NODE;
-                sibling->right = NULL;
-            } else {
-                child->key1 = parent->key2;
-                parent->key2 = sibling->key1;
-                child->left = sibling->right;
-                sibling->type = TWO_NODE;
-                sibling->right = sibling->middle;
-                sibling->middle = NULL;
-            }
+    // Leaf: absorb the key, splitting a full 3-node around its middle key
+    if (node->left == NULL) {
+        if (node->type == TWO_NODE) {
+            if (key < node->key1) setThreeNode(node, key, node->key1, NULL, NULL, NULL);
+            else setThreeNode(node, node->key1, key, NULL, NULL, NULL);
+            return node;
         }
-        return parent;
-    }
 
-    // If we can't borrow, we need to merge
-    // This is a simplification and might need more comprehensive handling
-    if (parent->type == TWO_NODE) {
-        // Convert to a 3-node if possible
-        if (isLeft) {
-            parent->type = THREE_NODE;
-            parent->key2 = parent->key1;
-            parent->key1 = child->key1;
-            parent->right = parent->middle;
-            parent->middle = parent->left;
-            parent->left = child->left;
-        } else {
-            parent->type = THREE_NODE;
-            parent->key2 = child->key1;
-            parent->right = child->left;
+        COUNT_OP(opCounters, splits);
+        int low = node->key1, middle = node->key2, high = key;
+        if (key < node->key1) {
+            low = key;
+            middle = node->key1;
+            high = node->key2;
+        } else if (key < node->key2) {
+            middle = key;
+            high = node->key2;
         }
+        setTwoNode(node, low, NULL, NULL);
+        *promotedKey = middle;
+        *promotedRight = createTwoNode(high);
+        return node;
     }
 
-    return parent;
-}
-
-// Delete operation
-Node* delete(Node* root, int key) {
-    if (root == NULL) return NULL;
+    // Internal node: insert into the matching child, then take in its split
+    int childKey;
+    Node* childRight;
+    if (key < node->key1) {
+        insertNode(node->left, key, &childKey, &childRight);
+        if (childRight == NULL) return node;
 
-    // 2-node case
-    if (root->type == TWO_NODE) {
-        if (key == root->key1) {
-            // If it's a leaf, simply remove
-            if (root->left == NULL) {
-                free(root);
-                return NULL;
-            }
-
-            // Find inorder successor
-            int successor = findMin(root->right);
-            root->key1 = successor;
-            root->right = delete(root->right, successor);
-        } else if (key < root->key1) {
-            root->left = delete(root->left, key);
-        } else {
-            root->right = delete(root->right, key);
+        if (node->type == TWO_NODE) {
+            setThreeNode(node, childKey, node->key1, node->left, childRight, node->right);
+            return node;
         }
-        return root;
+        COUNT_OP(opCounters, splits);
+        *promotedKey = node->key1;
+        *promotedRight = createTwoNode(node->key2);
+        (*promotedRight)->left = node->middle;
+        (*promotedRight)->right = node->right;
+        setTwoNode(node, childKey, node->left, childRight);
+        return node;
     }
 
-    // 3-node case
-    if (root->type == THREE_NODE) {
-        if (key == root->key1) {
-            // If it's a leaf, remove key1
-            if (root->left == NULL) {
-                root->type = TWO_NODE;
-                root->key1 = root->key2;
-                return root;
-            }
-
-            // Find inorder successor
-            int successor = findMin(root->middle);
-            root->key1 = successor;
-            root->middle = delete(root->middle, successor);
-        } else if (key == root->key2) {
-            // If it's a leaf, remove key2
-            if (root->left == NULL) {
-                root->type = TWO_NODE;
-                root->key2 = 0;
-                return root;
-            }
-
-            // Find inorder successor
-            int successor = findMin(root->right);
-            root->key2 = successor;
-            root->right = delete(root->right, successor);
-        } else if (key < root->key1) {
-            root->left = delete(root->left, key);
-        } else {
-            root->right = delete(root->right, key);
+    if (node->type == TWO_NODE) {
+        insertNode(node->right, key, &childKey, &childRight);
+        if (childRight != NULL) {
+            setThreeNode(node, node->key1, childKey, node->left, node->right, childRight);
         }
-        return root;
+        return node;
     }
 
-    return root;
+    if (key < node->key2) {
+        insertNode(node->middle, key, &childKey, &childRight);
+        if (childRight == NULL) return node;
+
+        COUNT_OP(opCounters, splits);
+        *promotedKey = childKey;
+        *promotedRight = createTwoNode(node->key2);
+        (*promotedRight)->left = childRight;
+        (*promotedRight)->right = node->right;
+        setTwoNode(node, node->key1, node->left, node->middle);
+        return node;
+    }
+
+    insertNode(node->right, key, &childKey, &childRight);
+    if (childRight == NULL) return node;
+
+    COUNT_OP(opCounters, splits);
+    *promotedKey = node->key2;
+    *promotedRight = createTwoNode(childKey);
+    (*promotedRight)->left = node->right;
+    (*promotedRight)->right = childRight;
+    setTwoNode(node, node->key1, node->left, node->middle);
+    return node;
 }
 
-// Insert into 2-3 Tree (previous implementation remains the same)
+// Insert into 2-3 Tree. Splits travel up to the root, which is the only
+// place the tree grows, so every leaf stays at the same depth.
 Node* insert(Node* root, int key) {
     if (root == NULL) return createTwoNode(key);
 
-    // For 2-node
-    if (root->type == TWO_NODE) {
-        if (key == root->key1) return root;  // Duplicate not allowed
-
-        if (key < root->key1) {
-            if (root->left == NULL) {
-                root->left = createTwoNode(key);
-                return root;
-            }
-            root->left = insert(root->left, key);
-        } else {
-            if (root->right == NULL) {
-                root->right = createTwoNode(key);
-                return root;
-            }
-            root->right = insert(root->right, key);
-        }
+    int promotedKey;
+    Node* promotedRight;
+    root = insertNode(root, key, &promotedKey, &promotedRight);
+    if (promotedRight == NULL) return root;
+
+    Node* newRoot = createTwoNode(promotedKey);
+    newRoot->left = root;
+    newRoot->right = promotedRight;
+    return newRoot;
+}
+
+void freeTree(Node* root) {
+    if (root == NULL) return;
+    freeTree(root->left);
+    freeTree(root->middle);
+    freeTree(root->right);
+    free(root);
+}
+
+// Copy the keys and children of node into arrays; returns the key count
+int unpackNode(Node* node, int keys[2], Node* children[3]) {
+    keys[0] = node->key1;
+    children[0] = node->left;
+    if (node->type == TWO_NODE) {
+        children[1] = node->right;
+        return 1;
     }
+    keys[1] = node->key2;
+    children[1] = node->middle;
+    children[2] = node->right;
+    return 2;
+}
 
-    // For 3-node
-    if (root->type == THREE_NODE) {
-        if (key == root->key1 || key == root->key2) return root;  // Duplicate not allowed
-
-        if (key < root->key1) {
-            if (root->left == NULL) {
-                root->left = createTwoNode(key);
-                return root;
-            }
-            root->left = insert(root->left, key);
-        } else if (key > root->key2) {
-            if (root->right == NULL) {
-                root->right = createTwoNode(key);
-                return root;
-            }
-            root->right = insert(root->right, key);
-        } else {
-            if (root->middle == NULL) {
-                root->middle = createTwoNode(key);
-                return root;
-            }
-            root->middle = insert(root->middle, key);
+void packNode(Node* node, int count, int keys[2], Node* children[3]) {
+    if (count == 1) setTwoNode(node, keys[0], children[0], children[1]);
+    else setThreeNode(node, keys[0], keys[1], children[0], children[1], children[2]);
+}
+
+// Child c of node has been emptied: it holds no key and at most one child,
+// kept in its left pointer. Borrow a key through node from a 3-node
+// sibling, or merge the hole into a 2-node sibling, which takes a key away
+// from node. Returns true when that leaves node itself empty.
+bool fixHole(Node* node, int c) {
+    int keys[2];
+    Node* children[3];
+    int count = unpackNode(node, keys, children);
+    Node* hole = children[c];
+    Node* orphan = hole->left;
+
+    if (c < count && children[c + 1]->type == THREE_NODE) {
+        COUNT_OP(opCounters, borrows);
+        Node* sibling = children[c + 1];
+        setTwoNode(hole, keys[c], orphan, sibling->left);
+        keys[c] = sibling->key1;
+        setTwoNode(sibling, sibling->key2, sibling->middle, sibling->right);
+        packNode(node, count, keys, children);
+        return false;
+    }
+    if (c > 0 && children[c - 1]->type == THREE_NODE) {
+        COUNT_OP(opCounters, borrows);
+        Node* sibling = children[c - 1];
+        setTwoNode(hole, keys[c - 1], sibling->right, orphan);
+        keys[c - 1] = sibling->key2;
+        setTwoNode(sibling, sibling->key1, sibling->left, sibling->middle);
+        packNode(node, count, keys, children);
+        return false;
+    }
+
+    // Both neighbours are 2-nodes: fold the hole and a separator into one
+    COUNT_OP(opCounters, merges);
+    int separator;
+    if (c < count) {
+        Node* sibling = children[c + 1];
+        setThreeNode(sibling, keys[c], sibling->key1, orphan, sibling->left, sibling->right);
+        separator = c;
+    } else {
+        Node* sibling = children[c - 1];
+        setThreeNode(sibling, sibling->key1, keys[c - 1], sibling->left, sibling->right, orphan);
+        separator = c - 1;
+    }
+    free(hole);
+    for (int k = separator; k < count - 1; k++) keys[k] = keys[k + 1];
+    for (int k = c; k < count; k++) children[k] = children[k + 1];
+    count--;
+
+    if (count == 0) {
+        // node gives up its last key; its one remaining child moves up
+        setTwoNode(node, 0, children[0], NULL);
+        return true;
+    }
+    packNode(node, count, keys, children);
+    return false;
+}
+
+// Remove key below node. Returns true when node is left without keys, in
+// which case the parent has to repair it with fixHole.
+bool deleteNode(Node* node, int key) {
+    COUNT_OP(opCounters, comparisons);
+    int keys[2];
+    Node* children[3];
+    int count = unpackNode(node, keys, children);
+
+    int c = 0;
+    while (c < count && key > keys[c]) c++;
+    bool found = c < count && key == keys[c];
+
+    if (node->left == NULL) {
+        if (!found) return false;
+        if (count == 1) {
+            setTwoNode(node, 0, NULL, NULL);
+            return true;
         }
+        keys[0] = keys[1 - c];
+        packNode(node, 1, keys, children);
+        return false;
     }
 
-    return root;
+    if (found) {
+        // Swap in the in-order successor and delete that from the leaf
+        int successor = findMin(children[c + 1]);
+        if (c == 0) node->key1 = successor;
+        else node->key2 = successor;
+        key = successor;
+        c++;
+    }
+
+    if (!deleteNode(children[c], key)) return false;
+    return fixHole(node, c);
+}
+
+// Delete operation. Keys only leave from leaves; an emptied node borrows
+// from or merges with a sibling, and the tree only shrinks at the root,
+// so every leaf stays at the same depth.
+Node* delete(Node* root, int key) {
+    if (root == NULL) return NULL;
+    if (!deleteNode(root, key)) return root;
+
+    Node* newRoot = root->left;
+    free(root);
+    return newRoot;
 }
 
 // Utility function to print tree (in-order traversal)
@@ -275,8 +353,142 @@ void inorderTraversal(Node* root) {
     }
 }
 
+const char* nodeTypeNames[] = { "TWO_NODE", "THREE_NODE" };
+
+// Walk the tree and report its memory footprint, shape and node fill
+void collectTreeStats(Node* node, int depth, TreeStats* stats) {
+    if (node == NULL) return;
+    treeStatsAddNode(stats, node, sizeof(Node), depth, node->type == TWO_NODE ? 1 : 2);
+    stats->nodesByType[node->type]++;
+    collectTreeStats(node->left, depth + 1, stats);
+    collectTreeStats(node->middle, depth + 1, stats);
+    collectTreeStats(node->right, depth + 1, stats);
+}
+
+TreeStats treeStats(Node* root) {
+    TreeStats stats;
+    treeStatsInit(&stats);
+    stats.nodeTypeCount = 2;
+    collectTreeStats(root, 0, &stats);
+    treeStatsFinish(&stats);
+    return stats;
+}
+
+// Stream the keys in order into a snapshot writer
+void writeSnapshot(Node* node, SnapshotWriter* writer) {
+    if (node == NULL) return;
+    writeSnapshot(node->left, writer);
+    snapshotAppend(writer, node->key1);
+    if (node->type == THREE_NODE) {
+        writeSnapshot(node->middle, writer);
+        snapshotAppend(writer, node->key2);
+    }
+    writeSnapshot(node->right, writer);
+}
+
+int saveSnapshot(Node* root, const char* path) {
+    SnapshotWriter* writer = snapshotBegin(path);
+    if (writer == NULL) return -1;
+    writeSnapshot(root, writer);
+    return snapshotFinish(writer);
+}
+
+// Heights a 2-3 tree of n keys can have: h levels of 3-nodes hold 3^h - 1
+// keys, h levels of 2-nodes 2^h - 1
+void heightBounds(long n, int* lowest, int* highest) {
+    *lowest = *highest = 0;
+    for (long full = 0; full < n; full = 3 * full + 2) (*lowest)++;
+    for (long sparse = 1; sparse <= n; sparse = 2 * sparse + 1) (*highest)++;
+}
+
+// Share of the tree's nodes that are 3-nodes, in percent
+double threeNodeShare(const TreeStats* stats) {
+    return stats->nodeCount ? 100.0 * stats->nodesByType[THREE_NODE] / stats->nodeCount : 0.0;
+}
+
+// Insert 0..n-1 in increasing order for growing n. Every key goes to the
+// rightmost leaf; when it would hold three keys it splits and the middle
+// key moves up, splitting each 3-node it meets on the right spine. What
+// is left behind on the left never changes again, so its node mix decides
+// where between the 2-3 height bounds the tree ends up.
+void benchmarkSortedInsertion() {
+    printf("\nSorted insertion scaling:\n");
+    for (int n = 1000; n <= 1000000; n *= 10) {
+        Node* root = NULL;
+        resetOpCounters(&opCounters);
+        uint64_t start = nowNanos();
+        for (int k = 0; k < n; k++) {
+            root = insert(root, k);
+        }
+        uint64_t elapsed = nowNanos() - start;
+        TreeStats stats = treeStats(root);
+        int lowest, highest;
+        heightBounds(n, &lowest, &highest);
+        printf("%d keys: %.1f ns per insertion, height=%d (a 2-3 tree may have %d to %d), 3-nodes=%.1f%%\n",
+               n, (double)elapsed / n, stats.height, lowest, highest, threeNodeShare(&stats));
+        printOpCounters("Sorted insertion", &opCounters, n);
+        freeTree(root);
+    }
+}
+
+// Delete-heavy churn: build a tree of n even keys, then delete all of them
+// in scattered order while inserting as many new odd keys. A delete that
+// empties a node leaves a hole, which fixHole fills on the way back up by
+// borrowing from a 3-node sibling or folding it into a 2-node one, so the
+// leaves keep one depth and the height stays inside the 2-3 bounds.
+void benchmarkChurn() {
+    printf("\nDelete/insert churn:\n");
+    for (int n = 1000; n <= 1000000; n *= 10) {
+        Node* root = NULL;
+        for (int k = 0; k < n; k++) {
+            root = insert(root, 2 * k);
+        }
+
+        resetOpCounters(&opCounters);
+        uint64_t start = nowNanos();
+        for (int k = 0; k < n; k++) {
+            root = delete(root, 2 * (int)(((long long)k * 7919) % n));
+            root = insert(root, 2 * (n + k) + 1);
+        }
+        uint64_t elapsed = nowNanos() - start;
+        TreeStats stats = treeStats(root);
+        int lowest, highest;
+        heightBounds(stats.keyCount, &lowest, &highest);
+        printf("%d keys: %.1f ns per delete+insert, height=%d (a 2-3 tree may have %d to %d), 3-nodes=%.1f%%, keys=%ld\n",
+               n, (double)elapsed / n, stats.height, lowest, highest, threeNodeShare(&stats), stats.keyCount);
+        printOpCounters("Churn", &opCounters, n);
+        freeTree(root);
+    }
+}
+
+// Replay the file's operations on a scratch tree with a clock read around
+// each one, outside the windows the hardware counters cover
+void recordLatencies(FILE* file, LatencyHistogram latency[]) {
+    Node* root = NULL;
+    int number;
+    rewind(file);
+    while (fscanf(file, "%d,", &number) == 1) {
+        uint64_t opStart = nowNanos();
+        root = insert(root, number);
+        histogramRecord(&latency[OP_INSERT], nowNanos() - opStart);
+    }
+
+    uint64_t opStart = nowNanos();
+    search(root, 500);
+    histogramRecord(&latency[OP_SEARCH], nowNanos() - opStart);
+
+    opStart = nowNanos();
+    root = delete(root, 500);
+    histogramRecord(&latency[OP_DELETE], nowNanos() - opStart);
+    freeTree(root);
+}
+
 void processFiles(const char* files[], int fileCount) {
     Node* root = NULL;
+    PerfCounters counters;
+    perfOpen(&counters);
+    static LatencyHistogram latency[OP_TYPE_COUNT], totalLatency[OP_TYPE_COUNT];
+    for (int op = 0; op < OP_TYPE_COUNT; op++) histogramInit(&totalLatency[op]);
 
     for (int i = 0; i < fileCount; i++) {
         FILE* file = fopen(files[i], "r");
@@ -290,18 +502,39 @@ void processFiles(const char* files[], int fileCount) {
         int number, nodeCount = 0;
         clock_t start, end;
 
+        for (int op = 0; op < OP_TYPE_COUNT; op++) histogramInit(&latency[op]);
+
         // Insertion time
+        resetOpCounters(&opCounters);
         start = clock();
+        perfStart(&counters);
         while (fscanf(file, "%d,", &number) == 1) {
             root = insert(root, number);
             nodeCount++;
         }
+        perfStop(&counters);
         end = clock();
         printf("Insertion time for %d nodes: %f seconds\n", nodeCount, ((double)(end - start)) / CLOCKS_PER_SEC);
+        perfReport(&counters, "Insertion", nodeCount);
+        printOpCounters("Insertion", &opCounters, nodeCount);
+        TreeStats stats = treeStats(root);
+        printTreeStats(&stats, nodeTypeNames, 2);
+
+        // Snapshot the tree and serve the same lookups from the mapped image
+        char snapshotPath[256];
+        snprintf(snapshotPath, sizeof(snapshotPath), "%s.snap", files[i]);
+        start = clock();
+        int saved = saveSnapshot(root, snapshotPath);
+        end = clock();
+        printf("Snapshot write time: %f seconds\n", ((double)(end - start)) / CLOCKS_PER_SEC);
+        if (saved == 0) snapshotBenchmark(snapshotPath, 500, 250, 750);
 
         // Search time for node with value 500
+        resetOpCounters(&opCounters);
         start = clock();
+        perfStart(&counters);
         Node* foundNode = search(root, 500);
+        perfStop(&counters);
         end = clock();
         if (foundNode != NULL) {
             printf("Node with value 500 found.\n");
@@ -309,16 +542,34 @@ void processFiles(const char* files[], int fileCount) {
             printf("Node with value 500 not found.\n");
         }
         printf("Search time for node with value 500: %f seconds\n", ((double)(end - start)) / CLOCKS_PER_SEC);
+        perfReport(&counters, "Search", 1);
+        printOpCounters("Search", &opCounters, 1);
 
         // Deletion time for node with value 500
+        resetOpCounters(&opCounters);
         start = clock();
+        perfStart(&counters);
         root = delete(root, 500);
+        perfStop(&counters);
         end = clock();
         printf("Deletion time for node with value 500: %f seconds\n", ((double)(end - start)) / CLOCKS_PER_SEC);
+        perfReport(&counters, "Deletion", 1);
+        printOpCounters("Deletion", &opCounters, 1);
+
+        recordLatencies(file, latency);
+        for (int op = 0; op < OP_TYPE_COUNT; op++) {
+            histogramPrint(&latency[op], opTypeNames[op]);
+            histogramMerge(&totalLatency[op], &latency[op]);
+        }
 
         fclose(file);
+        freeTree(root);
         root = NULL; // Reset the tree for the next file
     }
+
+    printf("\nLatency over all files:\n");
+    for (int op = 0; op < OP_TYPE_COUNT; op++) histogramPrint(&totalLatency[op], opTypeNames[op]);
+    perfClose(&counters);
 }
 
 int main() {
@@ -331,6 +582,8 @@ int main() {
     };
 
     processFiles(files, 4);
+    benchmarkSortedInsertion();
+    benchmarkChurn();
 
     return 0;
 }
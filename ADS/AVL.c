@@ -1,6 +1,16 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <stddef.h>
+#include <limits.h>
 #include <time.h>
+#include "perf_counters.h"
+#include "op_counters.h"
+#include "latency_histogram.h"
+#include "tree_stats.h"
+#include "snapshot.h"
+#include "bloom_filter.h"
+#include "veb_layout.h"
+#include "node_pool.h"
 
 int max(int a, int b){
     return a>b?a:b;
@@ -67,33 +77,51 @@ void generateDecreasingNumbersFile(const char* filename, int count) {
 }
 
 // AVL Tree structure and functions
+// Build with -DMULTISET to keep duplicates: inserting a key that is already
+// present bumps its node's count instead of being ignored
 typedef struct Node {
     int data;
+    int count;  // Occurrences of data; stays 1 unless built with MULTISET
     struct Node* left;
     struct Node* right;
     int height;
 } Node;
 
+OpCounters opCounters;  // Structural counters for the tree being benchmarked
+BloomFilter* missFilter;  // Screens out absent keys before the descent; NULL when disabled
+NodePoolSet nodePools;  // Pools compaction has moved nodes into
+Compaction compaction;  // The compaction in progress, if any
+long modCount;  // Structural changes, so an incremental compaction can tell the tree changed
+
 int height(Node* node) {
     if (node == NULL) return 0;
     return node->height;
 }
 
 Node* createNode(int data) {
+    modCount++;
     Node* newNode = (Node*)malloc(sizeof(Node));
     newNode->data = data;
+    newNode->count = 1;
     newNode->left = NULL;
     newNode->right = NULL;
     newNode->height = 1;
     return newNode;
 }
 
+// Free a node, wherever it was allocated
+void releaseNode(Node* node) {
+    if (!nodePoolSetRelease(&nodePools, node)) free(node);
+}
+
 int getBalance(Node* node) {
     if (node == NULL) return 0;
     return height(node->left) - height(node->right);
 }
 
 Node* rightRotate(Node* y) {
+    COUNT_OP(opCounters, rotations);
+    modCount++;
     Node* x = y->left;
     Node* T2 = x->right;
 
@@ -107,6 +135,8 @@ Node* rightRotate(Node* y) {
 }
 
 Node* leftRotate(Node* x) {
+    COUNT_OP(opCounters, rotations);
+    modCount++;
     Node* y = x->right;
     Node* T2 = y->left;
 
@@ -119,14 +149,22 @@ Node* leftRotate(Node* x) {
 }
 
 Node* insert(Node* node, int data) {
-    if (node == NULL) return createNode(data);
+    if (node == NULL) {
+        if (missFilter != NULL) bloomFilterAdd(missFilter, data);
+        return createNode(data);
+    }
 
+    COUNT_OP(opCounters, comparisons);
     if (data < node->data)
         node->left = insert(node->left, data);
     else if (data > node->data)
         node->right = insert(node->right, data);
-    else
+    else {
+#ifdef MULTISET
+        node->count++;
+#endif
         return node;
+    }
 
 //    node->height = 1 + (height(node->left) > height(node->right) ? height(node->left) : height(node->right));
     node->height = 1 + max(height(node->left), height(node->right));
@@ -163,6 +201,7 @@ Node* minValueNode(Node* node) {
 Node* delete(Node* root, int data) {
     if (root == NULL) return root;
 
+    COUNT_OP(opCounters, comparisons);
     if (data < root->data)
         root->left = delete(root->left, data);
     else if (data > root->data)
@@ -177,10 +216,13 @@ Node* delete(Node* root, int data) {
             } else
                 *root = *temp;
 
-            free(temp);
+            if (missFilter != NULL) bloomFilterNoteDelete(missFilter);
+            releaseNode(temp);
+            modCount++;
         } else {
             Node* temp = minValueNode(root->right);
             root->data = temp->data;
+            root->count = temp->count;
             root->right = delete(root->right, temp->data);
         }
     }
@@ -211,7 +253,10 @@ Node* delete(Node* root, int data) {
 }
 
 Node* search(Node* root, int data) {
-    if (root == NULL || root->data == data)
+    if (root == NULL) return root;
+
+    COUNT_OP(opCounters, comparisons);
+    if (root->data == data)
         return root;
 
     if (data < root->data)
@@ -220,8 +265,295 @@ Node* search(Node* root, int data) {
     return search(root->right, data);
 }
 
+void addFilterKeys(Node* node, BloomFilter* filter) {
+    if (node == NULL) return;
+    addFilterKeys(node->left, filter);
+    bloomFilterAdd(filter, node->data);
+    addFilterKeys(node->right, filter);
+}
+
+void freeTree(Node* node) {
+    if (node == NULL) return;
+    freeTree(node->left);
+    freeTree(node->right);
+    releaseNode(node);
+}
+
+int countNodes(Node* node) {
+    if (node == NULL) return 0;
+    return 1 + countNodes(node->left) + countNodes(node->right);
+}
+
+void releaseMovedNode(void* node, void* context) {
+    (void)context;
+    releaseNode((Node*)node);
+}
+
+// Start moving the tree into a fresh pool in the given order; compactStep
+// does the work. Returns -1 if the compaction cannot start.
+int compactBegin(Node* root, CompactOrder order) {
+    NodeLinks links = { sizeof(Node), offsetof(Node, left), offsetof(Node, right), -1, NULL, releaseMovedNode, NULL, NULL };
+    return compactionBegin(&compaction, &nodePools, &links, order, countNodes(root));
+}
+
+// Examine up to budget nodes of the running compaction; the tree may be
+// updated between calls. *root moves with it. Returns 1 once it is done.
+int compactStep(Node** root, long budget) {
+    return compactionStep(&compaction, &nodePools, root, modCount, budget);
+}
+
+// Move the whole tree into a fresh pool at once; returns the new root
+Node* compact(Node* root, CompactOrder order) {
+    if (compactBegin(root, order) != 0) return root;
+    while (!compactStep(&root, LONG_MAX)) {}
+    return root;
+}
+
+// Drop the bits of deleted keys by refilling the filter from the tree
+void rebuildMissFilter(Node* root) {
+    if (bloomFilterReset(missFilter, countNodes(root)) != 0) return;
+    addFilterKeys(root, missFilter);
+    missFilter->rebuilds++;
+}
+
+// Search that returns straight away when the filter rules the key out
+Node* lookup(Node* root, int data) {
+    if (missFilter == NULL) return search(root, data);
+    if (bloomFilterStale(missFilter)) rebuildMissFilter(root);
+    if (!bloomFilterMayContain(missFilter, data)) return NULL;
+    Node* node = search(root, data);
+    if (node == NULL) bloomFilterFalsePositive(missFilter);
+    return node;
+}
+
+// Number of occurrences of data
+int count(Node* root, int data) {
+    Node* node = search(root, data);
+    return node == NULL ? 0 : node->count;
+}
+
+// Remove one occurrence of data; the node goes once its count reaches zero
+Node* eraseOne(Node* root, int data) {
+    Node* node = search(root, data);
+    if (node == NULL) return root;
+    if (node->count > 1) {
+        node->count--;
+        return root;
+    }
+    return delete(root, data);
+}
+
+// Remove every occurrence of data
+Node* eraseAll(Node* root, int data) {
+    return delete(root, data);
+}
+
+// Walk the tree and report its memory footprint and shape. Nodes that
+// compaction moved into a pool have no heap block of their own.
+void collectTreeStats(Node* node, int depth, TreeStats* stats) {
+    if (node == NULL) return;
+    NodePool* pool = nodePoolSetFind(&nodePools, node);
+    if (pool != NULL) treeStatsAddNodeBytes(stats, pool->nodeSize, depth, 1);
+    else treeStatsAddNode(stats, node, sizeof(Node), depth, 1);
+    collectTreeStats(node->left, depth + 1, stats);
+    collectTreeStats(node->right, depth + 1, stats);
+}
+
+TreeStats treeStats(Node* root) {
+    TreeStats stats;
+    treeStatsInit(&stats);
+    collectTreeStats(root, 0, &stats);
+    stats.bytesAllocated += nodePoolSetOverhead(&nodePools);
+    treeStatsFinish(&stats);
+    return stats;
+}
+
+// Stream the keys in order into a snapshot writer
+void writeSnapshot(Node* node, SnapshotWriter* writer) {
+    if (node == NULL) return;
+    writeSnapshot(node->left, writer);
+    snapshotAppend(writer, node->data);
+    writeSnapshot(node->right, writer);
+}
+
+int saveSnapshot(Node* root, const char* path) {
+    SnapshotWriter* writer = snapshotBegin(path);
+    if (writer == NULL) return -1;
+    writeSnapshot(root, writer);
+    return snapshotFinish(writer);
+}
+
+// Append the keys in order
+void collectKeys(Node* node, int* keys, long* count) {
+    if (node == NULL) return;
+    collectKeys(node->left, keys, count);
+    keys[(*count)++] = node->data;
+    collectKeys(node->right, keys, count);
+}
+
+// Pointer descent against the same keys exported in van Emde Boas order,
+// from an L1-resident tree to one well past the last-level cache
+void benchmarkStaticSearch(int probes) {
+    long sizes[16];
+    int sizeCount = staticSearchSizes(sizes, 16, sizeof(Node));
+    int* queries = (int*)malloc(sizeof(int) * probes);
+    if (queries == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return;
+    }
+    printf("\nStatic search: pointer tree against van Emde Boas layout, %d probes, half of them misses\n", probes);
+
+    for (int s = 0; s < sizeCount; s++) {
+        // Even keys in random order, so odd probes miss
+        Node* root = NULL;
+        for (long i = 0; i < sizes[s]; i++) root = insert(root, rand() & 0x7ffffffe);
+        int* keys = (int*)malloc(sizeof(int) * sizes[s]);
+        if (keys == NULL) {
+            fprintf(stderr, "Memory allocation failed\n");
+            freeTree(root);
+            break;
+        }
+        long count = 0;
+        collectKeys(root, keys, &count);
+        VebLayout layout;
+        if (vebBuild(&layout, keys, count) != 0) {
+            free(keys);
+            freeTree(root);
+            break;
+        }
+        for (int i = 0; i < probes; i++) queries[i] = keys[rand() % count] | (i & 1);
+        free(keys);
+
+        long found = 0;
+        uint64_t start = nowNanos();
+        for (int i = 0; i < probes; i++) found += search(root, queries[i]) != NULL;
+        double searchNanos = (double)(nowNanos() - start) / probes;
+
+        long vebFound = 0;
+        start = nowNanos();
+        for (int i = 0; i < probes; i++) vebFound += vebContains(&layout, queries[i]);
+        double vebNanos = (double)(nowNanos() - start) / probes;
+
+        TreeStats stats = treeStats(root);
+        printf("%ld keys: tree %.1f MB, vEB array %.2f MB, pointer search %.1f ns, vEB search %.1f ns (%.2fx)%s\n",
+               count, stats.bytesAllocated / 1e6, vebBytes(&layout) / 1e6, searchNanos, vebNanos,
+               searchNanos / vebNanos, found != vebFound ? " (results differ)" : "");
+        vebFree(&layout);
+        freeTree(root);
+    }
+    free(queries);
+}
+
+// Probe keys over four times the key range, so most of them miss, once
+// with a plain descent and once through the filter
+void benchmarkMissLookups(Node* root, int range, int probes) {
+    int* keys = (int*)malloc(sizeof(int) * probes);
+    if (keys == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return;
+    }
+    for (int i = 0; i < probes; i++) keys[i] = rand() % (4 * range);
+
+    long found = 0;
+    uint64_t start = nowNanos();
+    for (int i = 0; i < probes; i++) found += search(root, keys[i]) != NULL;
+    double searchNanos = (double)(nowNanos() - start) / probes;
+
+    long filteredFound = 0;
+    start = nowNanos();
+    for (int i = 0; i < probes; i++) filteredFound += lookup(root, keys[i]) != NULL;
+    double lookupNanos = (double)(nowNanos() - start) / probes;
+
+    printf("Miss-heavy lookups: %d probes, %ld hits, search %.1f ns, filtered %.1f ns (%ld hits)\n",
+           probes, found, searchNanos, lookupNanos, filteredFound);
+    free(keys);
+}
+
+// The same comparison on a tree far larger than the caches, after deleting
+// half of its keys so the filter has to be rebuilt
+void benchmarkLargeMissLookups(int count) {
+    BloomFilter filter;
+    if (bloomFilterInit(&filter, count, BLOOM_BITS_PER_KEY) != 0) return;
+    missFilter = &filter;
+    printf("\nMiss-heavy lookups on %d keys\n", count);
+
+    int* keys = (int*)malloc(sizeof(int) * count);
+    if (keys == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        bloomFilterFree(&filter);
+        missFilter = NULL;
+        return;
+    }
+    Node* root = NULL;
+    for (int i = 0; i < count; i++) {
+        keys[i] = rand() % (4 * count);
+        root = insert(root, keys[i]);
+    }
+    for (int i = 0; i < count / 2; i++) root = delete(root, keys[i]);
+    // The first filtered probe finds the filter stale and pays for the rebuild
+    benchmarkMissLookups(root, count, count);
+    printBloomFilterStats(&filter);
+
+    freeTree(root);
+    free(keys);
+    bloomFilterFree(&filter);
+    missFilter = NULL;
+}
+
+// Snapshots of sequential IDs and of uniformly spread keys, large enough
+// for the learned index and the fence search to leave the caches
+void benchmarkLargeSnapshots(int count) {
+    for (int pass = 0; pass < 2; pass++) {
+        const char* path = pass == 0 ? "sequential_ids.snap" : "uniform_keys.snap";
+        printf("\nSnapshot of %d %s\n", count, pass == 0 ? "sequential IDs" : "uniform keys");
+        Node* root = NULL;
+        for (int i = 0; i < count; i++) root = insert(root, pass == 0 ? i : rand());
+        int saved = saveSnapshot(root, path);
+        freeTree(root);
+        if (saved == 0) snapshotBenchmark(path, count / 2, count / 4, count / 4 + 1000);
+    }
+}
+
+// Replay the file's operations on a scratch tree with a clock read around
+// each one. The counted phases of processFiles run without them, so the
+// hardware counters do not include the timer calls. The scratch tree gets
+// a miss filter of its own, leaving the measured tree's filter untouched.
+void recordLatencies(FILE* file, LatencyHistogram latency[]) {
+    BloomFilter* measuredFilter = missFilter;
+    BloomFilter filter;
+    missFilter = bloomFilterInit(&filter, 1024, BLOOM_BITS_PER_KEY) == 0 ? &filter : NULL;
+    Node* root = NULL;
+    int number;
+    rewind(file);
+    while (fscanf(file, "%d,", &number) == 1) {
+        uint64_t opStart = nowNanos();
+        root = insert(root, number);
+        histogramRecord(&latency[OP_INSERT], nowNanos() - opStart);
+    }
+
+    uint64_t opStart = nowNanos();
+    lookup(root, 500);
+    histogramRecord(&latency[OP_SEARCH], nowNanos() - opStart);
+
+    opStart = nowNanos();
+#ifdef MULTISET
+    root = eraseOne(root, 500);
+#else
+    root = delete(root, 500);
+#endif
+    histogramRecord(&latency[OP_DELETE], nowNanos() - opStart);
+    freeTree(root);
+    if (missFilter != NULL) bloomFilterFree(missFilter);
+    missFilter = measuredFilter;
+}
+
 void processFiles(const char* files[], int fileCount) {
     Node* root = NULL;
+    BloomFilter filter;
+    PerfCounters counters;
+    perfOpen(&counters);
+    static LatencyHistogram latency[OP_TYPE_COUNT], totalLatency[OP_TYPE_COUNT];
+    for (int op = 0; op < OP_TYPE_COUNT; op++) histogramInit(&totalLatency[op]);
 
     for (int i = 0; i < fileCount; i++) {
         FILE* file = fopen(files[i], "r");
@@ -235,38 +567,207 @@ void processFiles(const char* files[], int fileCount) {
         int number, nodeCount = 0;
         clock_t start, end;
 
+        for (int op = 0; op < OP_TYPE_COUNT; op++) histogramInit(&latency[op]);
+        missFilter = bloomFilterInit(&filter, 1024, BLOOM_BITS_PER_KEY) == 0 ? &filter : NULL;
+
         // Insertion time
+        resetOpCounters(&opCounters);
         start = clock();
+        perfStart(&counters);
         while (fscanf(file, "%d,", &number) == 1) {
             root = insert(root, number);
             nodeCount++;
         }
+        perfStop(&counters);
         end = clock();
         printf("Insertion time for %d nodes: %f seconds\n", nodeCount, ((double)(end - start)) / CLOCKS_PER_SEC);
+        perfReport(&counters, "Insertion", nodeCount);
+        printOpCounters("Insertion", &opCounters, nodeCount);
+        TreeStats stats = treeStats(root);
+        printTreeStats(&stats, NULL, 1);
+
+        // Snapshot the tree and serve the same lookups from the mapped image
+        char snapshotPath[256];
+        snprintf(snapshotPath, sizeof(snapshotPath), "%s.snap", files[i]);
+        start = clock();
+        int saved = saveSnapshot(root, snapshotPath);
+        end = clock();
+        printf("Snapshot write time: %f seconds\n", ((double)(end - start)) / CLOCKS_PER_SEC);
+        if (saved == 0) snapshotBenchmark(snapshotPath, 500, 250, 750);
 
         // Search time for node with value 500
         // note: for random number file value 500 may not be present everytime so please change this value depending on the element you want to delete
+        resetOpCounters(&opCounters);
         start = clock();
-        Node* foundNode = search(root, 500);
+        perfStart(&counters);
+        Node* foundNode = lookup(root, 500);
+        perfStop(&counters);
         end = clock();
         if (foundNode != NULL) {
-            printf("Node with value 500 found.\n");
+            printf("Node with value 500 found, %d occurrence(s).\n", foundNode->count);
         } else {
             printf("Node with value 500 not found.\n");
         }
         printf("Search time for node with value 500: %f seconds\n", ((double)(end - start)) / CLOCKS_PER_SEC);
+        perfReport(&counters, "Search", 1);
+        printOpCounters("Search", &opCounters, 1);
 
         // Deletion time for node with value 500
+        resetOpCounters(&opCounters);
         start = clock();
+        perfStart(&counters);
+#ifdef MULTISET
+        root = eraseOne(root, 500);
+#else
         root = delete(root, 500);
+#endif
+        perfStop(&counters);
         end = clock();
         printf("Deletion time for node with value 500: %f seconds\n", ((double)(end - start)) / CLOCKS_PER_SEC);
+        perfReport(&counters, "Deletion", 1);
+        printOpCounters("Deletion", &opCounters, 1);
+
+        benchmarkMissLookups(root, 1000, 100000);
+        if (missFilter != NULL) printBloomFilterStats(missFilter);
+
+        recordLatencies(file, latency);
+        for (int op = 0; op < OP_TYPE_COUNT; op++) {
+            histogramPrint(&latency[op], opTypeNames[op]);
+            histogramMerge(&totalLatency[op], &latency[op]);
+        }
 
         fclose(file);
+        if (missFilter != NULL) bloomFilterFree(missFilter);
+        missFilter = NULL;
         root = NULL; // Reset the tree for the next file
     }
+
+    printf("\nLatency over all files:\n");
+    for (int op = 0; op < OP_TYPE_COUNT; op++) histogramPrint(&totalLatency[op], opTypeNames[op]);
+    perfClose(&counters);
+}
+
+// Replace updates random keys of the tree: delete one, insert a new one
+Node* churnTree(Node* root, int* keys, int count, long updates) {
+    for (long i = 0; i < updates; i++) {
+        int slot = rand() % count;
+        root = delete(root, keys[slot]);
+        keys[slot] = rand() & 0x7ffffffe;
+        root = insert(root, keys[slot]);
+    }
+    return root;
+}
+
+// Nodes a search for data visits
+long searchPathLength(Node* root, int data) {
+    long visited = 0;
+    while (root != NULL) {
+        visited++;
+        if (data == root->data) break;
+        root = data < root->data ? root->left : root->right;
+    }
+    return visited;
+}
+
+// Time probes searches for current keys, every other one made to miss.
+// Returns the dTLB misses per node visited, or -1 without the counter;
+// the visits are counted afterwards, outside the counted window.
+double timeSearches(Node* root, const int* keys, int count, int* queries, int probes, PerfCounters* counters, const char* phase) {
+    for (int i = 0; i < probes; i++) queries[i] = keys[rand() % count] | (i & 1);
+    long found = 0;
+    uint64_t start = nowNanos();
+    perfStart(counters);
+    for (int i = 0; i < probes; i++) found += search(root, queries[i]) != NULL;
+    perfStop(counters);
+    printf("%s: %.1f ns per search, %ld found\n", phase, (double)(nowNanos() - start) / probes, found);
+    perfReport(counters, phase, probes);
+    long visited = 0;
+    for (int i = 0; i < probes; i++) visited += searchPathLength(root, queries[i]);
+    return perfDtlbMissRate(counters, phase, (double)visited);
+}
+
+// Searches on a tree whose nodes churn has scattered over the heap, then
+// after compacting it in DFS and in BFS order, in DFS order again on huge
+// pages, and after an incremental compaction that runs between further
+// updates
+void benchmarkCompaction(int count, int probes) {
+    printf("\nCompaction: %d keys, %d probes\n", count, probes);
+    int* keys = (int*)malloc(sizeof(int) * count);
+    int* queries = (int*)malloc(sizeof(int) * probes);
+    if (keys == NULL || queries == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        free(keys);
+        free(queries);
+        return;
+    }
+    PerfCounters counters;
+    perfOpen(&counters);
+
+    Node* root = NULL;
+    for (int i = 0; i < count; i++) {
+        keys[i] = rand() & 0x7ffffffe;
+        root = insert(root, keys[i]);
+    }
+    root = churnTree(root, keys, count, 2L * count);
+    timeSearches(root, keys, count, queries, probes, &counters, "Search after churn");
+
+    double smallPageRate = -1;
+    for (int order = COMPACT_DFS; order <= COMPACT_BFS; order++) {
+        uint64_t start = nowNanos();
+        root = compact(root, (CompactOrder)order);
+        printf("Compaction time: %f seconds\n", (nowNanos() - start) / 1e9);
+        printCompactionStats(&compaction, &nodePools);
+        TreeStats stats = treeStats(root);
+        printTreeStats(&stats, NULL, 1);
+        double rate = timeSearches(root, keys, count, queries, probes, &counters,
+                                   order == COMPACT_DFS ? "Search after DFS compaction" : "Search after BFS compaction");
+        if (order == COMPACT_DFS) smallPageRate = rate;
+    }
+
+    // The same DFS layout on 2 MB pages, so a descent needs far fewer dTLB entries
+    nodePools.hugePages = 1;
+    uint64_t hugeStart = nowNanos();
+    root = compact(root, COMPACT_DFS);
+    printf("Compaction time: %f seconds\n", (nowNanos() - hugeStart) / 1e9);
+    printCompactionStats(&compaction, &nodePools);
+    TreeStats hugeStats = treeStats(root);
+    printTreeStats(&hugeStats, NULL, 1);
+    double hugePageRate = timeSearches(root, keys, count, queries, probes, &counters, "Search after DFS compaction on huge pages");
+    nodePools.hugePages = 0;
+    perfCompareDtlbRates(smallPageRate, hugePageRate);
+
+    // Scatter the tree again, then run the first pass of a compaction a
+    // slice at a time between batches of updates, and let it finish once
+    // the updates stop
+    root = churnTree(root, keys, count, 2L * count);
+    timeSearches(root, keys, count, queries, probes, &counters, "Search after more churn");
+    long steps = 0, updates = 0;
+    int done = compactBegin(root, COMPACT_DFS) != 0;
+    for (; !done && compaction.passes < 2; steps++) {
+        root = churnTree(root, keys, count, 64);
+        updates += 64;
+        done = compactStep(&root, 4096);
+    }
+    long finishSteps = 0;
+    for (; !done; finishSteps++) done = compactStep(&root, 4096);
+    printf("Incremental compaction: %ld steps of 4096 nodes between %ld updates, %ld more to finish\n",
+           steps, updates, finishSteps);
+    printCompactionStats(&compaction, &nodePools);
+    TreeStats incrementalStats = treeStats(root);
+    printTreeStats(&incrementalStats, NULL, 1);
+    timeSearches(root, keys, count, queries, probes, &counters, "Search after incremental compaction");
+
+    freeTree(root);
+    compactionCancel(&compaction);
+    nodePoolSetDestroy(&nodePools);
+    perfClose(&counters);
+    free(keys);
+    free(queries);
 }
 
+// betree.c includes this file with AVL_NO_MAIN defined, to measure its
+// ingest against this tree's insert
+#ifndef AVL_NO_MAIN
 int main() {
     const char* files[] = {
         "random_numbers.txt", 
@@ -281,6 +782,11 @@ int main() {
     generateRandomNumbersFile(files[3], 1000);
 
     processFiles(files, 4);
+    benchmarkLargeMissLookups(1000000);
+    benchmarkLargeSnapshots(1000000);
+    benchmarkStaticSearch(1000000);
+    benchmarkCompaction(1000000, 1000000);
 
     return 0;
 }
+#endif
@@ -1,6 +1,11 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <time.h>
+#include "perf_counters.h"
+#include "op_counters.h"
+#include "latency_histogram.h"
+#include "tree_stats.h"
+#include "snapshot.h"
 
 
 void generateRandomNumbersFile(const char* filename, int count) {
@@ -69,6 +74,8 @@ typedef struct Node {
     struct Node* right;
 } Node;
 
+OpCounters opCounters;  // Structural counters for the tree being benchmarked
+
 Node* createNode(int data) {
     Node* newNode = (Node*) malloc(sizeof(Node));
     newNode->data = data;
@@ -80,6 +87,7 @@ Node* insert(Node* root, int data) {
     if (root == NULL) {
         return createNode(data);
     }
+    COUNT_OP(opCounters, comparisons);
     if (data < root->data) {
         root->left = insert(root->left, data);
     } else if (data > root->data) {
@@ -89,7 +97,11 @@ Node* insert(Node* root, int data) {
 }
 
 Node* search(Node* root, int data) {
-    if (root == NULL || root->data == data) {
+    if (root == NULL) {
+        return root;
+    }
+    COUNT_OP(opCounters, comparisons);
+    if (root->data == data) {
         return root;
     }
     if (data < root->data) {
@@ -112,6 +124,7 @@ Node* delete(Node* root, int data) {
         return NULL;
     }
 
+    COUNT_OP(opCounters, comparisons);
     if (data < root->data) {
         root->left = delete(root->left, data);
     } else if (data > root->data) {
@@ -134,8 +147,72 @@ Node* delete(Node* root, int data) {
     return root;
 }
 
+// Walk the tree and report its memory footprint and shape
+void collectTreeStats(Node* node, int depth, TreeStats* stats) {
+    if (node == NULL) return;
+    treeStatsAddNode(stats, node, sizeof(Node), depth, 1);
+    collectTreeStats(node->left, depth + 1, stats);
+    collectTreeStats(node->right, depth + 1, stats);
+}
+
+TreeStats treeStats(Node* root) {
+    TreeStats stats;
+    treeStatsInit(&stats);
+    collectTreeStats(root, 0, &stats);
+    treeStatsFinish(&stats);
+    return stats;
+}
+
+// Stream the keys in order into a snapshot writer
+void writeSnapshot(Node* node, SnapshotWriter* writer) {
+    if (node == NULL) return;
+    writeSnapshot(node->left, writer);
+    snapshotAppend(writer, node->data);
+    writeSnapshot(node->right, writer);
+}
+
+int saveSnapshot(Node* root, const char* path) {
+    SnapshotWriter* writer = snapshotBegin(path);
+    if (writer == NULL) return -1;
+    writeSnapshot(root, writer);
+    return snapshotFinish(writer);
+}
+
+void freeTree(Node* node) {
+    if (node == NULL) return;
+    freeTree(node->left);
+    freeTree(node->right);
+    free(node);
+}
+
+// Replay the file's operations on a scratch tree with a clock read around
+// each one, outside the windows the hardware counters cover
+void recordLatencies(FILE* file, LatencyHistogram latency[]) {
+    Node* root = NULL;
+    int number;
+    rewind(file);
+    while (fscanf(file, "%d,", &number) == 1) {
+        uint64_t opStart = nowNanos();
+        root = insert(root, number);
+        histogramRecord(&latency[OP_INSERT], nowNanos() - opStart);
+    }
+
+    uint64_t opStart = nowNanos();
+    search(root, 500);
+    histogramRecord(&latency[OP_SEARCH], nowNanos() - opStart);
+
+    opStart = nowNanos();
+    root = delete(root, 500);
+    histogramRecord(&latency[OP_DELETE], nowNanos() - opStart);
+    freeTree(root);
+}
+
 void processFiles(const char* files[], int fileCount) {
     Node* root = NULL;
+    PerfCounters counters;
+    perfOpen(&counters);
+    static LatencyHistogram latency[OP_TYPE_COUNT], totalLatency[OP_TYPE_COUNT];
+    for (int op = 0; op < OP_TYPE_COUNT; op++) histogramInit(&totalLatency[op]);
 
     for (int i = 0; i < fileCount; i++) {
         FILE* file = fopen(files[i], "r");
@@ -149,19 +226,40 @@ void processFiles(const char* files[], int fileCount) {
         int number, nodeCount = 0;
         clock_t start, end;
 
+        for (int op = 0; op < OP_TYPE_COUNT; op++) histogramInit(&latency[op]);
+
         // Insertion time
+        resetOpCounters(&opCounters);
         start = clock();
+        perfStart(&counters);
         while (fscanf(file, "%d,", &number) == 1) {
             root = insert(root, number);
             nodeCount++;
         }
+        perfStop(&counters);
         end = clock();
         printf("Insertion time for %d nodes: %f seconds\n", nodeCount, ((double)(end - start)) / CLOCKS_PER_SEC);
+        perfReport(&counters, "Insertion", nodeCount);
+        printOpCounters("Insertion", &opCounters, nodeCount);
+        TreeStats stats = treeStats(root);
+        printTreeStats(&stats, NULL, 1);
+
+        // Snapshot the tree and serve the same lookups from the mapped image
+        char snapshotPath[256];
+        snprintf(snapshotPath, sizeof(snapshotPath), "%s.snap", files[i]);
+        start = clock();
+        int saved = saveSnapshot(root, snapshotPath);
+        end = clock();
+        printf("Snapshot write time: %f seconds\n", ((double)(end - start)) / CLOCKS_PER_SEC);
+        if (saved == 0) snapshotBenchmark(snapshotPath, 500, 250, 750);
 
         // Search time for node with value 500
         // note: for random number file value 500 may not be present everytime so please change this value depending on the elemen you want to delete
+        resetOpCounters(&opCounters);
         start = clock();
+        perfStart(&counters);
         Node* foundNode = search(root, 500);
+        perfStop(&counters);
         end = clock();
         if (foundNode != NULL) {
             printf("Node with value 500 found.\n");
@@ -169,16 +267,33 @@ void processFiles(const char* files[], int fileCount) {
             printf("Node with value 500 not found.\n");
         }
         printf("Search time for node with value 500: %f seconds\n", ((double)(end - start)) / CLOCKS_PER_SEC);
+        perfReport(&counters, "Search", 1);
+        printOpCounters("Search", &opCounters, 1);
 
         // Deletion time for node with value 500
+        resetOpCounters(&opCounters);
         start = clock();
+        perfStart(&counters);
         root = delete(root, 500);
+        perfStop(&counters);
         end = clock();
         printf("Deletion time for node with value 500: %f seconds\n", ((double)(end - start)) / CLOCKS_PER_SEC);
+        perfReport(&counters, "Deletion", 1);
+        printOpCounters("Deletion", &opCounters, 1);
+
+        recordLatencies(file, latency);
+        for (int op = 0; op < OP_TYPE_COUNT; op++) {
+            histogramPrint(&latency[op], opTypeNames[op]);
+            histogramMerge(&totalLatency[op], &latency[op]);
+        }
 
         fclose(file);
         root = NULL; // Reset the tree for the next file
     }
+
+    printf("\nLatency over all files:\n");
+    for (int op = 0; op < OP_TYPE_COUNT; op++) histogramPrint(&totalLatency[op], opTypeNames[op]);
+    perfClose(&counters);
 }
 
 int main() {
@@ -2,6 +2,13 @@
 #include <stdlib.h>
 #include <time.h>
 #include <string.h>
+#include "perf_counters.h"
+#include "op_counters.h"
+#include "latency_histogram.h"
+#include "tree_stats.h"
+#include "snapshot.h"
+#include "hash_index.h"
+#include "veb_layout.h"
 
 
 // Function to check if a file exists
@@ -77,8 +84,11 @@ void generateDecreasingNumbersFile(const char* filename, int count) {
 // Red-Black Tree Node Structure
 typedef enum { RED, BLACK } Color;
 
+// Build with -DMULTISET to keep duplicates: inserting a key that is already
+// present bumps its node's count instead of being ignored
 typedef struct Node {
     int data;
+    int count;  // Occurrences of data; stays 1 unless built with MULTISET
     struct Node* parent;
     struct Node* left;
     struct Node* right;
@@ -86,6 +96,8 @@ typedef struct Node {
 } Node;
 
 Node* NIL;  // Sentinel NIL node for RBT
+OpCounters opCounters;  // Structural counters for the tree being benchmarked
+HashIndex* pointIndex;  // Key to node side-index for exact matches; NULL when disabled
 
 // Initialize NIL node
 void initNIL() {
@@ -93,6 +105,7 @@ void initNIL() {
     NIL->color = BLACK;
     NIL->left = NIL->right = NIL->parent = NULL;
     NIL->data = 0;
+    NIL->count = 0;
 }
 // Function to create a new node
 Node* createNode(int data) {
@@ -102,6 +115,7 @@ Node* createNode(int data) {
         exit(1);
     }
     newNode->data = data;
+    newNode->count = 1;
     newNode->parent = NIL;
     newNode->left = NIL;
     newNode->right = NIL;
@@ -134,6 +148,7 @@ void cleanupTree(Node* root) {
 
 // Function to perform a left rotate
 void leftRotate(Node** root, Node* x) {
+    COUNT_OP(opCounters, rotations);
     Node* y = x->right;
     x->right = y->left;
 
@@ -157,6 +172,7 @@ void leftRotate(Node** root, Node* x) {
 
 // Function to perform a right rotate
 void rightRotate(Node** root, Node* y) {
+    COUNT_OP(opCounters, rotations);
     Node* x = y->left;
     y->left = x->right;
 
@@ -180,6 +196,7 @@ void rightRotate(Node** root, Node* y) {
 
 void fixInsert(Node** root, Node* z) {
     while (z->parent->color == RED) {
+        COUNT_OP(opCounters, fixups);
         if (z->parent == z->parent->parent->left) {
             Node* y = z->parent->parent->right;
             if (y->color == RED) {  // Case 1: Uncle is RED
@@ -187,6 +204,7 @@ void fixInsert(Node** root, Node* z) {
                 y->color = BLACK;
                 z->parent->parent->color = RED;
                 z = z->parent->parent;
+                COUNT_OPS(opCounters, recolors, 3);
             } else {
                 if (z == z->parent->right) {  // Case 2: Triangle
                     z = z->parent;
@@ -194,6 +212,7 @@ void fixInsert(Node** root, Node* z) {
                 }
                 z->parent->color = BLACK;  // Case 3: Line
                 z->parent->parent->color = RED;
+                COUNT_OPS(opCounters, recolors, 2);
                 rightRotate(root, z->parent->parent);
             }
         } else {
@@ -203,6 +222,7 @@ void fixInsert(Node** root, Node* z) {
                 y->color = BLACK;
                 z->parent->parent->color = RED;
                 z = z->parent->parent;
+                COUNT_OPS(opCounters, recolors, 3);
             } else {
                 if (z == z->parent->left) {  // Case 2: Triangle
                     z = z->parent;
@@ -210,6 +230,7 @@ void fixInsert(Node** root, Node* z) {
                 }
                 z->parent->color = BLACK;  // Case 3: Line
                 z->parent->parent->color = RED;
+                COUNT_OPS(opCounters, recolors, 2);
                 leftRotate(root, z->parent->parent);
             }
         }
@@ -221,34 +242,46 @@ void fixInsert(Node** root, Node* z) {
 }
 
 
+// Add a new node to the side-index. An index that cannot grow would miss
+// the node, so it is dropped and lookup falls back to the tree.
+void indexNode(Node* node) {
+    if (pointIndex != NULL && hashIndexPut(pointIndex, node->data, node) != 0) {
+        hashIndexFree(pointIndex);
+        pointIndex = NULL;
+    }
+}
 
 Node* insert(Node** root, int data) {
     // If tree is empty, create root node
     if (*root == NIL) {
         *root = createNode(data);
         (*root)->color = BLACK;
+        indexNode(*root);
         return *root;
     }
 
-    Node* z = createNode(data);
     Node* y = NIL;
     Node* x = *root;
 
     // Find insertion point
     while (x != NIL) {
         y = x;
-        if (z->data < x->data) {
+        COUNT_OP(opCounters, comparisons);
+        if (data < x->data) {
             x = x->left;
-        } else if (z->data > x->data) {
+        } else if (data > x->data) {
             x = x->right;
         } else {
-            // Duplicate value, do not insert
-            free(z);
+            // Duplicate value: count it in multiset mode, otherwise ignore it
+#ifdef MULTISET
+            x->count++;
+#endif
             return x; // Return existing node if duplicate
         }
     }
 
-    // Link the new node
+    // Link the new node; it is only allocated once it is known to be new
+    Node* z = createNode(data);
     z->parent = y;
     if (y == NIL) {
         *root = z;
@@ -258,6 +291,9 @@ Node* insert(Node** root, int data) {
         y->right = z;
     }
 
+    // Nodes are relinked but never moved, so the handle stays valid
+    indexNode(z);
+
     // Restore Red-Black Tree properties
     fixInsert(root, z);
 
@@ -267,6 +303,7 @@ Node* insert(Node** root, int data) {
 // Function to search for a node in the RBT
 Node* search(Node* root, int data) {
     while (root != NIL && data != root->data) {
+        COUNT_OP(opCounters, comparisons);
         if (data < root->data) {
             root = root->left;
         } else {
@@ -276,30 +313,41 @@ Node* search(Node* root, int data) {
     return root == NIL ? NULL : root;
 }
 
+// Exact-match lookup through the side-index when it is enabled
+Node* lookup(Node* root, int data) {
+    if (pointIndex == NULL) return search(root, data);
+    return (Node*)hashIndexFind(pointIndex, data);
+}
+
 // Fixup function for Red-Black Tree after deletion
 void fixDelete(Node** root, Node* x) {
     while (x != *root && x->color == BLACK) {
+        COUNT_OP(opCounters, fixups);
         if (x == x->parent->left) {
             Node* w = x->parent->right;
             if (w->color == RED) {  // Case 1: Sibling is RED
                 w->color = BLACK;
                 x->parent->color = RED;
+                COUNT_OPS(opCounters, recolors, 2);
                 leftRotate(root, x->parent);
                 w = x->parent->right;
             }
             if (w->left->color == BLACK && w->right->color == BLACK) {  // Case 2: Sibling's children are BLACK
                 w->color = RED;
+                COUNT_OP(opCounters, recolors);
                 x = x->parent;
             } else {
                 if (w->right->color == BLACK) {  // Case 3: Sibling's right child is BLACK
                     w->left->color = BLACK;
                     w->color = RED;
+                    COUNT_OPS(opCounters, recolors, 2);
                     rightRotate(root, w);
                     w = x->parent->right;
                 }
                 w->color = x->parent->color;  // Case 4: Sibling's right child is RED
                 x->parent->color = BLACK;
                 w->right->color = BLACK;
+                COUNT_OPS(opCounters, recolors, 3);
                 leftRotate(root, x->parent);
                 x = *root;
             }
@@ -308,22 +356,26 @@ void fixDelete(Node** root, Node* x) {
             if (w->color == RED) {
                 w->color = BLACK;
                 x->parent->color = RED;
+                COUNT_OPS(opCounters, recolors, 2);
                 rightRotate(root, x->parent);
                 w = x->parent->left;
             }
             if (w->left->color == BLACK && w->right->color == BLACK) {
                 w->color = RED;
+                COUNT_OP(opCounters, recolors);
                 x = x->parent;
             } else {
                 if (w->left->color == BLACK) {
                     w->right->color = BLACK;
                     w->color = RED;
+                    COUNT_OPS(opCounters, recolors, 2);
                     leftRotate(root, w);
                     w = x->parent->left;
                 }
                 w->color = x->parent->color;
                 x->parent->color = BLACK;
                 w->left->color = BLACK;
+                COUNT_OPS(opCounters, recolors, 3);
                 rightRotate(root, x->parent);
                 x = *root;
             }
@@ -380,6 +432,7 @@ void deleteNode(Node** root, Node* z) {
             } else {
                 y->parent->right = x;
             }
+            x->parent = y->parent;
             y->right = z->right;
             y->right->parent = y;
         }
@@ -400,9 +453,33 @@ void deleteNode(Node** root, Node* z) {
         fixDelete(root, x);
     }
 
+    if (pointIndex != NULL) hashIndexErase(pointIndex, z->data);
     free(z);
 }
 
+// Number of occurrences of data
+int count(Node* root, int data) {
+    Node* node = search(root, data);
+    return node == NULL ? 0 : node->count;
+}
+
+// Remove one occurrence of data; the node goes once its count reaches zero
+void eraseOne(Node** root, int data) {
+    Node* node = search(*root, data);
+    if (node == NULL) return;
+    if (node->count > 1) {
+        node->count--;
+        return;
+    }
+    deleteNode(root, node);
+}
+
+// Remove every occurrence of data
+void eraseAll(Node** root, int data) {
+    Node* node = search(*root, data);
+    if (node != NULL) deleteNode(root, node);
+}
+
 void freeTree(Node* root) {
     if (root == NULL) return;
     freeTree(root->left);
@@ -411,8 +488,135 @@ void freeTree(Node* root) {
 }
 
 
+// Walk the tree and report its memory footprint and shape
+void collectTreeStats(Node* node, int depth, TreeStats* stats) {
+    if (node == NIL) return;
+    treeStatsAddNode(stats, node, sizeof(Node), depth, 1);
+    collectTreeStats(node->left, depth + 1, stats);
+    collectTreeStats(node->right, depth + 1, stats);
+}
+
+TreeStats treeStats(Node* root) {
+    TreeStats stats;
+    treeStatsInit(&stats);
+    collectTreeStats(root, 0, &stats);
+    stats.bytesAllocated += allocationBytes(NIL, sizeof(Node));  // Shared sentinel
+    treeStatsFinish(&stats);
+    return stats;
+}
+
+// Stream the keys in order into a snapshot writer
+void writeSnapshot(Node* node, SnapshotWriter* writer) {
+    if (node == NIL) return;
+    writeSnapshot(node->left, writer);
+    snapshotAppend(writer, node->data);
+    writeSnapshot(node->right, writer);
+}
+
+int saveSnapshot(Node* root, const char* path) {
+    SnapshotWriter* writer = snapshotBegin(path);
+    if (writer == NULL) return -1;
+    writeSnapshot(root, writer);
+    return snapshotFinish(writer);
+}
+
+// Append the keys in order
+void collectKeys(Node* node, int* keys, long* count) {
+    if (node == NIL) return;
+    collectKeys(node->left, keys, count);
+    keys[(*count)++] = node->data;
+    collectKeys(node->right, keys, count);
+}
+
+// Pointer descent against the same keys exported in van Emde Boas order,
+// from an L1-resident tree to one well past the last-level cache
+void benchmarkStaticSearch(int probes) {
+    long sizes[16];
+    int sizeCount = staticSearchSizes(sizes, 16, sizeof(Node));
+    int* queries = (int*)malloc(sizeof(int) * probes);
+    if (queries == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return;
+    }
+    printf("\nStatic search: pointer tree against van Emde Boas layout, %d probes, half of them misses\n", probes);
+
+    for (int s = 0; s < sizeCount; s++) {
+        // Even keys in random order, so odd probes miss
+        Node* root = NIL;
+        for (long i = 0; i < sizes[s]; i++) insert(&root, rand() & 0x7ffffffe);
+        int* keys = (int*)malloc(sizeof(int) * sizes[s]);
+        if (keys == NULL) {
+            fprintf(stderr, "Memory allocation failed\n");
+            freeTreeRecursive(root);
+            break;
+        }
+        long count = 0;
+        collectKeys(root, keys, &count);
+        VebLayout layout;
+        if (vebBuild(&layout, keys, count) != 0) {
+            free(keys);
+            freeTreeRecursive(root);
+            break;
+        }
+        for (int i = 0; i < probes; i++) queries[i] = keys[rand() % count] | (i & 1);
+        free(keys);
+
+        long found = 0;
+        uint64_t start = nowNanos();
+        for (int i = 0; i < probes; i++) found += search(root, queries[i]) != NULL;
+        double searchNanos = (double)(nowNanos() - start) / probes;
+
+        long vebFound = 0;
+        start = nowNanos();
+        for (int i = 0; i < probes; i++) vebFound += vebContains(&layout, queries[i]);
+        double vebNanos = (double)(nowNanos() - start) / probes;
+
+        TreeStats stats = treeStats(root);
+        printf("%ld keys: tree %.1f MB, vEB array %.2f MB, pointer search %.1f ns, vEB search %.1f ns (%.2fx)%s\n",
+               count, stats.bytesAllocated / 1e6, vebBytes(&layout) / 1e6, searchNanos, vebNanos,
+               searchNanos / vebNanos, found != vebFound ? " (results differ)" : "");
+        vebFree(&layout);
+        freeTreeRecursive(root);
+    }
+    free(queries);
+}
+
+// Replay the file's operations on a scratch tree, with a point index of its
+// own and a clock read around each one, outside the windows the hardware
+// counters cover
+void recordLatencies(FILE* file, LatencyHistogram latency[]) {
+    HashIndex* measuredIndex = pointIndex;
+    HashIndex index;
+    pointIndex = hashIndexInit(&index, 1024) == 0 ? &index : NULL;
+    Node* root = NIL;
+    char buffer[1024];
+    int number;
+    rewind(file);
+    while (fgets(buffer, sizeof(buffer), file)) {
+        for (char* token = strtok(buffer, ","); token != NULL; token = strtok(NULL, ",")) {
+            if (sscanf(token, "%d", &number) != 1) continue;
+            uint64_t opStart = nowNanos();
+            insert(&root, number);
+            histogramRecord(&latency[OP_INSERT], nowNanos() - opStart);
+        }
+    }
+
+    uint64_t opStart = nowNanos();
+    lookup(root, 500);
+    histogramRecord(&latency[OP_SEARCH], nowNanos() - opStart);
+
+    freeTreeRecursive(root);
+    if (pointIndex != NULL) hashIndexFree(pointIndex);
+    pointIndex = measuredIndex;
+}
+
 void processFiles(const char* files[], int fileCount) {
     Node* root = NIL;  // Initialize root to NIL
+    HashIndex index;
+    PerfCounters counters;
+    perfOpen(&counters);
+    static LatencyHistogram latency[OP_TYPE_COUNT], totalLatency[OP_TYPE_COUNT];
+    for (int op = 0; op < OP_TYPE_COUNT; op++) histogramInit(&totalLatency[op]);
 
     for (int i = 0; i < fileCount; i++) {
         FILE* file = fopen(files[i], "r");
@@ -428,9 +632,14 @@ void processFiles(const char* files[], int fileCount) {
 
         // Reset root to NIL before processing
         root = NIL;
+        pointIndex = hashIndexInit(&index, 1024) == 0 ? &index : NULL;
+
+        for (int op = 0; op < OP_TYPE_COUNT; op++) histogramInit(&latency[op]);
 
         // Insertion time
+        resetOpCounters(&opCounters);
         start = clock();
+        perfStart(&counters);
 
         // Use a more robust reading method
         char buffer[1024];
@@ -448,25 +657,59 @@ void processFiles(const char* files[], int fileCount) {
             }
         }
 
+        perfStop(&counters);
         end = clock();
         printf("Insertion time for %d nodes: %f seconds\n", nodeCount, ((double)(end - start)) / CLOCKS_PER_SEC);
+        perfReport(&counters, "Insertion", nodeCount);
+        printOpCounters("Insertion", &opCounters, nodeCount);
+        TreeStats stats = treeStats(root);
+        printTreeStats(&stats, NULL, 1);
+        if (pointIndex != NULL) printHashIndexStats(pointIndex);
+
+        // Snapshot the tree and serve the same lookups from the mapped image
+        char snapshotPath[256];
+        snprintf(snapshotPath, sizeof(snapshotPath), "%s.snap", files[i]);
+        start = clock();
+        int saved = saveSnapshot(root, snapshotPath);
+        end = clock();
+        printf("Snapshot write time: %f seconds\n", ((double)(end - start)) / CLOCKS_PER_SEC);
+        if (saved == 0) snapshotBenchmark(snapshotPath, 500, 250, 750);
 
         // Search time for node with value 500
+        resetOpCounters(&opCounters);
         start = clock();
-        Node* foundNode = search(root, 500);
+        perfStart(&counters);
+        Node* foundNode = lookup(root, 500);
+        perfStop(&counters);
         end = clock();
         if (foundNode != NULL) {
-            printf("Node with value 500 found.\n");
+            printf("Node with value 500 found, %d occurrence(s).\n", foundNode->count);
         } else {
             printf("Node with value 500 not found.\n");
         }
         printf("Search time for node with value 500: %f seconds\n", ((double)(end - start)) / CLOCKS_PER_SEC);
+        perfReport(&counters, "Search", 1);
+        printOpCounters("Search", &opCounters, 1);
+
+        recordLatencies(file, latency);
+        for (int op = 0; op < OP_TYPE_COUNT; op++) {
+            histogramPrint(&latency[op], opTypeNames[op]);
+            histogramMerge(&totalLatency[op], &latency[op]);
+        }
 
         fclose(file);
 
-        // Cleanup the tree after processing each file
-        cleanupTree(root);
+        // Free the tree after processing each file; the NIL sentinel is shared
+        // by every tree and is only released once all files are done
+        freeTreeRecursive(root);
+        if (pointIndex != NULL) hashIndexFree(pointIndex);
+        pointIndex = NULL;
     }
+    cleanupTree(NIL);
+    perfClose(&counters);
+
+    printf("\nLatency over all files:\n");
+    for (int op = 0; op < OP_TYPE_COUNT; op++) histogramPrint(&totalLatency[op], opTypeNames[op]);
 }
 
 
@@ -483,10 +726,13 @@ int main() {
 
     generateIncreasingNumbersFile(files[0], 1000);
     generateDecreasingNumbersFile(files[1], 1000);
-    generateRandomNumbersFile(files[3], 1000);
-    generateMixedNumbersFile(files[4], 500, 500);
+    generateRandomNumbersFile(files[2], 1000);
+    generateMixedNumbersFile(files[3], 500, 500);
 
     processFiles(files, 4);
+    initNIL();  // processFiles released the sentinel
+    benchmarkStaticSearch(1000000);
+    cleanupTree(NIL);
 
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,943 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "perf_counters.h"
+#include "latency_histogram.h"
+#include "tree_stats.h"
+#include "snapshot.h"
+#include "avl_template.h"
+
+// The radix tree is measured against AVL.c itself; the names it shares
+// with this file are renamed for the include
+#define AVL_NO_MAIN
+#define Node AvlNode
+#define createNode avlCreateNode
+#define insert avlInsert
+#define delete avlDelete
+#define search avlSearch
+#define count avlCount
+#define eraseOne avlEraseOne
+#define eraseAll avlEraseAll
+#define freeTree avlFreeTree
+#define collectTreeStats avlCollectTreeStats
+#define treeStats avlTreeStats
+#define writeSnapshot avlWriteSnapshot
+#define saveSnapshot avlSaveSnapshot
+#define recordLatencies avlRecordLatencies
+#define processFiles avlProcessFiles
+#include "AVL.c"
+#undef Node
+#undef createNode
+#undef insert
+#undef delete
+#undef search
+#undef count
+#undef eraseOne
+#undef eraseAll
+#undef freeTree
+#undef collectTreeStats
+#undef treeStats
+#undef writeSnapshot
+#undef saveSnapshot
+#undef recordLatencies
+#undef processFiles
+
+// Adaptive radix tree over integer keys. A key is split into bytes, most
+// significant first with the sign bit flipped so that byte order equals
+// numeric order, and every inner node branches on one byte. Inner nodes come
+// in four sizes (Node4, Node16, Node48, Node256) and grow or shrink with
+// their child count, so sparse levels stay small and dense levels become a
+// direct 256-way array. Bytes that every key below a node shares are stored
+// once in the node (path compression), and a subtree holding a single key is
+// just a leaf in the parent's child slot (lazy expansion). A lookup touches
+// at most one node per key byte whatever the number of keys.
+//
+// Keys are 32-bit by default; build with -DART_WIDE_KEYS for 64-bit keys.
+// A leaf is a tagged child pointer: 32-bit keys and their count live in the
+// pointer itself, wide keys in a small allocated leaf.
+//
+// Build with -DMULTISET to keep duplicates: inserting a key that is already
+// present bumps its leaf's count instead of being ignored
+#ifdef ART_WIDE_KEYS
+typedef int64_t Key;
+typedef uint64_t KeyBits;
+#else
+typedef int32_t Key;
+typedef uint32_t KeyBits;
+#endif
+#define KEY_BYTES ((int)sizeof(Key))
+#define SCALED_KEYS 2000000  // Keys per shape in benchmarkScaled by default
+
+typedef enum { NODE4, NODE16, NODE48, NODE256, NODE_TYPE_COUNT } NodeType;
+
+static const char* nodeTypeNames[NODE_TYPE_COUNT] = { "Node4", "Node16", "Node48", "Node256" };
+
+// Common header. The node branches on key byte depth + prefixLength, where
+// depth is the number of key bytes consumed above it.
+typedef struct Node {
+    uint8_t type;
+    uint8_t prefixLength;
+    uint16_t childCount;
+    uint8_t prefix[KEY_BYTES - 1];
+} Node;
+
+typedef struct Node4 {
+    Node header;
+    uint8_t keys[4];        // Sorted
+    Node* children[4];
+} Node4;
+
+typedef struct Node16 {
+    Node header;
+    uint8_t keys[16];       // Sorted
+    Node* children[16];
+} Node16;
+
+typedef struct Node48 {
+    Node header;
+    uint8_t childIndex[256];  // Slot + 1 in children, 0 when the byte has no child
+    Node* children[48];
+} Node48;
+
+typedef struct Node256 {
+    Node header;
+    Node* children[256];
+} Node256;
+
+// Leaves are child pointers with the low bit set
+static bool isLeaf(const Node* node) {
+    return ((uintptr_t)node & 1) != 0;
+}
+
+#ifdef ART_WIDE_KEYS
+typedef struct Leaf {
+    Key key;
+    int count;
+} Leaf;
+
+#define LEAF(node) ((Leaf*)((uintptr_t)(node) & ~(uintptr_t)1))
+
+Node* makeLeaf(Key key, int count) {
+    Leaf* leaf = (Leaf*)malloc(sizeof(Leaf));
+    if (leaf == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(1);
+    }
+    leaf->key = key;
+    leaf->count = count;
+    return (Node*)((uintptr_t)leaf | 1);
+}
+
+Key leafKey(const Node* node) {
+    return LEAF(node)->key;
+}
+
+int leafCount(const Node* node) {
+    return LEAF(node)->count;
+}
+
+void setLeafCount(Node** ref, int count) {
+    LEAF(*ref)->count = count;
+}
+
+void freeLeaf(Node* node) {
+    free(LEAF(node));
+}
+#else
+// Key in bits 1-32, count in bits 33-63
+Node* makeLeaf(Key key, int count) {
+    return (Node*)(((uintptr_t)count << 33) | ((uintptr_t)(uint32_t)key << 1) | 1);
+}
+
+Key leafKey(const Node* node) {
+    return (Key)(uint32_t)((uintptr_t)node >> 1);
+}
+
+int leafCount(const Node* node) {
+    return (int)((uintptr_t)node >> 33);
+}
+
+void setLeafCount(Node** ref, int count) {
+    *ref = makeLeaf(leafKey(*ref), count);
+}
+
+void freeLeaf(Node* node) {
+    (void)node;
+}
+#endif
+
+// Big-endian bytes with the sign bit flipped
+void keyBytes(Key key, uint8_t* bytes) {
+    KeyBits bits = (KeyBits)key ^ ((KeyBits)1 << (8 * KEY_BYTES - 1));
+    for (int i = KEY_BYTES - 1; i >= 0; i--) {
+        bytes[i] = (uint8_t)bits;
+        bits >>= 8;
+    }
+}
+
+Node* createNode(NodeType type) {
+    static const size_t sizes[NODE_TYPE_COUNT] = { sizeof(Node4), sizeof(Node16), sizeof(Node48), sizeof(Node256) };
+    Node* node = (Node*)calloc(1, sizes[type]);
+    if (node == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(1);
+    }
+    node->type = (uint8_t)type;
+    return node;
+}
+
+size_t nodeSize(const Node* node) {
+    switch (node->type) {
+    case NODE4: return sizeof(Node4);
+    case NODE16: return sizeof(Node16);
+    case NODE48: return sizeof(Node48);
+    default: return sizeof(Node256);
+    }
+}
+
+void copyHeader(Node* dst, const Node* src) {
+    dst->prefixLength = src->prefixLength;
+    dst->childCount = src->childCount;
+    memcpy(dst->prefix, src->prefix, src->prefixLength);
+}
+
+// Children of node in byte order; returns how many there are
+int childList(const Node* node, Node** children) {
+    int count = 0;
+    switch (node->type) {
+    case NODE4:
+        memcpy(children, ((const Node4*)node)->children, node->childCount * sizeof(Node*));
+        return node->childCount;
+    case NODE16:
+        memcpy(children, ((const Node16*)node)->children, node->childCount * sizeof(Node*));
+        return node->childCount;
+    case NODE48: {
+        const Node48* n = (const Node48*)node;
+        for (int b = 0; b < 256; b++) {
+            if (n->childIndex[b]) children[count++] = n->children[n->childIndex[b] - 1];
+        }
+        return count;
+    }
+    default: {
+        const Node256* n = (const Node256*)node;
+        for (int b = 0; b < 256; b++) {
+            if (n->children[b]) children[count++] = n->children[b];
+        }
+        return count;
+    }
+    }
+}
+
+// Slot holding the child for byte, or NULL if there is none
+Node** findChild(Node* node, uint8_t byte) {
+    switch (node->type) {
+    case NODE4: {
+        Node4* n = (Node4*)node;
+        for (int i = 0; i < node->childCount; i++) {
+            if (n->keys[i] == byte) return &n->children[i];
+        }
+        return NULL;
+    }
+    case NODE16: {
+        Node16* n = (Node16*)node;
+#ifdef __SSE2__
+        __m128i cmp = _mm_cmpeq_epi8(_mm_set1_epi8((char)byte), _mm_loadu_si128((const __m128i*)n->keys));
+        unsigned mask = (unsigned)_mm_movemask_epi8(cmp) & ((1u << node->childCount) - 1);
+        return mask ? &n->children[__builtin_ctz(mask)] : NULL;
+#else
+        for (int i = 0; i < node->childCount; i++) {
+            if (n->keys[i] == byte) return &n->children[i];
+        }
+        return NULL;
+#endif
+    }
+    case NODE48: {
+        Node48* n = (Node48*)node;
+        return n->childIndex[byte] ? &n->children[n->childIndex[byte] - 1] : NULL;
+    }
+    default: {
+        Node256* n = (Node256*)node;
+        return n->children[byte] ? &n->children[byte] : NULL;
+    }
+    }
+}
+
+// Child with the smallest byte greater than byte, or NULL; -1 gives the first child
+Node* nextChild(Node* node, int byte) {
+    switch (node->type) {
+    case NODE4:
+    case NODE16: {
+        uint8_t* keys = node->type == NODE4 ? ((Node4*)node)->keys : ((Node16*)node)->keys;
+        Node** children = node->type == NODE4 ? ((Node4*)node)->children : ((Node16*)node)->children;
+        for (int i = 0; i < node->childCount; i++) {
+            if (keys[i] > byte) return children[i];
+        }
+        return NULL;
+    }
+    case NODE48: {
+        Node48* n = (Node48*)node;
+        for (int b = byte + 1; b < 256; b++) {
+            if (n->childIndex[b]) return n->children[n->childIndex[b] - 1];
+        }
+        return NULL;
+    }
+    default: {
+        Node256* n = (Node256*)node;
+        for (int b = byte + 1; b < 256; b++) {
+            if (n->children[b]) return n->children[b];
+        }
+        return NULL;
+    }
+    }
+}
+
+// Insert into a sorted Node4/Node16 key array with room to spare
+void insertSorted(uint8_t* keys, Node** children, int count, uint8_t byte, Node* child) {
+    int pos = 0;
+    while (pos < count && keys[pos] < byte) pos++;
+    memmove(keys + pos + 1, keys + pos, count - pos);
+    memmove(children + pos + 1, children + pos, (count - pos) * sizeof(Node*));
+    keys[pos] = byte;
+    children[pos] = child;
+}
+
+// Add a child for a byte that has none, growing the node into the next size
+// when it is full; *ref is updated when the node is replaced
+void addChild(Node** ref, Node* node, uint8_t byte, Node* child) {
+    switch (node->type) {
+    case NODE4: {
+        Node4* n = (Node4*)node;
+        if (node->childCount < 4) {
+            insertSorted(n->keys, n->children, node->childCount++, byte, child);
+            return;
+        }
+        Node16* grown = (Node16*)createNode(NODE16);
+        copyHeader(&grown->header, node);
+        memcpy(grown->keys, n->keys, 4);
+        memcpy(grown->children, n->children, 4 * sizeof(Node*));
+        *ref = &grown->header;
+        free(node);
+        addChild(ref, &grown->header, byte, child);
+        return;
+    }
+    case NODE16: {
+        Node16* n = (Node16*)node;
+        if (node->childCount < 16) {
+            insertSorted(n->keys, n->children, node->childCount++, byte, child);
+            return;
+        }
+        Node48* grown = (Node48*)createNode(NODE48);
+        copyHeader(&grown->header, node);
+        for (int i = 0; i < 16; i++) {
+            grown->childIndex[n->keys[i]] = (uint8_t)(i + 1);
+            grown->children[i] = n->children[i];
+        }
+        *ref = &grown->header;
+        free(node);
+        addChild(ref, &grown->header, byte, child);
+        return;
+    }
+    case NODE48: {
+        Node48* n = (Node48*)node;
+        if (node->childCount < 48) {
+            int slot = 0;
+            while (n->children[slot] != NULL) slot++;
+            n->children[slot] = child;
+            n->childIndex[byte] = (uint8_t)(slot + 1);
+            node->childCount++;
+            return;
+        }
+        Node256* grown = (Node256*)createNode(NODE256);
+        copyHeader(&grown->header, node);
+        for (int b = 0; b < 256; b++) {
+            if (n->childIndex[b]) grown->children[b] = n->children[n->childIndex[b] - 1];
+        }
+        *ref = &grown->header;
+        free(node);
+        addChild(ref, &grown->header, byte, child);
+        return;
+    }
+    default: {
+        Node256* n = (Node256*)node;
+        n->children[byte] = child;
+        node->childCount++;
+        return;
+    }
+    }
+}
+
+// Drop the child for byte, shrinking the node when it falls well below its
+// size. A Node4 left with one child is replaced by that child: a leaf moves
+// up as is, an inner node absorbs the parent's prefix and the branch byte.
+void removeChild(Node** ref, Node* node, uint8_t byte) {
+    switch (node->type) {
+    case NODE4:
+    case NODE16: {
+        uint8_t* keys = node->type == NODE4 ? ((Node4*)node)->keys : ((Node16*)node)->keys;
+        Node** children = node->type == NODE4 ? ((Node4*)node)->children : ((Node16*)node)->children;
+        int pos = 0;
+        while (keys[pos] != byte) pos++;
+        memmove(keys + pos, keys + pos + 1, node->childCount - pos - 1);
+        memmove(children + pos, children + pos + 1, (node->childCount - pos - 1) * sizeof(Node*));
+        node->childCount--;
+        break;
+    }
+    case NODE48: {
+        Node48* n = (Node48*)node;
+        n->children[n->childIndex[byte] - 1] = NULL;
+        n->childIndex[byte] = 0;
+        node->childCount--;
+        break;
+    }
+    default:
+        ((Node256*)node)->children[byte] = NULL;
+        node->childCount--;
+        break;
+    }
+
+    if (node->type == NODE4 && node->childCount == 1) {
+        Node4* n = (Node4*)node;
+        Node* child = n->children[0];
+        if (!isLeaf(child)) {
+            uint8_t prefix[KEY_BYTES];
+            int length = node->prefixLength;
+            memcpy(prefix, node->prefix, length);
+            prefix[length++] = n->keys[0];
+            memcpy(prefix + length, child->prefix, child->prefixLength);
+            length += child->prefixLength;
+            memcpy(child->prefix, prefix, length);
+            child->prefixLength = (uint8_t)length;
+        }
+        *ref = child;
+        free(node);
+    } else if (node->type == NODE16 && node->childCount <= 3) {
+        Node16* n = (Node16*)node;
+        Node4* shrunk = (Node4*)createNode(NODE4);
+        copyHeader(&shrunk->header, node);
+        memcpy(shrunk->keys, n->keys, node->childCount);
+        memcpy(shrunk->children, n->children, node->childCount * sizeof(Node*));
+        *ref = &shrunk->header;
+        free(node);
+    } else if (node->type == NODE48 && node->childCount <= 12) {
+        Node48* n = (Node48*)node;
+        Node16* shrunk = (Node16*)createNode(NODE16);
+        copyHeader(&shrunk->header, node);
+        int count = 0;
+        for (int b = 0; b < 256; b++) {
+            if (n->childIndex[b]) {
+                shrunk->keys[count] = (uint8_t)b;
+                shrunk->children[count++] = n->children[n->childIndex[b] - 1];
+            }
+        }
+        *ref = &shrunk->header;
+        free(node);
+    } else if (node->type == NODE256 && node->childCount <= 37) {
+        Node256* n = (Node256*)node;
+        Node48* shrunk = (Node48*)createNode(NODE48);
+        copyHeader(&shrunk->header, node);
+        int count = 0;
+        for (int b = 0; b < 256; b++) {
+            if (n->children[b]) {
+                shrunk->children[count] = n->children[b];
+                shrunk->childIndex[b] = (uint8_t)++count;
+            }
+        }
+        *ref = &shrunk->header;
+        free(node);
+    }
+}
+
+// Length of the prefix of node that matches bytes from depth on
+int prefixMismatch(const Node* node, const uint8_t* bytes, int depth) {
+    int i = 0;
+    while (i < node->prefixLength && node->prefix[i] == bytes[depth + i]) i++;
+    return i;
+}
+
+// Returns true if a new key was added
+bool insertAt(Node** ref, Key key, const uint8_t* bytes, int depth) {
+    Node* node = *ref;
+    if (node == NULL) {
+        *ref = makeLeaf(key, 1);
+        return true;
+    }
+
+    if (isLeaf(node)) {
+        if (leafKey(node) == key) {
+#ifdef MULTISET
+            setLeafCount(ref, leafCount(node) + 1);
+#endif
+            return false;
+        }
+        // Two keys in one slot: branch where they first differ
+        uint8_t existing[KEY_BYTES];
+        keyBytes(leafKey(node), existing);
+        int split = depth;
+        while (existing[split] == bytes[split]) split++;
+        Node4* branch = (Node4*)createNode(NODE4);
+        branch->header.prefixLength = (uint8_t)(split - depth);
+        memcpy(branch->header.prefix, bytes + depth, split - depth);
+        *ref = &branch->header;
+        addChild(ref, &branch->header, existing[split], node);
+        addChild(ref, &branch->header, bytes[split], makeLeaf(key, 1));
+        return true;
+    }
+
+    int matched = prefixMismatch(node, bytes, depth);
+    if (matched < node->prefixLength) {
+        // The key leaves the compressed path: branch at the first difference
+        Node4* branch = (Node4*)createNode(NODE4);
+        branch->header.prefixLength = (uint8_t)matched;
+        memcpy(branch->header.prefix, node->prefix, matched);
+        uint8_t oldByte = node->prefix[matched];
+        node->prefixLength -= (uint8_t)(matched + 1);
+        memmove(node->prefix, node->prefix + matched + 1, node->prefixLength);
+        *ref = &branch->header;
+        addChild(ref, &branch->header, oldByte, node);
+        addChild(ref, &branch->header, bytes[depth + matched], makeLeaf(key, 1));
+        return true;
+    }
+
+    depth += node->prefixLength;
+    Node** child = findChild(node, bytes[depth]);
+    if (child != NULL) return insertAt(child, key, bytes, depth + 1);
+    addChild(ref, node, bytes[depth], makeLeaf(key, 1));
+    return true;
+}
+
+Node* insert(Node* root, Key key) {
+    uint8_t bytes[KEY_BYTES];
+    keyBytes(key, bytes);
+    insertAt(&root, key, bytes, 0);
+    return root;
+}
+
+// Number of occurrences of key
+int count(Node* root, Key key) {
+    uint8_t bytes[KEY_BYTES];
+    keyBytes(key, bytes);
+    Node* node = root;
+    int depth = 0;
+    while (node != NULL) {
+        if (isLeaf(node)) return leafKey(node) == key ? leafCount(node) : 0;
+        if (prefixMismatch(node, bytes, depth) < node->prefixLength) return 0;
+        depth += node->prefixLength;
+        Node** child = findChild(node, bytes[depth]);
+        if (child == NULL) return 0;
+        node = *child;
+        depth++;
+    }
+    return 0;
+}
+
+bool search(Node* root, Key key) {
+    return count(root, key) > 0;
+}
+
+// Returns true if an occurrence was removed; all removes every occurrence
+bool deleteAt(Node** ref, Key key, const uint8_t* bytes, int depth, bool all) {
+    Node* node = *ref;
+    if (node == NULL) return false;
+
+    if (isLeaf(node)) {
+        if (leafKey(node) != key) return false;
+        if (!all && leafCount(node) > 1) {
+            setLeafCount(ref, leafCount(node) - 1);
+            return true;
+        }
+        freeLeaf(node);
+        *ref = NULL;
+        return true;
+    }
+
+    if (prefixMismatch(node, bytes, depth) < node->prefixLength) return false;
+    depth += node->prefixLength;
+    Node** child = findChild(node, bytes[depth]);
+    if (child == NULL) return false;
+    bool removed = deleteAt(child, key, bytes, depth + 1, all);
+    if (removed && *child == NULL) removeChild(ref, node, bytes[depth]);
+    return removed;
+}
+
+// Remove one occurrence of key; the leaf goes once its count reaches zero
+Node* eraseOne(Node* root, Key key) {
+    uint8_t bytes[KEY_BYTES];
+    keyBytes(key, bytes);
+    deleteAt(&root, key, bytes, 0, false);
+    return root;
+}
+
+// Remove every occurrence of key
+Node* eraseAll(Node* root, Key key) {
+    uint8_t bytes[KEY_BYTES];
+    keyBytes(key, bytes);
+    deleteAt(&root, key, bytes, 0, true);
+    return root;
+}
+
+Node* delete(Node* root, Key key) {
+    return eraseAll(root, key);
+}
+
+Node* minimumLeaf(Node* node) {
+    while (node != NULL && !isLeaf(node)) node = nextChild(node, -1);
+    return node;
+}
+
+// Leaf with the smallest key >= key below node, or NULL
+Node* lowerBoundAt(Node* node, Key key, const uint8_t* bytes, int depth) {
+    if (node == NULL) return NULL;
+    if (isLeaf(node)) return leafKey(node) >= key ? node : NULL;
+
+    for (int i = 0; i < node->prefixLength; i++) {
+        if (node->prefix[i] < bytes[depth + i]) return NULL;       // Whole subtree is smaller
+        if (node->prefix[i] > bytes[depth + i]) return minimumLeaf(node);  // Whole subtree is larger
+    }
+    depth += node->prefixLength;
+    Node** child = findChild(node, bytes[depth]);
+    if (child != NULL) {
+        Node* leaf = lowerBoundAt(*child, key, bytes, depth + 1);
+        if (leaf != NULL) return leaf;
+    }
+    return minimumLeaf(nextChild(node, bytes[depth]));
+}
+
+// Smallest key >= key; returns false if there is none
+bool lowerBound(Node* root, Key key, Key* result) {
+    uint8_t bytes[KEY_BYTES];
+    keyBytes(key, bytes);
+    Node* leaf = lowerBoundAt(root, key, bytes, 0);
+    if (leaf == NULL) return false;
+    *result = leafKey(leaf);
+    return true;
+}
+
+// Number of keys in [low, high], walked in order through lowerBound
+long rangeCount(Node* root, Key low, Key high) {
+    long keys = 0;
+    Key key;
+    for (bool more = lowerBound(root, low, &key); more && key <= high;
+         more = key < high && lowerBound(root, key + 1, &key)) {
+        keys++;
+    }
+    return keys;
+}
+
+void freeTree(Node* node) {
+    if (node == NULL) return;
+    if (isLeaf(node)) {
+        freeLeaf(node);
+        return;
+    }
+    Node* children[256];
+    int childCount = childList(node, children);
+    for (int i = 0; i < childCount; i++) freeTree(children[i]);
+    free(node);
+}
+
+// Walk the tree and report its memory footprint and shape. Leaves are
+// counted as keys of their parent; wide-key leaves add their own block.
+void collectTreeStats(Node* node, int depth, TreeStats* stats) {
+    Node* children[256];
+    int childCount = childList(node, children);
+    int leaves = 0;
+    for (int i = 0; i < childCount; i++) {
+        if (!isLeaf(children[i])) continue;
+        leaves++;
+#ifdef ART_WIDE_KEYS
+        stats->bytesAllocated += allocationBytes(LEAF(children[i]), sizeof(Leaf));
+#endif
+    }
+    treeStatsAddNode(stats, node, nodeSize(node), depth, leaves);
+    stats->nodesByType[node->type]++;
+    for (int i = 0; i < childCount; i++) {
+        if (!isLeaf(children[i])) collectTreeStats(children[i], depth + 1, stats);
+    }
+}
+
+TreeStats treeStats(Node* root) {
+    TreeStats stats;
+    treeStatsInit(&stats);
+    stats.nodeTypeCount = NODE_TYPE_COUNT;
+    if (root != NULL && isLeaf(root)) {
+        stats.keyCount = 1;
+    } else if (root != NULL) {
+        collectTreeStats(root, 0, &stats);
+    }
+    treeStatsFinish(&stats);
+    return stats;
+}
+
+// Stream the keys in order into a snapshot writer
+// Snapshots hold 32-bit keys, so a wide key outside that range fails the
+// snapshot instead of being truncated
+void writeSnapshot(Node* node, SnapshotWriter* writer) {
+    if (node == NULL) return;
+    if (isLeaf(node)) {
+        Key key = leafKey(node);
+#ifdef ART_WIDE_KEYS
+        if (key != (int32_t)key) {
+            if (!writer->failed) fprintf(stderr, "Key %lld does not fit a snapshot\n", (long long)key);
+            writer->failed = 1;
+            return;
+        }
+#endif
+        snapshotAppend(writer, (int)key);
+        return;
+    }
+    Node* children[256];
+    int childCount = childList(node, children);
+    for (int i = 0; i < childCount; i++) writeSnapshot(children[i], writer);
+}
+
+int saveSnapshot(Node* root, const char* path) {
+    SnapshotWriter* writer = snapshotBegin(path);
+    if (writer == NULL) return -1;
+    writeSnapshot(root, writer);
+    return snapshotFinish(writer);
+}
+
+#ifdef ART_WIDE_KEYS
+// AVL.c holds int keys, so wide keys are compared against the generic AVL
+// over the same key type, with a count as payload like AVL.c's node
+DEFINE_AVL(KeyAvl, Key, int, AVL_CMP_SCALAR)
+typedef KeyAvlNode ComparisonNode;
+#define comparisonInsert(root, key) KeyAvlInsert(root, key, 1)
+#define comparisonSearch KeyAvlSearch
+#define comparisonFree KeyAvlFree
+#else
+typedef AvlNode ComparisonNode;
+#define comparisonInsert avlInsert
+#define comparisonSearch avlSearch
+#define comparisonFree avlFreeTree
+#endif
+
+// Footprint and shape of the comparison tree, one heap block per key
+void collectComparisonStats(ComparisonNode* node, int depth, TreeStats* stats) {
+    if (node == NULL) return;
+    treeStatsAddNode(stats, node, sizeof(ComparisonNode), depth, 1);
+    collectComparisonStats(node->left, depth + 1, stats);
+    collectComparisonStats(node->right, depth + 1, stats);
+}
+
+// Insert the same keys into the radix tree and the AVL tree, then time
+// lookups of stored keys in a scattered order and report memory per key
+void compareWithAvl(const char* label, Key* keys, long n) {
+    if (n == 0) return;
+    printf("\n%s: %ld keys\n", label, n);
+
+    uint64_t start = nowNanos();
+    Node* root = NULL;
+    for (long i = 0; i < n; i++) root = insert(root, keys[i]);
+    double artInsertNanos = (double)(nowNanos() - start) / n;
+
+    start = nowNanos();
+    ComparisonNode* avl = NULL;
+    for (long i = 0; i < n; i++) avl = comparisonInsert(avl, keys[i]);
+    double avlInsertNanos = (double)(nowNanos() - start) / n;
+
+    long artFound = 0, avlFound = 0;
+    start = nowNanos();
+    for (long i = 0; i < n; i++) artFound += search(root, keys[(i * 7919) % n]);
+    double artSearchNanos = (double)(nowNanos() - start) / n;
+
+    start = nowNanos();
+    for (long i = 0; i < n; i++) avlFound += comparisonSearch(avl, keys[(i * 7919) % n]) != NULL;
+    double avlSearchNanos = (double)(nowNanos() - start) / n;
+
+    TreeStats stats = treeStats(root);
+    TreeStats avlStats;
+    treeStatsInit(&avlStats);
+    collectComparisonStats(avl, 0, &avlStats);
+    treeStatsFinish(&avlStats);
+    printf("Radix tree: insert %.1f ns, search %.1f ns, %.2f bytes/key, height %d\n",
+           artInsertNanos, artSearchNanos, (double)stats.bytesAllocated / stats.keyCount, stats.height);
+    printf("AVL tree:   insert %.1f ns, search %.1f ns, %.2f bytes/key, height %d\n",
+           avlInsertNanos, avlSearchNanos, (double)avlStats.bytesAllocated / avlStats.keyCount, avlStats.height);
+    printTreeStats(&stats, nodeTypeNames, 256);
+    if (artFound != avlFound) printf("Lookup results differ: %ld vs %ld\n", artFound, avlFound);
+
+    freeTree(root);
+    comparisonFree(avl);
+}
+
+// Larger runs of the three key shapes in the input files
+// Uniform over the whole key width
+Key randomKey(void) {
+    KeyBits bits = 0;
+    for (int i = 0; i < KEY_BYTES; i += 2) bits = (bits << 16) ^ (KeyBits)(rand() & 0xffff);
+    return (Key)bits;
+}
+
+void benchmarkScaled(long n) {
+    Key* keys = (Key*)malloc(sizeof(Key) * n);
+    if (keys == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return;
+    }
+    srand(time(NULL));
+    for (long i = 0; i < n; i++) keys[i] = randomKey();
+    compareWithAvl("Random keys", keys, n);
+    for (long i = 0; i < n; i++) keys[i] = (Key)i;
+    compareWithAvl("Increasing keys", keys, n);
+    for (long i = 0; i < n; i++) keys[i] = i % 2 ? randomKey() : (Key)i;
+    compareWithAvl("Mixed keys", keys, n);
+    free(keys);
+}
+
+// Replay the file's operations on a scratch tree with a clock read around
+// each one, outside the windows the hardware counters cover
+void recordLatencies(FILE* file, LatencyHistogram latency[]) {
+    Node* root = NULL;
+    int number;
+    rewind(file);
+    while (fscanf(file, "%d,", &number) == 1) {
+        uint64_t opStart = nowNanos();
+        root = insert(root, number);
+        histogramRecord(&latency[OP_INSERT], nowNanos() - opStart);
+    }
+
+    uint64_t opStart = nowNanos();
+    count(root, 500);
+    histogramRecord(&latency[OP_SEARCH], nowNanos() - opStart);
+
+    opStart = nowNanos();
+#ifdef MULTISET
+    root = eraseOne(root, 500);
+#else
+    root = delete(root, 500);
+#endif
+    histogramRecord(&latency[OP_DELETE], nowNanos() - opStart);
+    freeTree(root);
+}
+
+void processFiles(const char* files[], int fileCount) {
+    Node* root = NULL;
+    PerfCounters counters;
+    perfOpen(&counters);
+    static LatencyHistogram latency[OP_TYPE_COUNT], totalLatency[OP_TYPE_COUNT];
+    for (int op = 0; op < OP_TYPE_COUNT; op++) histogramInit(&totalLatency[op]);
+
+    for (int i = 0; i < fileCount; i++) {
+        FILE* file = fopen(files[i], "r");
+        if (file == NULL) {
+            perror("Error opening file");
+            return;
+        }
+
+        printf("\nProcessing file: %s\n", files[i]);
+
+        int number, nodeCount = 0, capacity = 1024;
+        Key* keys = (Key*)malloc(sizeof(Key) * capacity);
+        clock_t start, end;
+
+        for (int op = 0; op < OP_TYPE_COUNT; op++) histogramInit(&latency[op]);
+
+        // Insertion time
+        start = clock();
+        perfStart(&counters);
+        while (fscanf(file, "%d,", &number) == 1) {
+            root = insert(root, number);
+            if (keys != NULL && nodeCount == capacity) {
+                capacity *= 2;
+                Key* grown = (Key*)realloc(keys, sizeof(Key) * capacity);
+                if (grown == NULL) free(keys);
+                keys = grown;
+            }
+            if (keys != NULL) keys[nodeCount] = number;
+            nodeCount++;
+        }
+        perfStop(&counters);
+        end = clock();
+        printf("Insertion time for %d nodes: %f seconds\n", nodeCount, ((double)(end - start)) / CLOCKS_PER_SEC);
+        perfReport(&counters, "Insertion", nodeCount);
+        TreeStats stats = treeStats(root);
+        printTreeStats(&stats, nodeTypeNames, 256);
+
+        // Snapshot the tree and serve the same lookups from the mapped image
+        char snapshotPath[256];
+        snprintf(snapshotPath, sizeof(snapshotPath), "%s.snap", files[i]);
+        start = clock();
+        int saved = saveSnapshot(root, snapshotPath);
+        end = clock();
+        printf("Snapshot write time: %f seconds\n", ((double)(end - start)) / CLOCKS_PER_SEC);
+        if (saved == 0) snapshotBenchmark(snapshotPath, 500, 250, 750);
+        printf("Range [250, 750]: %ld keys\n", rangeCount(root, 250, 750));
+
+        // Search time for node with value 500
+        start = clock();
+        perfStart(&counters);
+        int occurrences = count(root, 500);
+        perfStop(&counters);
+        end = clock();
+        if (occurrences > 0) {
+            printf("Node with value 500 found, %d occurrence(s).\n", occurrences);
+        } else {
+            printf("Node with value 500 not found.\n");
+        }
+        printf("Search time for node with value 500: %f seconds\n", ((double)(end - start)) / CLOCKS_PER_SEC);
+        perfReport(&counters, "Search", 1);
+
+        // Deletion time for node with value 500
+        start = clock();
+        perfStart(&counters);
+#ifdef MULTISET
+        root = eraseOne(root, 500);
+#else
+        root = delete(root, 500);
+#endif
+        perfStop(&counters);
+        end = clock();
+        printf("Deletion time for node with value 500: %f seconds\n", ((double)(end - start)) / CLOCKS_PER_SEC);
+        perfReport(&counters, "Deletion", 1);
+
+        recordLatencies(file, latency);
+        for (int op = 0; op < OP_TYPE_COUNT; op++) {
+            histogramPrint(&latency[op], opTypeNames[op]);
+            histogramMerge(&totalLatency[op], &latency[op]);
+        }
+
+        // Same keys against the AVL tree
+        if (keys != NULL) compareWithAvl(files[i], keys, nodeCount);
+        free(keys);
+
+        fclose(file);
+        freeTree(root);
+        root = NULL; // Reset the tree for the next file
+    }
+
+    printf("\nLatency over all files:\n");
+    for (int op = 0; op < OP_TYPE_COUNT; op++) histogramPrint(&totalLatency[op], opTypeNames[op]);
+    perfClose(&counters);
+}
+
+int main(int argc, char** argv) {
+    // Keys per shape in the scaled run; pass a count to go larger
+    long scaledKeys = SCALED_KEYS;
+    if (argc > 1) {
+        char* end;
+        scaledKeys = strtol(argv[1], &end, 10);
+        if (*end != '\0' || scaledKeys <= 0) {
+            fprintf(stderr, "Usage: %s [keys per shape in the scaled run, default %d]\n", argv[0], SCALED_KEYS);
+            return 1;
+        }
+    }
+
+    const char* files[] = {
+        "random_numbers.txt",
+        "mixed_numbers.txt",
+        "increasing_numbers.txt",
+        "decreasing_numbers.txt"
+    };
+
+    processFiles(files, 4);
+    benchmarkScaled(scaledKeys);
+
+    return 0;
+}
@@ -0,0 +1,198 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include "avl_template.h"
+
+// Benchmarks the macro-specialised AVL tree from avl_template.h with the
+// key/value shapes the engines need: 32-bit keys, 64-bit IDs carrying a
+// 16-byte payload, 16-byte binary keys and string keys. A 64-bit variant
+// comparing through a function pointer is built alongside to show what
+// the inlined comparator saves.
+
+typedef struct Payload16 {
+    unsigned char bytes[16];
+} Payload16;
+
+typedef struct Key16 {
+    unsigned char bytes[16];
+} Key16;
+
+int compareInt64(int64_t a, int64_t b) {
+    return (a > b) - (a < b);
+}
+
+// volatile keeps the compiler from resolving the call at compile time
+int (*volatile indirectCompare)(int64_t, int64_t) = compareInt64;
+#define AVL_CMP_INDIRECT(a, b) indirectCompare((a), (b))
+
+DEFINE_AVL(Int32Avl, int32_t, int32_t, AVL_CMP_SCALAR)
+DEFINE_AVL(Int64Avl, int64_t, Payload16, AVL_CMP_SCALAR)
+DEFINE_AVL(IndirectAvl, int64_t, Payload16, AVL_CMP_INDIRECT)
+DEFINE_AVL(BinaryAvl, Key16, int64_t, AVL_CMP_BYTES)
+DEFINE_AVL(StringAvl, const char*, int32_t, AVL_CMP_STRING)
+
+#define STRING_KEY_SIZE 16
+#define RANDOM_KEYS 1000000  // Keys in the large random run
+
+// Spread the small input numbers over the 64-bit ID space, keeping their order
+int64_t makeId(int number) {
+    return (int64_t)number * 2654435761LL;
+}
+
+Payload16 makePayload(int number) {
+    Payload16 payload;
+    for (int i = 0; i < 16; i++) payload.bytes[i] = (unsigned char)(number + i);
+    return payload;
+}
+
+// Big-endian with the sign bit flipped so memcmp order matches integer order
+Key16 makeBinaryKey(int number) {
+    Key16 key;
+    memset(key.bytes, 0xA5, sizeof(key.bytes));
+    uint32_t biased = (uint32_t)number ^ 0x80000000u;
+    for (int i = 0; i < 4; i++) key.bytes[i] = (unsigned char)(biased >> (24 - 8 * i));
+    return key;
+}
+
+void makeStringKey(int number, char* buffer) {
+    snprintf(buffer, STRING_KEY_SIZE, "key-%011d", number);
+}
+
+int* readNumbers(const char* filename, int* count) {
+    FILE* file = fopen(filename, "r");
+    if (file == NULL) {
+        perror("Error opening file");
+        return NULL;
+    }
+
+    int capacity = 1024, number;
+    int* numbers = (int*)malloc(sizeof(int) * capacity);
+    *count = 0;
+    while (numbers != NULL && fscanf(file, "%d,", &number) == 1) {
+        if (*count == capacity) {
+            capacity *= 2;
+            int* grown = (int*)realloc(numbers, sizeof(int) * capacity);
+            if (grown == NULL) {
+                free(numbers);
+                numbers = NULL;
+                break;
+            }
+            numbers = grown;
+        }
+        numbers[(*count)++] = number;
+    }
+    fclose(file);
+    if (numbers == NULL) fprintf(stderr, "Memory allocation failed\n");
+    return numbers;
+}
+
+double seconds(clock_t start, clock_t end) {
+    return ((double)(end - start)) / CLOCKS_PER_SEC;
+}
+
+// Insert every number, look every one up again, then search and delete 500.
+// Expands to the same benchmark for each instantiation over the count
+// input numbers. probe is the key for 500 and VALUE(n) builds the value
+// for input number n; keyAt(keys, k) is the key of the k-th input, taken
+// from keys, so string keys can point at storage built once up front.
+#define BENCHMARK_AVL(prefix, label, numbers, count, keys, probe, VALUE, keyAt)          \
+    do {                                                                                 \
+        prefix##Node* root = NULL;                                                       \
+        clock_t start = clock();                                                         \
+        for (int k = 0; k < (count); k++) root = prefix##Insert(root, keyAt(keys, k), VALUE((numbers)[k])); \
+        clock_t end = clock();                                                           \
+        printf("%s: insertion time for %d keys (%ld distinct, %zu-byte nodes): %f seconds\n", \
+               label, (count), prefix##Count(root), sizeof(prefix##Node), seconds(start, end)); \
+                                                                                         \
+        long hits = 0;                                                                   \
+        start = clock();                                                                 \
+        for (int k = 0; k < (count); k++) hits += prefix##Search(root, keyAt(keys, k)) != NULL; \
+        end = clock();                                                                   \
+        printf("%s: lookup time for %d keys (%ld hits): %f seconds\n", label, (count), hits, seconds(start, end)); \
+                                                                                         \
+        start = clock();                                                                 \
+        prefix##Node* found = prefix##Search(root, probe);                               \
+        end = clock();                                                                   \
+        printf("%s: node with value 500 %s, search time %f seconds\n", label,            \
+               found != NULL ? "found" : "not found", seconds(start, end));              \
+                                                                                         \
+        start = clock();                                                                 \
+        root = prefix##Delete(root, probe);                                              \
+        end = clock();                                                                   \
+        printf("%s: deletion time for node with value 500: %f seconds\n", label, seconds(start, end)); \
+        prefix##Free(root);                                                              \
+    } while (0)
+
+#define INT32_KEY(n) ((int32_t)(n))
+#define INT32_VALUE(n) ((int32_t)(n))
+#define INT32_KEY_AT(numbers, k) INT32_KEY((numbers)[k])
+#define ID_AT(numbers, k) makeId((numbers)[k])
+#define BINARY_KEY_AT(numbers, k) makeBinaryKey((numbers)[k])
+#define STRING_KEY_AT(buffer, k) ((const char*)(buffer) + (size_t)(k) * STRING_KEY_SIZE)
+
+// Run every instantiation over the same count numbers
+void benchmarkNumbers(const int* numbers, int count) {
+    BENCHMARK_AVL(Int32Avl, "int32 -> int32", numbers, count, numbers, INT32_KEY(500), INT32_VALUE, INT32_KEY_AT);
+    BENCHMARK_AVL(Int64Avl, "int64 -> 16 bytes", numbers, count, numbers, makeId(500), makePayload, ID_AT);
+    BENCHMARK_AVL(IndirectAvl, "int64 -> 16 bytes, indirect compare", numbers, count, numbers, makeId(500), makePayload, ID_AT);
+    BENCHMARK_AVL(BinaryAvl, "16-byte key -> int64", numbers, count, numbers, makeBinaryKey(500), makeId, BINARY_KEY_AT);
+
+    // The string tree stores pointers, so the keys live in one buffer
+    // that outlives it
+    char* stringKeys = (char*)malloc((size_t)count * STRING_KEY_SIZE + 1);
+    char probeKey[STRING_KEY_SIZE];
+    if (stringKeys == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return;
+    }
+    for (int k = 0; k < count; k++) makeStringKey(numbers[k], stringKeys + (size_t)k * STRING_KEY_SIZE);
+    makeStringKey(500, probeKey);
+    BENCHMARK_AVL(StringAvl, "string -> int32", numbers, count, stringKeys, (const char*)probeKey, INT32_VALUE, STRING_KEY_AT);
+    free(stringKeys);
+}
+
+void processFiles(const char* files[], int fileCount) {
+    for (int i = 0; i < fileCount; i++) {
+        int count;
+        int* numbers = readNumbers(files[i], &count);
+        if (numbers == NULL) return;
+
+        printf("\nProcessing file: %s\n", files[i]);
+        benchmarkNumbers(numbers, count);
+        free(numbers);
+    }
+}
+
+// The 1000-key files are over before clock() can tell the inlined and the
+// indirect comparator apart. A large random tree can: inserts, which
+// compare and rebalance all the way down, pay for the indirect call, while
+// lookups are mostly cache misses either way.
+void benchmarkRandom(int count) {
+    int* numbers = (int*)malloc(sizeof(int) * count);
+    if (numbers == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return;
+    }
+    srand(time(NULL));
+    for (int k = 0; k < count; k++) numbers[k] = (int)(((uint32_t)rand() << 16 ^ (uint32_t)rand()) & 0x7fffffff);
+
+    printf("\nRandom keys: %d\n", count);
+    benchmarkNumbers(numbers, count);
+    free(numbers);
+}
+
+int main() {
+    const char* files[] = {
+        "random_numbers.txt",
+        "mixed_numbers.txt",
+        "increasing_numbers.txt",
+        "decreasing_numbers.txt"
+    };
+
+    processFiles(files, 4);
+    benchmarkRandom(RANDOM_KEYS);
+
+    return 0;
+}
@@ -0,0 +1,148 @@
+#ifndef AVL_TEMPLATE_H
+#define AVL_TEMPLATE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Compile-time specialised AVL tree. DEFINE_AVL(prefix, KeyT, ValueT, CMP)
+// expands to a node type prefix##Node and the functions prefix##Insert,
+// prefix##Search, prefix##Delete, prefix##Free and prefix##Count. CMP is a
+// macro CMP(a, b) returning <0, 0 or >0; it is pasted into every comparison
+// site, so the compiler sees the key type and inlines the comparison
+// instead of calling through a function pointer.
+//
+// Keys and values are stored by value. For string keys the tree keeps the
+// pointer only; the caller owns the characters and must keep them alive.
+
+// Integers of any width
+#define AVL_CMP_SCALAR(a, b) (((a) > (b)) - ((a) < (b)))
+// Fixed-size binary keys: any struct with an array member named bytes,
+// ordered as unsigned big-endian strings (encode integers big-endian)
+#define AVL_CMP_BYTES(a, b) memcmp((a).bytes, (b).bytes, sizeof((a).bytes))
+// NUL-terminated strings
+#define AVL_CMP_STRING(a, b) strcmp((a), (b))
+
+#define DEFINE_AVL(prefix, KeyT, ValueT, CMP)                                        \
+typedef struct prefix##Node {                                                        \
+    KeyT key;                                                                        \
+    ValueT value;                                                                    \
+    struct prefix##Node* left;                                                       \
+    struct prefix##Node* right;                                                      \
+    int height;                                                                      \
+} prefix##Node;                                                                      \
+                                                                                     \
+static inline int prefix##Height(const prefix##Node* node) {                         \
+    return node == NULL ? 0 : node->height;                                          \
+}                                                                                    \
+                                                                                     \
+static inline void prefix##UpdateHeight(prefix##Node* node) {                        \
+    int l = prefix##Height(node->left), r = prefix##Height(node->right);             \
+    node->height = 1 + (l > r ? l : r);                                              \
+}                                                                                    \
+                                                                                     \
+static inline prefix##Node* prefix##RightRotate(prefix##Node* y) {                   \
+    prefix##Node* x = y->left;                                                       \
+    y->left = x->right;                                                              \
+    x->right = y;                                                                    \
+    prefix##UpdateHeight(y);                                                         \
+    prefix##UpdateHeight(x);                                                         \
+    return x;                                                                        \
+}                                                                                    \
+                                                                                     \
+static inline prefix##Node* prefix##LeftRotate(prefix##Node* x) {                    \
+    prefix##Node* y = x->right;                                                      \
+    x->right = y->left;                                                              \
+    y->left = x;                                                                     \
+    prefix##UpdateHeight(x);                                                         \
+    prefix##UpdateHeight(y);                                                         \
+    return y;                                                                        \
+}                                                                                    \
+                                                                                     \
+/* Restore the AVL invariant at node after one of its subtrees changed */           \
+static inline prefix##Node* prefix##Rebalance(prefix##Node* node) {                  \
+    prefix##UpdateHeight(node);                                                      \
+    int balance = prefix##Height(node->left) - prefix##Height(node->right);          \
+    if (balance > 1) {                                                               \
+        if (prefix##Height(node->left->left) < prefix##Height(node->left->right))    \
+            node->left = prefix##LeftRotate(node->left);                             \
+        return prefix##RightRotate(node);                                            \
+    }                                                                                \
+    if (balance < -1) {                                                              \
+        if (prefix##Height(node->right->right) < prefix##Height(node->right->left))  \
+            node->right = prefix##RightRotate(node->right);                          \
+        return prefix##LeftRotate(node);                                             \
+    }                                                                                \
+    return node;                                                                     \
+}                                                                                    \
+                                                                                     \
+/* Insert key, or replace the value if key is already present */                    \
+static inline prefix##Node* prefix##Insert(prefix##Node* node, KeyT key, ValueT value) { \
+    if (node == NULL) {                                                              \
+        node = (prefix##Node*)malloc(sizeof(prefix##Node));                          \
+        if (node == NULL) {                                                          \
+            fprintf(stderr, "Memory allocation failed\n");                           \
+            exit(1);                                                                 \
+        }                                                                            \
+        node->key = key;                                                             \
+        node->value = value;                                                         \
+        node->left = NULL;                                                           \
+        node->right = NULL;                                                          \
+        node->height = 1;                                                            \
+        return node;                                                                 \
+    }                                                                                \
+    int cmp = CMP(key, node->key);                                                   \
+    if (cmp < 0)                                                                     \
+        node->left = prefix##Insert(node->left, key, value);                         \
+    else if (cmp > 0)                                                                \
+        node->right = prefix##Insert(node->right, key, value);                       \
+    else {                                                                           \
+        node->value = value;                                                         \
+        return node;                                                                 \
+    }                                                                                \
+    return prefix##Rebalance(node);                                                  \
+}                                                                                    \
+                                                                                     \
+static inline prefix##Node* prefix##Search(prefix##Node* node, KeyT key) {           \
+    while (node != NULL) {                                                           \
+        int cmp = CMP(key, node->key);                                               \
+        if (cmp == 0) return node;                                                   \
+        node = cmp < 0 ? node->left : node->right;                                   \
+    }                                                                                \
+    return NULL;                                                                     \
+}                                                                                    \
+                                                                                     \
+static inline prefix##Node* prefix##Delete(prefix##Node* node, KeyT key) {           \
+    if (node == NULL) return NULL;                                                   \
+    int cmp = CMP(key, node->key);                                                   \
+    if (cmp < 0)                                                                     \
+        node->left = prefix##Delete(node->left, key);                                \
+    else if (cmp > 0)                                                                \
+        node->right = prefix##Delete(node->right, key);                              \
+    else if (node->left == NULL || node->right == NULL) {                            \
+        prefix##Node* child = node->left ? node->left : node->right;                 \
+        free(node);                                                                  \
+        return child;                                                                \
+    } else {                                                                         \
+        prefix##Node* successor = node->right;                                       \
+        while (successor->left != NULL) successor = successor->left;                 \
+        node->key = successor->key;                                                  \
+        node->value = successor->value;                                              \
+        node->right = prefix##Delete(node->right, successor->key);                   \
+    }                                                                                \
+    return prefix##Rebalance(node);                                                  \
+}                                                                                    \
+                                                                                     \
+static inline long prefix##Count(const prefix##Node* node) {                         \
+    if (node == NULL) return 0;                                                      \
+    return 1 + prefix##Count(node->left) + prefix##Count(node->right);               \
+}                                                                                    \
+                                                                                     \
+static inline void prefix##Free(prefix##Node* node) {                                \
+    if (node == NULL) return;                                                        \
+    prefix##Free(node->left);                                                        \
+    prefix##Free(node->right);                                                       \
+    free(node);                                                                      \
+}
+
+#endif
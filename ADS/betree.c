@@ -0,0 +1,674 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include "perf_counters.h"
+#include "latency_histogram.h"
+#include "tree_stats.h"
+#include "snapshot.h"
+
+// The ingest benchmark runs against AVL.c's own insert; the names it
+// shares with this file are renamed for the include
+#define AVL_NO_MAIN
+#define Node AvlNode
+#define createNode avlCreateNode
+#define freeTree avlFreeTree
+#define collectTreeStats avlCollectTreeStats
+#define writeSnapshot avlWriteSnapshot
+#define saveSnapshot avlSaveSnapshot
+#define recordLatencies avlRecordLatencies
+#define processFiles avlProcessFiles
+#include "AVL.c"
+#undef Node
+#undef createNode
+#undef freeTree
+#undef collectTreeStats
+#undef writeSnapshot
+#undef saveSnapshot
+#undef recordLatencies
+#undef processFiles
+
+// B^epsilon-tree: a B-tree whose internal nodes also hold a buffer of
+// pending insert and delete messages. An update only lands in the root's
+// buffer; when a buffer fills, the messages bound for its busiest child
+// move down in one batch, so a message crosses each level as part of a
+// batch of about BE_BUFFER / BE_FANOUT messages instead of paying a
+// root-to-leaf descent of its own. Leaves apply their batches with one
+// merge and split as needed.
+//
+// Buffers are sorted by key and keep at most one message per key, the
+// newest. A lookup walks the ordinary root-to-leaf path and stops at the
+// first buffer holding the key, because higher messages are always newer
+// than lower ones and than the leaf. Updates are blind: an insert of a
+// present key or a delete of an absent one is only resolved in the leaf.
+// Leaves that run empty are dropped, and so are internal nodes left with a
+// single child and nothing pending, but sparse nodes are not merged, so
+// after heavy deletes leaves may sit at different depths.
+#ifndef BE_FANOUT
+#define BE_FANOUT 8             // Most children an internal node keeps
+#endif
+#ifndef BE_BUFFER
+#define BE_BUFFER 512           // Messages a node buffers before flushing
+#endif
+#ifndef BE_LEAF_KEYS
+#define BE_LEAF_KEYS 512        // Most keys a leaf keeps
+#endif
+
+typedef enum { MSG_INSERT, MSG_DELETE } MessageType;
+
+typedef struct Message {
+    int key;
+    int type;
+} Message;
+
+typedef enum { LEAF_NODE, INTERNAL_NODE } NodeType;
+
+typedef struct Node {
+    NodeType type;
+    int count;               // Keys in a leaf, pivots in an internal node
+    int capacity;            // Slots in keys (and capacity + 1 in children)
+    int* keys;               // Leaf keys or pivots; child i holds [keys[i - 1], keys[i])
+    struct Node** children;
+    Message* buffer;         // Pending messages, sorted by key
+    int buffered;
+    int bufferCapacity;
+} Node;
+
+typedef struct BeTree {
+    Node* root;
+    long updates;            // Inserts and deletes issued
+    long flushes;            // Batches moved one level down
+    long messagesMoved;      // Messages carried by those batches
+    long leafSplits;
+    long nodeSplits;
+} BeTree;
+
+void* checkedRealloc(void* block, size_t size) {
+    void* result = realloc(block, size);
+    if (result == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(1);
+    }
+    return result;
+}
+
+Node* createNode(NodeType type) {
+    Node* node = (Node*)checkedRealloc(NULL, sizeof(Node));
+    memset(node, 0, sizeof(Node));
+    node->type = type;
+    node->capacity = type == LEAF_NODE ? BE_LEAF_KEYS : BE_FANOUT;
+    node->keys = (int*)checkedRealloc(NULL, sizeof(int) * node->capacity);
+    if (type == INTERNAL_NODE) {
+        node->children = (Node**)checkedRealloc(NULL, sizeof(Node*) * (node->capacity + 1));
+        node->bufferCapacity = 2 * BE_BUFFER;
+        node->buffer = (Message*)checkedRealloc(NULL, sizeof(Message) * node->bufferCapacity);
+    }
+    return node;
+}
+
+void freeNode(Node* node) {
+    free(node->keys);
+    free(node->children);
+    free(node->buffer);
+    free(node);
+}
+
+void freeTree(Node* node) {
+    if (node->type == INTERNAL_NODE) {
+        for (int i = 0; i <= node->count; i++) freeTree(node->children[i]);
+    }
+    freeNode(node);
+}
+
+// Make room for needed keys (and needed + 1 children)
+void reserveKeys(Node* node, int needed) {
+    if (needed <= node->capacity) return;
+    while (node->capacity < needed) node->capacity *= 2;
+    node->keys = (int*)checkedRealloc(node->keys, sizeof(int) * node->capacity);
+    if (node->type == INTERNAL_NODE) {
+        node->children = (Node**)checkedRealloc(node->children, sizeof(Node*) * (node->capacity + 1));
+    }
+}
+
+// The searches below halve the range with a conditional move instead of a
+// branch: buffers and leaves are searched on every update and lookup, and
+// the outcome of each comparison is a coin flip for random keys.
+
+// Child of an internal node whose range holds key
+int childIndex(const Node* node, int key) {
+    const int* base = node->keys;
+    int n = node->count;
+    if (n == 0) return 0;
+    while (n > 1) {
+        int half = n / 2;
+        base += (base[half - 1] <= key) * half;
+        n -= half;
+    }
+    return (int)(base - node->keys) + (*base <= key);
+}
+
+// Position of the first key >= key in a sorted key array
+int keyLowerBound(const int* keys, int count, int key) {
+    const int* base = keys;
+    int n = count;
+    if (n == 0) return 0;
+    while (n > 1) {
+        int half = n / 2;
+        base += (base[half - 1] < key) * half;
+        n -= half;
+    }
+    return (int)(base - keys) + (*base < key);
+}
+
+// Position of the first message with a key >= key
+int bufferLowerBound(const Node* node, int key) {
+    const Message* base = node->buffer;
+    int n = node->buffered;
+    if (n == 0) return 0;
+    while (n > 1) {
+        int half = n / 2;
+        base += (base[half - 1].key < key) * half;
+        n -= half;
+    }
+    return (int)(base - node->buffer) + (base->key < key);
+}
+
+// Merge a sorted batch of newer messages into a node's buffer. The merge
+// runs back to front inside the buffer itself, so a flush touches no
+// memory but the two nodes involved. While both inputs last the loop is
+// branch-free: which side wins is a coin flip for random keys. On equal
+// keys the older message is superseded.
+void mergeMessages(Node* node, const Message* batch, int n) {
+    if (node->buffered + n > node->bufferCapacity) {
+        while (node->bufferCapacity < node->buffered + n) node->bufferCapacity *= 2;
+        node->buffer = (Message*)checkedRealloc(node->buffer, sizeof(Message) * node->bufferCapacity);
+    }
+    Message* buffer = node->buffer;
+    int end = node->buffered + n;
+    int i = node->buffered - 1, j = n - 1, w = end;
+    while (i >= 0 && j >= 0) {
+        Message older = buffer[i], newer = batch[j];
+        bool takeOlder = older.key > newer.key;
+        w--;
+        buffer[w].key = takeOlder ? older.key : newer.key;
+        buffer[w].type = takeOlder ? older.type : newer.type;
+        i -= takeOlder | (older.key == newer.key);
+        j -= !takeOlder;
+    }
+    while (j >= 0) buffer[--w] = batch[j--];
+    // buffer[0..i] is already in place; close the gap superseded messages left
+    if (w > i + 1) memmove(buffer + i + 1, buffer + w, sizeof(Message) * (end - w));
+    node->buffered = i + 1 + end - w;
+}
+
+// Apply a sorted batch of messages to a leaf, merging back to front in
+// place like mergeMessages. A delete message is written like an insert but
+// does not advance the output, so the next key overwrites it.
+void applyToLeaf(Node* leaf, const Message* batch, int n) {
+    reserveKeys(leaf, leaf->count + n);
+    int* keys = leaf->keys;
+    int end = leaf->count + n;
+    int i = leaf->count - 1, j = n - 1, w = end;
+    while (i >= 0 && j >= 0) {
+        int key = keys[i];
+        Message message = batch[j];
+        bool takeKey = key > message.key;
+        keys[w - 1] = takeKey ? key : message.key;
+        w -= takeKey | (message.type == MSG_INSERT);
+        i -= takeKey | (key == message.key);
+        j -= !takeKey;
+    }
+    for (; j >= 0; j--) {
+        keys[w - 1] = batch[j].key;
+        w -= batch[j].type == MSG_INSERT;
+    }
+    if (w > i + 1) memmove(keys + i + 1, keys + w, sizeof(int) * (end - w));
+    leaf->count = i + 1 + end - w;
+}
+
+// Put child at position pos of an internal node, separated from its left
+// neighbour by pivot
+void insertChild(Node* node, int pos, int pivot, Node* child) {
+    reserveKeys(node, node->count + 1);
+    memmove(node->keys + pos, node->keys + pos - 1, sizeof(int) * (node->count - pos + 1));
+    memmove(node->children + pos + 1, node->children + pos, sizeof(Node*) * (node->count - pos + 1));
+    node->keys[pos - 1] = pivot;
+    node->children[pos] = child;
+    node->count++;
+}
+
+// Drop child pos together with the pivot in front of it (or after it, for
+// the first child)
+void removeChild(Node* node, int pos) {
+    int pivot = pos > 0 ? pos - 1 : 0;
+    memmove(node->keys + pivot, node->keys + pivot + 1, sizeof(int) * (node->count - pivot - 1));
+    memmove(node->children + pos, node->children + pos + 1, sizeof(Node*) * (node->count - pos));
+    node->count--;
+}
+
+// Give back the room a leaf grew to while applying a batch
+void shrinkLeaf(Node* leaf) {
+    if (leaf->capacity == BE_LEAF_KEYS || leaf->count > BE_LEAF_KEYS) return;
+    leaf->keys = (int*)checkedRealloc(leaf->keys, sizeof(int) * BE_LEAF_KEYS);
+    leaf->capacity = BE_LEAF_KEYS;
+}
+
+// Cut an overfull leaf into pieces at most three quarters full
+void splitLeaf(BeTree* tree, Node* parent, int pos) {
+    Node* leaf = parent->children[pos];
+    int pieces = (4 * leaf->count + 3 * BE_LEAF_KEYS - 1) / (3 * BE_LEAF_KEYS);
+    int* keys = leaf->keys;
+    int count = leaf->count;
+    int done = count / pieces;
+    for (int p = 1; p < pieces; p++) {
+        int end = (int)((long)count * (p + 1) / pieces);
+        Node* piece = createNode(LEAF_NODE);
+        memcpy(piece->keys, keys + done, sizeof(int) * (end - done));
+        piece->count = end - done;
+        insertChild(parent, pos + p, keys[done], piece);
+        done = end;
+        tree->leafSplits++;
+    }
+    // The first piece stays in the original leaf
+    leaf->count = count / pieces;
+    shrinkLeaf(leaf);
+}
+
+// Split an internal node with too many children in half; the right half
+// takes the pivots, children and pending messages above the middle pivot
+void splitInternal(BeTree* tree, Node* parent, int pos) {
+    Node* node = parent->children[pos];
+    int mid = node->count / 2;
+    int pivot = node->keys[mid];
+    Node* right = createNode(INTERNAL_NODE);
+    right->count = node->count - mid - 1;
+    reserveKeys(right, right->count);
+    memcpy(right->keys, node->keys + mid + 1, sizeof(int) * right->count);
+    memcpy(right->children, node->children + mid + 1, sizeof(Node*) * (right->count + 1));
+    node->count = mid;
+
+    int split = bufferLowerBound(node, pivot);
+    if (split < node->buffered) mergeMessages(right, node->buffer + split, node->buffered - split);
+    node->buffered = split;
+
+    insertChild(parent, pos + 1, pivot, right);
+    tree->nodeSplits++;
+}
+
+// Restore the size limits of child pos after something was pushed into it
+void fixChild(BeTree* tree, Node* parent, int pos) {
+    Node* child = parent->children[pos];
+    if (child->type == LEAF_NODE) {
+        if (child->count > BE_LEAF_KEYS) {
+            splitLeaf(tree, parent, pos);
+        } else if (child->count == 0 && parent->count > 0) {
+            removeChild(parent, pos);
+            freeNode(child);
+        } else {
+            shrinkLeaf(child);
+        }
+        return;
+    }
+    if (child->count == 0 && child->buffered == 0) {
+        // A single child and nothing pending: splice the node out
+        parent->children[pos] = child->children[0];
+        freeNode(child);
+        fixChild(tree, parent, pos);
+        return;
+    }
+    if (child->count < BE_FANOUT) return;
+    splitInternal(tree, parent, pos);
+    fixChild(tree, parent, pos + 1);
+    fixChild(tree, parent, pos);
+}
+
+void flushNode(BeTree* tree, Node* node, int limit);
+
+// Move the messages bound for child pos down one level
+void flushChild(BeTree* tree, Node* node, int pos, int lo, int hi) {
+    Node* child = node->children[pos];
+    if (child->type == LEAF_NODE) {
+        applyToLeaf(child, node->buffer + lo, hi - lo);
+    } else {
+        mergeMessages(child, node->buffer + lo, hi - lo);
+        if (child->buffered >= BE_BUFFER) flushNode(tree, child, BE_BUFFER);
+    }
+    memmove(node->buffer + lo, node->buffer + hi, sizeof(Message) * (node->buffered - hi));
+    node->buffered -= hi - lo;
+    tree->flushes++;
+    tree->messagesMoved += hi - lo;
+    fixChild(tree, node, pos);
+}
+
+// Flush the busiest child until fewer than limit messages are left
+void flushNode(BeTree* tree, Node* node, int limit) {
+    while (node->buffered > 0 && node->buffered >= limit) {
+        int best = 0, bestLo = 0, bestHi = 0, lo = 0;
+        for (int c = 0; c <= node->count; c++) {
+            int hi = c < node->count ? bufferLowerBound(node, node->keys[c]) : node->buffered;
+            if (hi - lo > bestHi - bestLo) {
+                best = c;
+                bestLo = lo;
+                bestHi = hi;
+            }
+            lo = hi;
+        }
+        flushChild(tree, node, best, bestLo, bestHi);
+    }
+}
+
+// Give the root a parent while it is too big, and drop internal roots left
+// with a single child and nothing buffered
+void fixRoot(BeTree* tree) {
+    for (;;) {
+        Node* root = tree->root;
+        bool overfull = root->type == LEAF_NODE ? root->count > BE_LEAF_KEYS : root->count >= BE_FANOUT;
+        if (overfull) {
+            Node* newRoot = createNode(INTERNAL_NODE);
+            newRoot->children[0] = root;
+            tree->root = newRoot;
+            fixChild(tree, newRoot, 0);
+        } else if (root->type == INTERNAL_NODE && root->count == 0 && root->buffered == 0) {
+            tree->root = root->children[0];
+            freeNode(root);
+        } else {
+            return;
+        }
+    }
+}
+
+void betreeInit(BeTree* tree) {
+    memset(tree, 0, sizeof(*tree));
+    tree->root = createNode(LEAF_NODE);
+}
+
+void betreeFree(BeTree* tree) {
+    freeTree(tree->root);
+    tree->root = NULL;
+}
+
+// Queue an insert or delete message at the root
+void betreeUpdate(BeTree* tree, int key, MessageType type) {
+    Node* root = tree->root;
+    tree->updates++;
+    Message message = { key, type };
+    if (root->type == LEAF_NODE) {
+        applyToLeaf(root, &message, 1);
+    } else {
+        int pos = bufferLowerBound(root, key);
+        if (pos < root->buffered && root->buffer[pos].key == key) {
+            root->buffer[pos].type = type;
+            return;
+        }
+        memmove(root->buffer + pos + 1, root->buffer + pos, sizeof(Message) * (root->buffered - pos));
+        root->buffer[pos] = message;
+        root->buffered++;
+        if (root->buffered < BE_BUFFER) return;
+        flushNode(tree, root, BE_BUFFER);
+    }
+    fixRoot(tree);
+}
+
+void betreeInsert(BeTree* tree, int key) {
+    betreeUpdate(tree, key, MSG_INSERT);
+}
+
+void betreeDelete(BeTree* tree, int key) {
+    betreeUpdate(tree, key, MSG_DELETE);
+}
+
+bool betreeSearch(const BeTree* tree, int key) {
+    const Node* node = tree->root;
+    while (node->type == INTERNAL_NODE) {
+        int pos = bufferLowerBound(node, key);
+        if (pos < node->buffered && node->buffer[pos].key == key) return node->buffer[pos].type == MSG_INSERT;
+        node = node->children[childIndex(node, key)];
+    }
+    int pos = keyLowerBound(node->keys, node->count, key);
+    return pos < node->count && node->keys[pos] == key;
+}
+
+// Push every pending message down to the leaves
+void flushAll(BeTree* tree, Node* node) {
+    if (node->type == LEAF_NODE) return;
+    flushNode(tree, node, 1);
+    // Right to left, so splits only shift children already done
+    for (int i = node->count; i >= 0; i--) {
+        flushAll(tree, node->children[i]);
+        fixChild(tree, node, i);
+    }
+}
+
+void betreeFlushAll(BeTree* tree) {
+    flushAll(tree, tree->root);
+    fixRoot(tree);
+}
+
+const char* nodeTypeNames[] = { "LEAF", "INTERNAL" };
+
+// Walk the tree and report its memory footprint, shape and pending messages
+void collectTreeStats(const Node* node, int depth, TreeStats* stats, long* pending) {
+    size_t bytes = allocationBytes(node->keys, sizeof(int) * node->capacity);
+    if (node->type == INTERNAL_NODE) {
+        bytes += allocationBytes(node->children, sizeof(Node*) * (node->capacity + 1));
+        bytes += allocationBytes(node->buffer, sizeof(Message) * node->bufferCapacity);
+        *pending += node->buffered;
+    }
+    treeStatsAddNode(stats, node, sizeof(Node), depth, node->type == LEAF_NODE ? node->count : 0);
+    stats->bytesAllocated += bytes;
+    stats->nodesByType[node->type]++;
+    if (node->type == INTERNAL_NODE) {
+        for (int i = 0; i <= node->count; i++) collectTreeStats(node->children[i], depth + 1, stats, pending);
+    }
+}
+
+void printBeTreeStats(const BeTree* tree) {
+    TreeStats stats;
+    long pending = 0;
+    treeStatsInit(&stats);
+    stats.nodeTypeCount = 2;
+    collectTreeStats(tree->root, 0, &stats, &pending);
+    treeStatsFinish(&stats);
+    printTreeStats(&stats, nodeTypeNames, BE_LEAF_KEYS);
+    printf("B^e-tree: pending messages=%ld, flushes=%ld, messages moved/update=%.2f, "
+           "batch size=%.1f, leaf splits=%ld, node splits=%ld\n",
+           pending, tree->flushes, tree->updates ? (double)tree->messagesMoved / tree->updates : 0.0,
+           tree->flushes ? (double)tree->messagesMoved / tree->flushes : 0.0, tree->leafSplits, tree->nodeSplits);
+}
+
+// Stream the keys in order into a snapshot writer; the tree must have been
+// flushed
+void writeSnapshot(const Node* node, SnapshotWriter* writer) {
+    if (node->type == LEAF_NODE) {
+        for (int i = 0; i < node->count; i++) snapshotAppend(writer, node->keys[i]);
+        return;
+    }
+    for (int i = 0; i <= node->count; i++) writeSnapshot(node->children[i], writer);
+}
+
+int saveSnapshot(BeTree* tree, const char* path) {
+    betreeFlushAll(tree);
+    SnapshotWriter* writer = snapshotBegin(path);
+    if (writer == NULL) return -1;
+    writeSnapshot(tree->root, writer);
+    return snapshotFinish(writer);
+}
+
+// Ingest count random keys into the tree and into AVL.c's tree, then
+// compare lookups and a burst of deletes. The target is ten times AVL.c's
+// insert rate; the output says whether this run reached it.
+#define INGEST_TARGET_SPEEDUP 10.0
+
+void benchmarkIngest(long count) {
+    printf("\nRandom ingest: %ld keys\n", count);
+    int* keys = (int*)malloc(sizeof(int) * count);
+    if (keys == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return;
+    }
+    for (long i = 0; i < count; i++) keys[i] = (int)(((uint32_t)rand() << 16) ^ (uint32_t)rand());
+
+    BeTree tree;
+    betreeInit(&tree);
+    AvlNode* avl = NULL;
+    uint64_t start = nowNanos();
+    for (long i = 0; i < count; i++) betreeInsert(&tree, keys[i]);
+    double treeInsertNanos = (double)(nowNanos() - start) / count;
+    start = nowNanos();
+    for (long i = 0; i < count; i++) avl = insert(avl, keys[i]);
+    double avlInsertNanos = (double)(nowNanos() - start) / count;
+    printBeTreeStats(&tree);
+    double speedup = avlInsertNanos / treeInsertNanos;
+    printf("Insert: B^e-tree %.1f ns (%.1f M/s), AVL.c %.1f ns (%.1f M/s), speedup %.1fx, %s the %.0fx target\n",
+           treeInsertNanos, 1e3 / treeInsertNanos, avlInsertNanos, 1e3 / avlInsertNanos, speedup,
+           speedup >= INGEST_TARGET_SPEEDUP ? "meets" : "misses", INGEST_TARGET_SPEEDUP);
+
+    long treeFound = 0, avlFound = 0;
+    start = nowNanos();
+    for (long i = 0; i < count; i++) treeFound += betreeSearch(&tree, keys[(i * 7919) % count] + (int)(i & 1));
+    double treeSearchNanos = (double)(nowNanos() - start) / count;
+    start = nowNanos();
+    for (long i = 0; i < count; i++) avlFound += search(avl, keys[(i * 7919) % count] + (int)(i & 1)) != NULL;
+    double avlSearchNanos = (double)(nowNanos() - start) / count;
+    printf("Search: B^e-tree %.1f ns, AVL.c %.1f ns%s\n", treeSearchNanos, avlSearchNanos,
+           treeFound != avlFound ? " (lookup results differ)" : "");
+
+    start = nowNanos();
+    for (long i = 0; i < count; i += 2) betreeDelete(&tree, keys[i]);
+    double treeDeleteNanos = (double)(nowNanos() - start) / ((count + 1) / 2);
+    start = nowNanos();
+    for (long i = 0; i < count; i += 2) avl = delete(avl, keys[i]);
+    double avlDeleteNanos = (double)(nowNanos() - start) / ((count + 1) / 2);
+    printf("Delete half: B^e-tree %.1f ns, AVL.c %.1f ns\n", treeDeleteNanos, avlDeleteNanos);
+
+    start = nowNanos();
+    betreeFlushAll(&tree);
+    printf("Flushing all buffers: %f seconds\n", (double)(nowNanos() - start) / 1e9);
+    printBeTreeStats(&tree);
+
+    betreeFree(&tree);
+    avlFreeTree(avl);
+    free(keys);
+}
+
+// Replay the file's operations on a scratch tree with a clock read around
+// each one, outside the windows the hardware counters cover
+void recordLatencies(FILE* file, LatencyHistogram latency[]) {
+    BeTree tree;
+    betreeInit(&tree);
+    int number;
+    rewind(file);
+    while (fscanf(file, "%d,", &number) == 1) {
+        uint64_t opStart = nowNanos();
+        betreeInsert(&tree, number);
+        histogramRecord(&latency[OP_INSERT], nowNanos() - opStart);
+    }
+
+    uint64_t opStart = nowNanos();
+    betreeSearch(&tree, 500);
+    histogramRecord(&latency[OP_SEARCH], nowNanos() - opStart);
+
+    opStart = nowNanos();
+    betreeDelete(&tree, 500);
+    histogramRecord(&latency[OP_DELETE], nowNanos() - opStart);
+    betreeFree(&tree);
+}
+
+void processFiles(const char* files[], int fileCount) {
+    BeTree tree;
+    PerfCounters counters;
+    perfOpen(&counters);
+    static LatencyHistogram latency[OP_TYPE_COUNT], totalLatency[OP_TYPE_COUNT];
+    for (int op = 0; op < OP_TYPE_COUNT; op++) histogramInit(&totalLatency[op]);
+
+    for (int i = 0; i < fileCount; i++) {
+        FILE* file = fopen(files[i], "r");
+        if (file == NULL) {
+            perror("Error opening file");
+            return;
+        }
+
+        printf("\nProcessing file: %s\n", files[i]);
+
+        int number, nodeCount = 0;
+        clock_t start, end;
+        betreeInit(&tree);
+
+        for (int op = 0; op < OP_TYPE_COUNT; op++) histogramInit(&latency[op]);
+
+        // Insertion time
+        start = clock();
+        perfStart(&counters);
+        while (fscanf(file, "%d,", &number) == 1) {
+            betreeInsert(&tree, number);
+            nodeCount++;
+        }
+        perfStop(&counters);
+        end = clock();
+        printf("Insertion time for %d nodes: %f seconds\n", nodeCount, ((double)(end - start)) / CLOCKS_PER_SEC);
+        perfReport(&counters, "Insertion", nodeCount);
+        printBeTreeStats(&tree);
+
+        // Search time for node with value 500, answered through the pending buffers
+        start = clock();
+        perfStart(&counters);
+        bool found = betreeSearch(&tree, 500);
+        perfStop(&counters);
+        end = clock();
+        if (found) {
+            printf("Node with value 500 found.\n");
+        } else {
+            printf("Node with value 500 not found.\n");
+        }
+        printf("Search time for node with value 500: %f seconds\n", ((double)(end - start)) / CLOCKS_PER_SEC);
+        perfReport(&counters, "Search", 1);
+
+        // Snapshot the tree (flushing it) and serve the same lookups from the mapped image
+        char snapshotPath[256];
+        snprintf(snapshotPath, sizeof(snapshotPath), "%s.snap", files[i]);
+        start = clock();
+        int saved = saveSnapshot(&tree, snapshotPath);
+        end = clock();
+        printf("Snapshot write time: %f seconds\n", ((double)(end - start)) / CLOCKS_PER_SEC);
+        if (saved == 0) snapshotBenchmark(snapshotPath, 500, 250, 750);
+
+        // Deletion time for node with value 500
+        start = clock();
+        perfStart(&counters);
+        betreeDelete(&tree, 500);
+        perfStop(&counters);
+        end = clock();
+        printf("Deletion time for node with value 500: %f seconds\n", ((double)(end - start)) / CLOCKS_PER_SEC);
+        perfReport(&counters, "Deletion", 1);
+
+        recordLatencies(file, latency);
+        for (int op = 0; op < OP_TYPE_COUNT; op++) {
+            histogramPrint(&latency[op], opTypeNames[op]);
+            histogramMerge(&totalLatency[op], &latency[op]);
+        }
+
+        fclose(file);
+        betreeFree(&tree); // Reset the tree for the next file
+    }
+
+    printf("\nLatency over all files:\n");
+    for (int op = 0; op < OP_TYPE_COUNT; op++) histogramPrint(&totalLatency[op], opTypeNames[op]);
+    perfClose(&counters);
+}
+
+int main() {
+    const char* files[] = {
+        "random_numbers.txt",
+        "mixed_numbers.txt",
+        "increasing_numbers.txt",
+        "decreasing_numbers.txt"
+    };
+
+    processFiles(files, 4);
+    srand(time(NULL));
+    benchmarkIngest(2000000);
+
+    return 0;
+}
@@ -0,0 +1,546 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include "perf_counters.h"
+#include "latency_histogram.h"
+#include "tree_stats.h"
+#include "snapshot.h"
+#include "avl_template.h"
+
+// Ordered set of integers from a bounded range, stored as a bitmap with
+// one bit per possible key. Above the key bits sit summary levels with one
+// bit per 64-bit word of the level below (set when that word is non-zero),
+// up to a single top word, like a van Emde Boas tree with fan-out 64.
+// Membership is one bit test; insert and delete touch one word per level
+// only while a word turns empty or non-empty; successor and predecessor
+// climb to the first level with a candidate bit and come back down with
+// tzcnt/lzcnt, so every operation is O(log64 U). Rank adds the popcounts of
+// the words before the key to a Fenwick tree of per-block key counts.
+//
+// The set picks its representation itself: it starts as a small bitmap
+// around the first key and widens it as keys arrive, and once the keys
+// span more than BITMAP_MAX_UNIVERSE values it moves them into an AVL tree.
+#define BITMAP_MIN_UNIVERSE 4096            // One full summary word
+#define BITMAP_MAX_UNIVERSE (1LL << 26)     // 8 MB of key bits; wider ranges use the tree
+#define BITMAP_MAX_LEVELS 6                 // 64^5 > BITMAP_MAX_UNIVERSE
+
+typedef struct BitmapSet {
+    int64_t base;                            // Key stored at bit 0, a multiple of 64
+    int64_t universe;                        // Key bits, a power of two
+    int levelCount;
+    uint64_t* levels[BITMAP_MAX_LEVELS];     // levels[0] holds the keys
+    long levelWords[BITMAP_MAX_LEVELS];
+    long* blockCounts;                       // Fenwick tree over keys per level-1 word (4096 keys)
+    long blockCount;
+    long size;
+} BitmapSet;
+
+int bitmapInit(BitmapSet* set, int64_t base, int64_t universe) {
+    memset(set, 0, sizeof(*set));
+    set->base = base;
+    set->universe = universe;
+    long words = (long)((universe + 63) / 64);
+    while (set->levelCount < BITMAP_MAX_LEVELS) {
+        set->levels[set->levelCount] = (uint64_t*)calloc(words, sizeof(uint64_t));
+        if (set->levels[set->levelCount] == NULL) return -1;
+        set->levelWords[set->levelCount++] = words;
+        if (words == 1) break;
+        words = (words + 63) / 64;
+    }
+    set->blockCount = set->levelWords[0] / 64 + 1;
+    set->blockCounts = (long*)calloc(set->blockCount + 1, sizeof(long));
+    return set->blockCounts == NULL ? -1 : 0;
+}
+
+void bitmapFree(BitmapSet* set) {
+    for (int l = 0; l < set->levelCount; l++) free(set->levels[l]);
+    free(set->blockCounts);
+    memset(set, 0, sizeof(*set));
+}
+
+size_t bitmapBytes(const BitmapSet* set) {
+    size_t bytes = (set->blockCount + 1) * sizeof(long);
+    for (int l = 0; l < set->levelCount; l++) bytes += set->levelWords[l] * sizeof(uint64_t);
+    return bytes;
+}
+
+void fenwickAdd(BitmapSet* set, long block, long delta) {
+    for (long i = block + 1; i <= set->blockCount; i += i & -i) set->blockCounts[i] += delta;
+}
+
+// Keys in the blocks before block
+long fenwickPrefix(const BitmapSet* set, long block) {
+    long sum = 0;
+    for (long i = block; i > 0; i -= i & -i) sum += set->blockCounts[i];
+    return sum;
+}
+
+bool bitmapContains(const BitmapSet* set, int64_t i) {
+    return (set->levels[0][i >> 6] >> (i & 63)) & 1;
+}
+
+// Returns true if the bit was clear
+bool bitmapInsert(BitmapSet* set, int64_t i) {
+    if (bitmapContains(set, i)) return false;
+    int64_t index = i;
+    for (int l = 0; l < set->levelCount; l++) {
+        uint64_t* word = &set->levels[l][index >> 6];
+        bool wasEmpty = *word == 0;
+        *word |= 1ULL << (index & 63);
+        if (!wasEmpty) break;
+        index >>= 6;
+    }
+    fenwickAdd(set, (long)(i >> 12), 1);
+    set->size++;
+    return true;
+}
+
+// Returns true if the bit was set
+bool bitmapDelete(BitmapSet* set, int64_t i) {
+    if (!bitmapContains(set, i)) return false;
+    int64_t index = i;
+    for (int l = 0; l < set->levelCount; l++) {
+        uint64_t* word = &set->levels[l][index >> 6];
+        *word &= ~(1ULL << (index & 63));
+        if (*word != 0) break;
+        index >>= 6;
+    }
+    fenwickAdd(set, (long)(i >> 12), -1);
+    set->size--;
+    return true;
+}
+
+// Smallest set bit >= i, or -1
+int64_t bitmapNext(const BitmapSet* set, int64_t i) {
+    if (i < 0) i = 0;
+    if (i >= set->universe) return -1;
+    int level = 0;
+    int64_t pos = i;
+    for (;;) {
+        int64_t w = pos >> 6;
+        if (w >= set->levelWords[level]) return -1;
+        uint64_t word = set->levels[level][w] & (~0ULL << (pos & 63));
+        if (word != 0) {
+            pos = (w << 6) + __builtin_ctzll(word);
+            break;
+        }
+        if (level == set->levelCount - 1) return -1;
+        level++;
+        pos = w + 1;  // Bit of the next word, one level up
+    }
+    while (level > 0) {
+        level--;
+        pos = (pos << 6) + __builtin_ctzll(set->levels[level][pos]);
+    }
+    return pos;
+}
+
+// Largest set bit <= i, or -1
+int64_t bitmapPrevious(const BitmapSet* set, int64_t i) {
+    if (i < 0) return -1;
+    if (i >= set->universe) i = set->universe - 1;
+    int level = 0;
+    int64_t pos = i;
+    for (;;) {
+        int64_t w = pos >> 6;
+        uint64_t word = set->levels[level][w] & (~0ULL >> (63 - (pos & 63)));
+        if (word != 0) {
+            pos = (w << 6) + 63 - __builtin_clzll(word);
+            break;
+        }
+        if (w == 0 || level == set->levelCount - 1) return -1;
+        level++;
+        pos = w - 1;  // Bit of the previous word, one level up
+    }
+    while (level > 0) {
+        level--;
+        pos = (pos << 6) + 63 - __builtin_clzll(set->levels[level][pos]);
+    }
+    return pos;
+}
+
+// Number of set bits below i
+long bitmapRank(const BitmapSet* set, int64_t i) {
+    if (i <= 0) return 0;
+    if (i >= set->universe) return set->size;
+    long w = (long)(i >> 6);
+    long block = w >> 6;
+    long rank = fenwickPrefix(set, block);
+    // Only the non-empty words of the block, found through its summary word
+    uint64_t summary = set->levels[1][block] & ((1ULL << (w & 63)) - 1);
+    while (summary != 0) {
+        rank += __builtin_popcountll(set->levels[0][(block << 6) + __builtin_ctzll(summary)]);
+        summary &= summary - 1;
+    }
+    return rank + __builtin_popcountll(set->levels[0][w] & ((1ULL << (i & 63)) - 1));
+}
+
+// The tree the set falls back to for wide key ranges
+DEFINE_AVL(KeyAvl, int, char, AVL_CMP_SCALAR)
+
+// Smallest key >= key in the tree; returns false if there is none
+bool treeSuccessor(const KeyAvlNode* node, int key, int* result) {
+    bool found = false;
+    while (node != NULL) {
+        if (node->key >= key) {
+            *result = node->key;
+            found = true;
+            node = node->left;
+        } else {
+            node = node->right;
+        }
+    }
+    return found;
+}
+
+// Keys below key; the tree keeps no subtree sizes, so this walks every
+// node on the left of the search path
+long treeRank(const KeyAvlNode* node, int key) {
+    long rank = 0;
+    while (node != NULL) {
+        if (node->key < key) {
+            rank += KeyAvlCount(node->left) + 1;
+            node = node->right;
+        } else {
+            node = node->left;
+        }
+    }
+    return rank;
+}
+
+typedef struct OrderedSet {
+    bool useTree;
+    BitmapSet bitmap;
+    KeyAvlNode* tree;
+    long size;
+    long rebuilds;    // Bitmap moves and widenings
+} OrderedSet;
+
+void setInit(OrderedSet* set) {
+    memset(set, 0, sizeof(*set));
+}
+
+void setFree(OrderedSet* set) {
+    if (set->useTree) KeyAvlFree(set->tree);
+    else if (set->bitmap.levelCount > 0) bitmapFree(&set->bitmap);
+    setInit(set);
+}
+
+int64_t floorTo64(int64_t value) {
+    return value >= 0 ? value & ~63LL : -((-value + 63) & ~63LL);
+}
+
+// Move the bitmap's keys into a bitmap over [base, base + universe), or
+// into the tree when universe is 0
+void setRebuild(OrderedSet* set, int64_t base, int64_t universe) {
+    BitmapSet old = set->bitmap;
+    if (universe == 0 || bitmapInit(&set->bitmap, base, universe) != 0) {
+        if (universe != 0) bitmapFree(&set->bitmap);
+        set->useTree = true;
+        set->tree = NULL;
+        for (int64_t i = bitmapNext(&old, 0); i >= 0; i = bitmapNext(&old, i + 1)) {
+            set->tree = KeyAvlInsert(set->tree, (int)(old.base + i), 0);
+        }
+        memset(&set->bitmap, 0, sizeof(set->bitmap));
+    } else {
+        for (int64_t i = bitmapNext(&old, 0); i >= 0; i = bitmapNext(&old, i + 1)) {
+            bitmapInsert(&set->bitmap, old.base + i - base);
+        }
+        set->rebuilds++;
+    }
+    bitmapFree(&old);
+}
+
+// Move or widen the bitmap so that it covers key, or give up on it. The
+// new window keeps at least a third of its room free, on the side the key
+// arrived from, so keys drifting in one direction cost amortised O(1) moves.
+void setCover(OrderedSet* set, int key) {
+    BitmapSet* bitmap = &set->bitmap;
+    int64_t low = key, high = key;
+    if (set->size > 0) {
+        int64_t first = bitmap->base + bitmapNext(bitmap, 0);
+        int64_t last = bitmap->base + bitmapPrevious(bitmap, bitmap->universe - 1);
+        if (first < low) low = first;
+        if (last > high) high = last;
+    }
+    int64_t needed = high - floorTo64(low) + 1;
+    if (needed > BITMAP_MAX_UNIVERSE) {
+        setRebuild(set, 0, 0);
+        return;
+    }
+    int64_t universe = bitmap->universe;
+    while (universe < needed + needed / 2 && universe < BITMAP_MAX_UNIVERSE) universe *= 2;
+    int64_t base = floorTo64(low);
+    if (key < bitmap->base) {
+        int64_t lowest = -floorTo64(universe - high - 1);  // high + 1 - universe, rounded up
+        if (lowest < base) base = lowest;
+    }
+    setRebuild(set, base, universe);
+}
+
+bool setInsert(OrderedSet* set, int key) {
+    bool added;
+    if (!set->useTree && set->bitmap.levelCount == 0) {
+        if (bitmapInit(&set->bitmap, floorTo64(key), BITMAP_MIN_UNIVERSE) != 0) {
+            fprintf(stderr, "Memory allocation failed\n");
+            exit(1);
+        }
+    }
+    if (!set->useTree) {
+        int64_t i = (int64_t)key - set->bitmap.base;
+        if (i < 0 || i >= set->bitmap.universe) setCover(set, key);
+    }
+    if (set->useTree) {
+        long before = KeyAvlSearch(set->tree, key) != NULL;
+        set->tree = KeyAvlInsert(set->tree, key, 0);
+        added = !before;
+    } else {
+        added = bitmapInsert(&set->bitmap, (int64_t)key - set->bitmap.base);
+    }
+    set->size += added;
+    return added;
+}
+
+bool setContains(const OrderedSet* set, int key) {
+    if (set->useTree) return KeyAvlSearch(set->tree, key) != NULL;
+    int64_t i = (int64_t)key - set->bitmap.base;
+    return set->bitmap.levelCount > 0 && i >= 0 && i < set->bitmap.universe && bitmapContains(&set->bitmap, i);
+}
+
+bool setDelete(OrderedSet* set, int key) {
+    if (!setContains(set, key)) return false;
+    if (set->useTree) set->tree = KeyAvlDelete(set->tree, key);
+    else bitmapDelete(&set->bitmap, (int64_t)key - set->bitmap.base);
+    set->size--;
+    return true;
+}
+
+// Smallest key >= key; returns false if there is none
+bool setSuccessor(const OrderedSet* set, int key, int* result) {
+    if (set->useTree) return treeSuccessor(set->tree, key, result);
+    if (set->bitmap.levelCount == 0) return false;
+    int64_t i = bitmapNext(&set->bitmap, (int64_t)key - set->bitmap.base);
+    if (i < 0) return false;
+    *result = (int)(set->bitmap.base + i);
+    return true;
+}
+
+// Number of keys below key
+long setRank(const OrderedSet* set, int key) {
+    if (set->useTree) return treeRank(set->tree, key);
+    if (set->bitmap.levelCount == 0) return 0;
+    return bitmapRank(&set->bitmap, (int64_t)key - set->bitmap.base);
+}
+
+size_t setBytes(const OrderedSet* set) {
+    if (set->useTree) return KeyAvlCount(set->tree) * allocationBytes(set->tree, sizeof(KeyAvlNode));
+    return set->bitmap.levelCount > 0 ? bitmapBytes(&set->bitmap) : 0;
+}
+
+// Walk the fallback tree and report its memory footprint and shape
+void collectTreeStats(const KeyAvlNode* node, int depth, TreeStats* stats) {
+    if (node == NULL) return;
+    treeStatsAddNode(stats, node, sizeof(KeyAvlNode), depth, 1);
+    collectTreeStats(node->left, depth + 1, stats);
+    collectTreeStats(node->right, depth + 1, stats);
+}
+
+void printSetStats(const OrderedSet* set) {
+    size_t bytes = setBytes(set);
+    if (set->useTree) {
+        printf("Ordered set: AVL tree, the keys span more than %lld values\n", (long long)BITMAP_MAX_UNIVERSE);
+        TreeStats stats;
+        treeStatsInit(&stats);
+        collectTreeStats(set->tree, 0, &stats);
+        treeStatsFinish(&stats);
+        printTreeStats(&stats, NULL, 1);
+        return;
+    }
+    const BitmapSet* bitmap = &set->bitmap;
+    printf("Ordered set: bitmap over [%lld, %lld), keys=%ld, levels=%d, bytes=%zu, bytes/key=%.2f, bits/possible key=%.3f, rebuilds=%ld\n",
+           (long long)bitmap->base, (long long)(bitmap->base + bitmap->universe), set->size, bitmap->levelCount,
+           bytes, set->size ? (double)bytes / set->size : 0.0, 8.0 * bytes / bitmap->universe, set->rebuilds);
+}
+
+// Stream the keys in order into a snapshot writer
+int saveSnapshot(const OrderedSet* set, const char* path) {
+    SnapshotWriter* writer = snapshotBegin(path);
+    if (writer == NULL) return -1;
+    int key;
+    for (bool more = setSuccessor(set, INT32_MIN, &key); more; more = key < INT32_MAX && setSuccessor(set, key + 1, &key)) {
+        snapshotAppend(writer, key);
+    }
+    return snapshotFinish(writer);
+}
+
+// Dense keys, where the bitmap applies, and keys over the whole int range,
+// where the set falls back to the tree; both against the plain AVL tree
+void benchmarkDensity(long count) {
+    for (int pass = 0; pass < 2; pass++) {
+        printf("\n%s: %ld keys\n", pass == 0 ? "Dense keys in [0, 2n)" : "Keys over the whole int range", count);
+        OrderedSet set;
+        setInit(&set);
+        KeyAvlNode* avl = NULL;
+        int* keys = (int*)malloc(sizeof(int) * count);
+        if (keys == NULL) {
+            fprintf(stderr, "Memory allocation failed\n");
+            return;
+        }
+        for (long i = 0; i < count; i++) {
+            keys[i] = pass == 0 ? rand() % (int)(2 * count) : (int)(((uint32_t)rand() << 16) ^ (uint32_t)rand());
+        }
+
+        uint64_t start = nowNanos();
+        for (long i = 0; i < count; i++) setInsert(&set, keys[i]);
+        double setInsertNanos = (double)(nowNanos() - start) / count;
+        start = nowNanos();
+        for (long i = 0; i < count; i++) avl = KeyAvlInsert(avl, keys[i], 0);
+        double avlInsertNanos = (double)(nowNanos() - start) / count;
+
+        long setFound = 0, avlFound = 0;
+        start = nowNanos();
+        for (long i = 0; i < count; i++) setFound += setContains(&set, keys[(i * 7919) % count] + (int)(i & 1));
+        double setSearchNanos = (double)(nowNanos() - start) / count;
+        start = nowNanos();
+        for (long i = 0; i < count; i++) avlFound += KeyAvlSearch(avl, keys[(i * 7919) % count] + (int)(i & 1)) != NULL;
+        double avlSearchNanos = (double)(nowNanos() - start) / count;
+
+        long avlNodes = KeyAvlCount(avl);
+        printSetStats(&set);
+        printf("Set: insert %.1f ns, search %.1f ns; AVL tree: insert %.1f ns, search %.1f ns, bytes/key=%.2f%s\n",
+               setInsertNanos, setSearchNanos, avlInsertNanos, avlSearchNanos,
+               (double)avlNodes * allocationBytes(avl, sizeof(KeyAvlNode)) / avlNodes,
+               setFound != avlFound ? " (lookup results differ)" : "");
+
+        setFree(&set);
+        KeyAvlFree(avl);
+        free(keys);
+    }
+}
+
+// Replay the file's operations on a scratch set with a clock read around
+// each one, outside the windows the hardware counters cover
+void recordLatencies(FILE* file, LatencyHistogram latency[]) {
+    OrderedSet set;
+    setInit(&set);
+    int number;
+    rewind(file);
+    while (fscanf(file, "%d,", &number) == 1) {
+        uint64_t opStart = nowNanos();
+        setInsert(&set, number);
+        histogramRecord(&latency[OP_INSERT], nowNanos() - opStart);
+    }
+
+    uint64_t opStart = nowNanos();
+    setContains(&set, 500);
+    histogramRecord(&latency[OP_SEARCH], nowNanos() - opStart);
+
+    opStart = nowNanos();
+    setDelete(&set, 500);
+    histogramRecord(&latency[OP_DELETE], nowNanos() - opStart);
+    setFree(&set);
+}
+
+void processFiles(const char* files[], int fileCount) {
+    OrderedSet set;
+    PerfCounters counters;
+    perfOpen(&counters);
+    static LatencyHistogram latency[OP_TYPE_COUNT], totalLatency[OP_TYPE_COUNT];
+    for (int op = 0; op < OP_TYPE_COUNT; op++) histogramInit(&totalLatency[op]);
+
+    for (int i = 0; i < fileCount; i++) {
+        FILE* file = fopen(files[i], "r");
+        if (file == NULL) {
+            perror("Error opening file");
+            return;
+        }
+
+        printf("\nProcessing file: %s\n", files[i]);
+
+        int number, nodeCount = 0;
+        clock_t start, end;
+        setInit(&set);
+
+        for (int op = 0; op < OP_TYPE_COUNT; op++) histogramInit(&latency[op]);
+
+        // Insertion time
+        start = clock();
+        perfStart(&counters);
+        while (fscanf(file, "%d,", &number) == 1) {
+            setInsert(&set, number);
+            nodeCount++;
+        }
+        perfStop(&counters);
+        end = clock();
+        printf("Insertion time for %d nodes: %f seconds\n", nodeCount, ((double)(end - start)) / CLOCKS_PER_SEC);
+        perfReport(&counters, "Insertion", nodeCount);
+        printSetStats(&set);
+
+        // Snapshot the set and serve the same lookups from the mapped image
+        char snapshotPath[256];
+        snprintf(snapshotPath, sizeof(snapshotPath), "%s.snap", files[i]);
+        start = clock();
+        int saved = saveSnapshot(&set, snapshotPath);
+        end = clock();
+        printf("Snapshot write time: %f seconds\n", ((double)(end - start)) / CLOCKS_PER_SEC);
+        if (saved == 0) snapshotBenchmark(snapshotPath, 500, 250, 750);
+
+        // Search time for node with value 500
+        start = clock();
+        perfStart(&counters);
+        bool found = setContains(&set, 500);
+        perfStop(&counters);
+        end = clock();
+        if (found) {
+            printf("Node with value 500 found.\n");
+        } else {
+            printf("Node with value 500 not found.\n");
+        }
+        printf("Search time for node with value 500: %f seconds\n", ((double)(end - start)) / CLOCKS_PER_SEC);
+        perfReport(&counters, "Search", 1);
+
+        int next;
+        if (setSuccessor(&set, 500, &next)) printf("Successor of 500: %d, ", next);
+        printf("rank of 500: %ld, keys in [250, 750]: %ld\n", setRank(&set, 500), setRank(&set, 751) - setRank(&set, 250));
+
+        // Deletion time for node with value 500
+        start = clock();
+        perfStart(&counters);
+        setDelete(&set, 500);
+        perfStop(&counters);
+        end = clock();
+        printf("Deletion time for node with value 500: %f seconds\n", ((double)(end - start)) / CLOCKS_PER_SEC);
+        perfReport(&counters, "Deletion", 1);
+
+        recordLatencies(file, latency);
+        for (int op = 0; op < OP_TYPE_COUNT; op++) {
+            histogramPrint(&latency[op], opTypeNames[op]);
+            histogramMerge(&totalLatency[op], &latency[op]);
+        }
+
+        fclose(file);
+        setFree(&set); // Reset the set for the next file
+    }
+
+    printf("\nLatency over all files:\n");
+    for (int op = 0; op < OP_TYPE_COUNT; op++) histogramPrint(&totalLatency[op], opTypeNames[op]);
+    perfClose(&counters);
+}
+
+int main() {
+    const char* files[] = {
+        "random_numbers.txt",
+        "mixed_numbers.txt",
+        "increasing_numbers.txt",
+        "decreasing_numbers.txt"
+    };
+
+    processFiles(files, 4);
+    srand(time(NULL));
+    benchmarkDensity(1000000);
+
+    return 0;
+}
@@ -0,0 +1,140 @@
+#ifndef EYTZINGER_H
+#define EYTZINGER_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+// Read-only copy of sorted keys in Eytzinger (breadth-first) order: slot 1
+// is the root and the children of slot k are 2k and 2k + 1. A descent
+// walks the array front to back, the top levels share a few hot cache
+// lines, and the 16 descendants four levels below slot k fill the one
+// 64-byte line starting at slot 16k, so the search prefetches that line
+// while it works through the levels in between.
+//
+// The descent has no data-dependent branch: each step appends the
+// comparison result to k as one bit, and once k runs off the array the
+// lower bound is k with its trailing ones and the zero before them shifted
+// out, which __builtin_ffs finds.
+//
+// An AVX2 version resolves eight keys at once, one per lane, with gathers.
+// It is picked at run time when the CPU has AVX2 and otherwise falls back
+// to the scalar descent.
+#define EYTZINGER_LINE 64
+#define EYTZINGER_BATCH 8
+#define EYTZINGER_MAX_KEYS (1L << 29)  // Lane indices stay in 32 bits
+
+typedef struct Eytzinger {
+    int32_t* keys;  // keys[1..count]; keys[0] is unused
+    long count;
+} Eytzinger;
+
+// Hand out the sorted keys to the subtree under slot k in order
+static long eytzingerFill(Eytzinger* tree, const int32_t* sorted, long next, long k) {
+    if (k > tree->count) return next;
+    next = eytzingerFill(tree, sorted, next, 2 * k);
+    tree->keys[k] = sorted[next++];
+    return eytzingerFill(tree, sorted, next, 2 * k + 1);
+}
+
+// Lay out count distinct sorted keys; returns -1 on failure. The array is
+// line-aligned so slot 16k always starts a cache line.
+static int eytzingerBuild(Eytzinger* tree, const int32_t* sorted, long count) {
+    if (count > EYTZINGER_MAX_KEYS) {
+        fprintf(stderr, "Too many keys for an Eytzinger copy: %ld\n", count);
+        return -1;
+    }
+    size_t bytes = sizeof(int32_t) * (count + 1);
+    bytes = (bytes + EYTZINGER_LINE - 1) / EYTZINGER_LINE * EYTZINGER_LINE;
+    tree->keys = (int32_t*)aligned_alloc(EYTZINGER_LINE, bytes);
+    if (tree->keys == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return -1;
+    }
+    tree->count = count;
+    tree->keys[0] = 0;
+    eytzingerFill(tree, sorted, 0, 1);
+    return 0;
+}
+
+static void eytzingerFree(Eytzinger* tree) {
+    free(tree->keys);
+    tree->keys = NULL;
+}
+
+static size_t eytzingerBytes(const Eytzinger* tree) {
+    return sizeof(int32_t) * (tree->count + 1);
+}
+
+// Slot of the first key >= key, or 0 if every key is smaller
+static long eytzingerLowerBound(const Eytzinger* tree, int key) {
+    const int32_t* keys = tree->keys;
+    long count = tree->count;
+    long k = 1;
+    while (k <= count) {
+        __builtin_prefetch(keys + 16 * k);
+        k = 2 * k + (keys[k] < key);
+    }
+    return k >> __builtin_ffsl(~k);
+}
+
+static int eytzingerContains(const Eytzinger* tree, int key) {
+    long k = eytzingerLowerBound(tree, key);
+    return k != 0 && tree->keys[k] == key;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+// Eight descents in lockstep, one step per bit of count. A lane that has
+// run off the array stops loading and keeps stepping right, which appends
+// a one that the final shift drops again, so every lane can run the
+// longest path. The eight gathers per level already overlap their misses,
+// so there is no prefetch.
+__attribute__((target("avx2")))
+static void eytzingerContainsAvx2(const Eytzinger* tree, const int* keys, int* found) {
+    __m256i query = _mm256_loadu_si256((const __m256i*)keys);
+    __m256i limit = _mm256_set1_epi32((int)tree->count + 1);
+    __m256i k = _mm256_set1_epi32(1);
+    for (long level = 1; level <= tree->count; level *= 2) {
+        __m256i inside = _mm256_cmpgt_epi32(limit, k);
+        __m256i values = _mm256_mask_i32gather_epi32(_mm256_setzero_si256(), tree->keys, k, inside, 4);
+        __m256i right = _mm256_or_si256(_mm256_cmpgt_epi32(query, values), _mm256_xor_si256(inside, _mm256_set1_epi32(-1)));
+        k = _mm256_sub_epi32(_mm256_add_epi32(k, k), right);
+    }
+
+    uint32_t slots[EYTZINGER_BATCH];
+    _mm256_storeu_si256((__m256i*)slots, k);
+    for (int lane = 0; lane < EYTZINGER_BATCH; lane++) {
+        uint32_t slot = slots[lane] >> __builtin_ffs(~slots[lane]);
+        found[lane] = slot != 0 && tree->keys[slot] == keys[lane];
+    }
+}
+#endif
+
+// Resolve count keys, found[i] set to whether keys[i] is present; returns
+// the number present
+static long eytzingerContainsBatch(const Eytzinger* tree, const int* keys, int* found, long count) {
+    long i = 0, present = 0;
+#if defined(__x86_64__) || defined(__i386__)
+    if (__builtin_cpu_supports("avx2")) {
+        for (; i + EYTZINGER_BATCH <= count; i += EYTZINGER_BATCH) {
+            eytzingerContainsAvx2(tree, keys + i, found + i);
+            for (int lane = 0; lane < EYTZINGER_BATCH; lane++) present += found[i + lane];
+        }
+    }
+#endif
+    for (; i < count; i++) present += found[i] = eytzingerContains(tree, keys[i]);
+    return present;
+}
+
+// Name of the batch path eytzingerContainsBatch takes on this CPU
+static const char* eytzingerBatchPath(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    if (__builtin_cpu_supports("avx2")) return "AVX2";
+#endif
+    return "scalar";
+}
+
+#endif
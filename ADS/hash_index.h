@@ -0,0 +1,246 @@
+#ifndef HASH_INDEX_H
+#define HASH_INDEX_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Open-addressing hash index from key to node handle, kept next to a tree
+// so exact-match lookups cost one or two cache lines instead of a descent.
+// Range and rank queries still go to the tree.
+//
+// Layout follows the Swiss-table scheme: slots are grouped by 16 and every
+// slot has a one-byte control entry holding either EMPTY, DELETED or the low
+// 7 bits of the key's hash. A probe loads the 16 control bytes of a group,
+// compares them with the hash tag in one SSE2 instruction (a portable loop
+// when SSE2 is missing) and only reads the slots whose tag matches. Groups
+// are probed in triangular order, which visits every group once.
+//
+// The index stores handles and never owns them: the engine must keep node
+// addresses stable while they are indexed and erase a key before freeing
+// its node.
+#define HASH_GROUP_SIZE 16
+#define HASH_CTRL_EMPTY ((int8_t)-128)
+#define HASH_CTRL_DELETED ((int8_t)-2)
+#define HASH_MAX_LOAD_NUM 7   // Grow beyond 7/8 full (tombstones included)
+#define HASH_MAX_LOAD_DEN 8
+
+typedef struct HashSlot {
+    int key;
+    void* handle;
+} HashSlot;
+
+typedef struct HashIndex {
+    int8_t* ctrl;        // One control byte per slot, 16-byte aligned
+    HashSlot* slots;
+    size_t capacity;     // Slot count, a power of two and at least one group
+    size_t size;
+    size_t tombstones;
+    long probes;         // Groups examined by hashIndexFind, for the stats
+    long finds;
+} HashIndex;
+
+static uint64_t hashKey(int key) {
+    // Murmur3 finaliser: cheap and mixes every input bit into the tag
+    uint64_t h = (uint64_t)(uint32_t)key;
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+// Bit i set when control byte i of the group equals tag
+static uint32_t hashGroupMatch(const int8_t* group, int8_t tag) {
+#ifdef __SSE2__
+    __m128i ctrl = _mm_load_si128((const __m128i*)group);
+    return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8(tag)));
+#else
+    uint32_t mask = 0;
+    for (int i = 0; i < HASH_GROUP_SIZE; i++) {
+        if (group[i] == tag) mask |= 1u << i;
+    }
+    return mask;
+#endif
+}
+
+// Bit i set when control byte i is EMPTY or DELETED (both have the sign bit)
+static uint32_t hashGroupFree(const int8_t* group) {
+#ifdef __SSE2__
+    return (uint32_t)_mm_movemask_epi8(_mm_load_si128((const __m128i*)group));
+#else
+    uint32_t mask = 0;
+    for (int i = 0; i < HASH_GROUP_SIZE; i++) {
+        if (group[i] < 0) mask |= 1u << i;
+    }
+    return mask;
+#endif
+}
+
+static int hashIndexAllocate(HashIndex* index, size_t capacity) {
+    index->ctrl = (int8_t*)aligned_alloc(HASH_GROUP_SIZE, capacity);
+    index->slots = (HashSlot*)malloc(sizeof(HashSlot) * capacity);
+    if (index->ctrl == NULL || index->slots == NULL) {
+        free(index->ctrl);
+        free(index->slots);
+        fprintf(stderr, "Memory allocation failed\n");
+        return -1;
+    }
+    memset(index->ctrl, (unsigned char)HASH_CTRL_EMPTY, capacity);
+    index->capacity = capacity;
+    index->size = 0;
+    index->tombstones = 0;
+    return 0;
+}
+
+// Prepare an index sized for about expected keys. Returns 0 on success.
+static int hashIndexInit(HashIndex* index, size_t expected) {
+    size_t capacity = HASH_GROUP_SIZE;
+    while (capacity * HASH_MAX_LOAD_NUM < expected * HASH_MAX_LOAD_DEN) capacity *= 2;
+    index->probes = 0;
+    index->finds = 0;
+    return hashIndexAllocate(index, capacity);
+}
+
+static void hashIndexFree(HashIndex* index) {
+    free(index->ctrl);
+    free(index->slots);
+    index->ctrl = NULL;
+    index->slots = NULL;
+    index->capacity = index->size = index->tombstones = 0;
+}
+
+// Handle stored for key, or NULL if the key is not indexed
+static void* hashIndexFind(HashIndex* index, int key) {
+    uint64_t hash = hashKey(key);
+    int8_t tag = (int8_t)(hash & 0x7f);
+    size_t groupMask = index->capacity / HASH_GROUP_SIZE - 1;
+    size_t group = (size_t)(hash >> 7) & groupMask;
+
+    index->finds++;
+    for (size_t step = 1; ; step++) {
+        const int8_t* ctrl = index->ctrl + group * HASH_GROUP_SIZE;
+        index->probes++;
+        for (uint32_t match = hashGroupMatch(ctrl, tag); match != 0; match &= match - 1) {
+            HashSlot* slot = &index->slots[group * HASH_GROUP_SIZE + __builtin_ctz(match)];
+            if (slot->key == key) return slot->handle;
+        }
+        // A group with an empty slot ends every probe sequence through it
+        if (hashGroupMatch(ctrl, HASH_CTRL_EMPTY) != 0) return NULL;
+        group = (group + step) & groupMask;
+    }
+}
+
+// Place a key known to be absent; the table must have a free slot
+static void hashIndexPlace(HashIndex* index, int key, void* handle) {
+    uint64_t hash = hashKey(key);
+    size_t groupMask = index->capacity / HASH_GROUP_SIZE - 1;
+    size_t group = (size_t)(hash >> 7) & groupMask;
+
+    for (size_t step = 1; ; step++) {
+        int8_t* ctrl = index->ctrl + group * HASH_GROUP_SIZE;
+        uint32_t available = hashGroupFree(ctrl);
+        if (available != 0) {
+            int i = __builtin_ctz(available);
+            if (ctrl[i] == HASH_CTRL_DELETED) index->tombstones--;
+            ctrl[i] = (int8_t)(hash & 0x7f);
+            index->slots[group * HASH_GROUP_SIZE + i].key = key;
+            index->slots[group * HASH_GROUP_SIZE + i].handle = handle;
+            index->size++;
+            return;
+        }
+        group = (group + step) & groupMask;
+    }
+}
+
+// Rebuild into a table of the given capacity, dropping tombstones
+static int hashIndexRehash(HashIndex* index, size_t capacity) {
+    HashIndex old = *index;
+    if (hashIndexAllocate(index, capacity) != 0) {
+        *index = old;
+        return -1;
+    }
+    for (size_t i = 0; i < old.capacity; i++) {
+        if (old.ctrl[i] >= 0) hashIndexPlace(index, old.slots[i].key, old.slots[i].handle);
+    }
+    free(old.ctrl);
+    free(old.slots);
+    return 0;
+}
+
+// Map key to handle, replacing any handle it had. Returns 0 on success.
+static int hashIndexPut(HashIndex* index, int key, void* handle) {
+    uint64_t hash = hashKey(key);
+    int8_t tag = (int8_t)(hash & 0x7f);
+    size_t groupMask = index->capacity / HASH_GROUP_SIZE - 1;
+    size_t group = (size_t)(hash >> 7) & groupMask;
+
+    for (size_t step = 1; ; step++) {
+        const int8_t* ctrl = index->ctrl + group * HASH_GROUP_SIZE;
+        for (uint32_t match = hashGroupMatch(ctrl, tag); match != 0; match &= match - 1) {
+            HashSlot* slot = &index->slots[group * HASH_GROUP_SIZE + __builtin_ctz(match)];
+            if (slot->key == key) {
+                slot->handle = handle;
+                return 0;
+            }
+        }
+        if (hashGroupMatch(ctrl, HASH_CTRL_EMPTY) != 0) break;
+        group = (group + step) & groupMask;
+    }
+
+    if ((index->size + index->tombstones + 1) * HASH_MAX_LOAD_DEN > index->capacity * HASH_MAX_LOAD_NUM) {
+        // Mostly tombstones: clean up in place, otherwise double
+        size_t capacity = index->capacity;
+        if ((index->size + 1) * HASH_MAX_LOAD_DEN * 2 > capacity * HASH_MAX_LOAD_NUM) capacity *= 2;
+        if (hashIndexRehash(index, capacity) != 0) return -1;
+    }
+    hashIndexPlace(index, key, handle);
+    return 0;
+}
+
+// Remove key; returns 1 if it was indexed
+static int hashIndexErase(HashIndex* index, int key) {
+    uint64_t hash = hashKey(key);
+    int8_t tag = (int8_t)(hash & 0x7f);
+    size_t groupMask = index->capacity / HASH_GROUP_SIZE - 1;
+    size_t group = (size_t)(hash >> 7) & groupMask;
+
+    for (size_t step = 1; ; step++) {
+        int8_t* ctrl = index->ctrl + group * HASH_GROUP_SIZE;
+        int hasEmpty = hashGroupMatch(ctrl, HASH_CTRL_EMPTY) != 0;
+        for (uint32_t match = hashGroupMatch(ctrl, tag); match != 0; match &= match - 1) {
+            int i = __builtin_ctz(match);
+            if (index->slots[group * HASH_GROUP_SIZE + i].key != key) continue;
+            // No probe has ever passed a group that still has an empty
+            // slot, so the slot can go straight back to EMPTY there
+            if (hasEmpty) {
+                ctrl[i] = HASH_CTRL_EMPTY;
+            } else {
+                ctrl[i] = HASH_CTRL_DELETED;
+                index->tombstones++;
+            }
+            index->size--;
+            return 1;
+        }
+        if (hasEmpty) return 0;
+        group = (group + step) & groupMask;
+    }
+}
+
+static size_t hashIndexBytes(const HashIndex* index) {
+    return index->capacity * (sizeof(int8_t) + sizeof(HashSlot));
+}
+
+static void printHashIndexStats(const HashIndex* index) {
+    printf("Hash index: keys=%zu, slots=%zu, load=%.1f%%, tombstones=%zu, bytes=%zu, bytes/key=%.2f, groups/find=%.2f\n",
+           index->size, index->capacity, 100.0 * index->size / index->capacity, index->tombstones,
+           hashIndexBytes(index), index->size ? (double)hashIndexBytes(index) / index->size : 0.0,
+           index->finds ? (double)index->probes / index->finds : 0.0);
+}
+
+#endif
@@ -0,0 +1,116 @@
+#ifndef LATENCY_HISTOGRAM_H
+#define LATENCY_HISTOGRAM_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+// Log-linear (HDR style) latency histogram in nanoseconds. Values below
+// HIST_SUB_BUCKETS are recorded exactly; above that every power of two is
+// split into HIST_SUB_BUCKETS / 2 linear sub-buckets, which bounds the
+// relative error of any reported percentile to under 1/64 (~1.6%) over the
+// whole 64-bit range.
+#define HIST_SUB_BUCKET_BITS 7
+#define HIST_SUB_BUCKETS (1 << HIST_SUB_BUCKET_BITS)
+#define HIST_HALF_BUCKETS (HIST_SUB_BUCKETS / 2)
+#define HIST_BUCKET_COUNT (HIST_SUB_BUCKETS + (64 - HIST_SUB_BUCKET_BITS) * HIST_HALF_BUCKETS)
+
+// Operation types recorded by the benchmarks
+typedef enum {
+    OP_INSERT,
+    OP_SEARCH,
+    OP_DELETE,
+    OP_TYPE_COUNT
+} OpType;
+
+static const char* opTypeNames[OP_TYPE_COUNT] = { "Insertion", "Search", "Deletion" };
+
+// Histograms are plain values: give every thread its own and combine them
+// with histogramMerge, so the recording path never needs synchronisation
+typedef struct LatencyHistogram {
+    uint64_t counts[HIST_BUCKET_COUNT];
+    uint64_t total;
+    uint64_t min, max;
+    double sum;
+} LatencyHistogram;
+
+static uint64_t nowNanos(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static void histogramInit(LatencyHistogram* h) {
+    memset(h, 0, sizeof(*h));
+    h->min = UINT64_MAX;
+}
+
+static int histogramIndex(uint64_t value) {
+    if (value < HIST_SUB_BUCKETS) return (int)value;
+    int msb = 63 - __builtin_clzll(value);
+    int shift = msb - (HIST_SUB_BUCKET_BITS - 1);
+    int sub = (int)(value >> shift) - HIST_HALF_BUCKETS;
+    return HIST_SUB_BUCKETS + (shift - 1) * HIST_HALF_BUCKETS + sub;
+}
+
+// Largest value that maps to the same bucket as index
+static uint64_t histogramHighestEquivalent(int index) {
+    if (index < HIST_SUB_BUCKETS) return (uint64_t)index;
+    int shift = (index - HIST_SUB_BUCKETS) / HIST_HALF_BUCKETS + 1;
+    uint64_t sub = (uint64_t)((index - HIST_SUB_BUCKETS) % HIST_HALF_BUCKETS + HIST_HALF_BUCKETS);
+    return ((sub + 1) << shift) - 1;
+}
+
+static void histogramRecord(LatencyHistogram* h, uint64_t nanos) {
+    h->counts[histogramIndex(nanos)]++;
+    h->total++;
+    h->sum += (double)nanos;
+    if (nanos < h->min) h->min = nanos;
+    if (nanos > h->max) h->max = nanos;
+}
+
+static void histogramMerge(LatencyHistogram* dst, const LatencyHistogram* src) {
+    for (int i = 0; i < HIST_BUCKET_COUNT; i++) {
+        dst->counts[i] += src->counts[i];
+    }
+    dst->total += src->total;
+    dst->sum += src->sum;
+    if (src->min < dst->min) dst->min = src->min;
+    if (src->max > dst->max) dst->max = src->max;
+}
+
+// Value at the given percentile (0-100), clamped to the exact recorded max
+static uint64_t histogramPercentile(const LatencyHistogram* h, double percentile) {
+    if (h->total == 0) return 0;
+    uint64_t rank = (uint64_t)(percentile / 100.0 * (double)h->total + 0.5);
+    if (rank < 1) rank = 1;
+    if (rank > h->total) rank = h->total;
+
+    uint64_t seen = 0;
+    for (int i = 0; i < HIST_BUCKET_COUNT; i++) {
+        seen += h->counts[i];
+        if (seen >= rank) {
+            uint64_t value = histogramHighestEquivalent(i);
+            return value < h->max ? value : h->max;
+        }
+    }
+    return h->max;
+}
+
+static void histogramPrint(const LatencyHistogram* h, const char* label) {
+    if (h->total == 0) {
+        printf("%s latency: no samples\n", label);
+        return;
+    }
+    printf("%s latency (ns): count=%llu, mean=%.1f, min=%llu, p50=%llu, p99=%llu, p99.9=%llu, max=%llu\n",
+           label,
+           (unsigned long long)h->total, h->sum / (double)h->total,
+           (unsigned long long)h->min,
+           (unsigned long long)histogramPercentile(h, 50.0),
+           (unsigned long long)histogramPercentile(h, 99.0),
+           (unsigned long long)histogramPercentile(h, 99.9),
+           (unsigned long long)h->max);
+}
+
+#endif
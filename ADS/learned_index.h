@@ -0,0 +1,197 @@
+#ifndef LEARNED_INDEX_H
+#define LEARNED_INDEX_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+// Learned index over a static sorted array of distinct keys, in the style of
+// the PGM index. The keys are covered by linear segments, each predicting a
+// key's position to within LEARNED_EPSILON, and the first keys of those
+// segments are covered again by a smaller level, until one segment is left.
+// A lookup evaluates one segment per level and finishes with a binary search
+// over at most 2 * epsilon + 2 keys, so on near-linear data (sequential IDs,
+// smooth distributions) a handful of multiplies replaces the descent.
+//
+// Segments come from the shrinking-cone method: a segment is pinned at its
+// first key and keeps the range of slopes that still predict every key seen
+// so far within epsilon; when the range empties a new segment starts. That
+// is a single pass over the keys per level. The index only points at the
+// keys, so they must outlive it (a mapped snapshot does).
+#ifndef LEARNED_EPSILON
+#define LEARNED_EPSILON 32
+#endif
+#define LEARNED_EPSILON_UPPER 4   // Tighter bound for the levels above the keys
+#define LEARNED_MAX_LEVELS 16
+
+typedef struct LearnedSegment {
+    int32_t key;       // First key covered
+    int32_t position;  // Its position in the level below
+    double slope;
+} LearnedSegment;
+
+typedef struct LearnedIndex {
+    const int32_t* keys;
+    long keyCount;
+    LearnedSegment* segments;     // All levels, bottom level first
+    long levelStart[LEARNED_MAX_LEVELS];
+    long levelSize[LEARNED_MAX_LEVELS];
+    int levelCount;
+} LearnedIndex;
+
+// Cover count sorted keys with segments of error at most epsilon, appending
+// them to out; returns the number of segments
+static long learnedBuildLevel(const int32_t* keys, long count, int epsilon, LearnedSegment* out) {
+    long segments = 0;
+    long first = 0;
+    double low = 0.0, high = 1e300;
+    for (long i = 1; i <= count; i++) {
+        if (i < count) {
+            double dx = (double)keys[i] - (double)keys[first];
+            double dy = (double)(i - first);
+            double segLow = (dy - epsilon) / dx;
+            double segHigh = (dy + epsilon) / dx;
+            if (segLow < low) segLow = low;
+            if (segHigh > high) segHigh = high;
+            if (segLow <= segHigh) {
+                low = segLow;
+                high = segHigh;
+                continue;
+            }
+        }
+        // Key i does not fit the cone (or the keys ran out): close the segment
+        out[segments].key = keys[first];
+        out[segments].position = (int32_t)first;
+        out[segments].slope = i - first == 1 ? 0.0 : (low + high) / 2;
+        segments++;
+        first = i;
+        low = 0.0;
+        high = 1e300;
+    }
+    return segments;
+}
+
+// Build the index over keys, which must be sorted and distinct. Returns 0 on
+// success.
+static int learnedIndexBuild(LearnedIndex* index, const int32_t* keys, long count) {
+    memset(index, 0, sizeof(*index));
+    index->keys = keys;
+    index->keyCount = count;
+    if (count == 0) return 0;
+
+    // Every level has at most half the entries of the one below, plus one
+    index->segments = (LearnedSegment*)malloc(sizeof(LearnedSegment) * (2 * count + LEARNED_MAX_LEVELS));
+    int32_t* levelKeys = (int32_t*)malloc(sizeof(int32_t) * count);
+    if (index->segments == NULL || levelKeys == NULL) {
+        free(index->segments);
+        free(levelKeys);
+        index->segments = NULL;
+        fprintf(stderr, "Memory allocation failed\n");
+        return -1;
+    }
+
+    const int32_t* levelInput = keys;
+    long levelInputCount = count;
+    long used = 0;
+    int epsilon = LEARNED_EPSILON;
+    while (index->levelCount < LEARNED_MAX_LEVELS) {
+        long size = learnedBuildLevel(levelInput, levelInputCount, epsilon, index->segments + used);
+        index->levelStart[index->levelCount] = used;
+        index->levelSize[index->levelCount] = size;
+        index->levelCount++;
+        if (size == 1) break;
+        for (long i = 0; i < size; i++) levelKeys[i] = index->segments[used + i].key;
+        levelInput = levelKeys;
+        levelInputCount = size;
+        used += size;
+        epsilon = LEARNED_EPSILON_UPPER;
+    }
+    free(levelKeys);
+    return 0;
+}
+
+static void learnedIndexFree(LearnedIndex* index) {
+    free(index->segments);
+    index->segments = NULL;
+}
+
+// Predicted position of key in the level below segment, capped at the start
+// of the next segment so keys in the gap after a segment do not extrapolate
+static long learnedPredict(const LearnedSegment* segment, long nextPosition, int key) {
+    if (key <= segment->key) return segment->position;
+    long position = segment->position + (long)(segment->slope * ((double)key - (double)segment->key));
+    return position < nextPosition ? position : nextPosition;
+}
+
+// Position of the first key >= key, or keyCount if there is none
+static long learnedIndexLowerBound(const LearnedIndex* index, int key) {
+    if (index->keyCount == 0) return 0;
+
+    // The top level is a single segment unless LEARNED_MAX_LEVELS ran out
+    int level = index->levelCount - 1;
+    const LearnedSegment* top = index->segments + index->levelStart[level];
+    long lo = 1, hi = index->levelSize[level];
+    while (lo < hi) {
+        long mid = lo + (hi - lo) / 2;
+        if (top[mid].key <= key) lo = mid + 1;
+        else hi = mid;
+    }
+    const LearnedSegment* segment = top + lo - 1;
+
+    // Walk down the levels, keeping the segment whose range holds key
+    while (level > 0) {
+        const LearnedSegment* below = index->segments + index->levelStart[level - 1];
+        long belowSize = index->levelSize[level - 1];
+        long next = segment + 1 < index->segments + index->levelStart[level] + index->levelSize[level]
+                  ? segment[1].position : belowSize;
+        long guess = learnedPredict(segment, next, key);
+        // Last entry <= key within the error window
+        lo = guess - LEARNED_EPSILON_UPPER - 1;
+        hi = guess + LEARNED_EPSILON_UPPER + 2;
+        if (lo < segment->position) lo = segment->position;
+        if (hi > next) hi = next;
+        while (lo < hi) {
+            long mid = lo + (hi - lo) / 2;
+            if (below[mid].key <= key) lo = mid + 1;
+            else hi = mid;
+        }
+        segment = below + (lo > segment->position ? lo - 1 : segment->position);
+        level--;
+    }
+
+    long segmentIndex = segment - index->segments;
+    long next = segmentIndex + 1 < index->levelSize[0] ? segment[1].position : index->keyCount;
+    long guess = learnedPredict(segment, next, key);
+    lo = guess - LEARNED_EPSILON - 1;
+    hi = guess + LEARNED_EPSILON + 2;
+    if (lo < segment->position) lo = segment->position;
+    if (hi > next) hi = next;
+    while (lo < hi) {
+        long mid = lo + (hi - lo) / 2;
+        if (index->keys[mid] < key) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+// Position of key, or -1 if it is absent
+static long learnedIndexSearch(const LearnedIndex* index, int key) {
+    long pos = learnedIndexLowerBound(index, key);
+    if (pos < index->keyCount && index->keys[pos] == key) return pos;
+    return -1;
+}
+
+static size_t learnedIndexBytes(const LearnedIndex* index) {
+    size_t segments = 0;
+    for (int level = 0; level < index->levelCount; level++) segments += index->levelSize[level];
+    return segments * sizeof(LearnedSegment);
+}
+
+static void printLearnedIndexStats(const LearnedIndex* index) {
+    printf("Learned index: keys=%ld, epsilon=%d, levels=%d, segments=%ld, bytes=%zu, keys/segment=%.1f\n",
+           index->keyCount, LEARNED_EPSILON, index->levelCount, index->levelCount ? index->levelSize[0] : 0,
+           learnedIndexBytes(index), index->levelCount ? (double)index->keyCount / index->levelSize[0] : 0.0);
+}
+
+#endif
@@ -0,0 +1,703 @@
+// Log-structured merge engine built on the red-black tree in rbtree.c.
+// Updates go into a small in-memory tree, the memtable; once it has taken
+// memtableUpdates updates it is frozen and a fresh one takes over. A
+// compactor thread turns every frozen memtable into an immutable sorted
+// run and merges runs into larger ones in the background, so the writer
+// only ever touches a tree that fits in cache and never waits for a merge
+// unless LSM_MAX_FROZEN memtables are already queued.
+//
+// Deletes are tombstones that shadow older entries until a merge that
+// reaches the oldest run drops them. A delete only touches the memtable;
+// when its tombstones are flushed the compactor charges them to the older
+// runs still holding the keys, and once a quarter of a run is dead it
+// merges the tombstones down onto it to purge them. A lookup goes from the newest data to
+// the oldest and stops at the first entry for its key; every run has a
+// Bloom filter, so runs that do not hold the key cost one cache line.
+//
+// Two compaction policies are supported. Tiered lets LSM_FANOUT runs pile
+// up on a level and merges them into one run on the next level, writing
+// each entry once per level. Leveled keeps one run per level, each
+// LSM_FANOUT times larger than the one above, and merges into it whenever
+// the level above overflows: more rewriting, but fewer runs to probe.
+#define RBTREE_NO_MAIN
+#include "rbtree.c"
+#include <stdbool.h>
+#include <pthread.h>
+#include "bloom_filter.h"
+
+#define LSM_MEMTABLE_UPDATES 65536   // Default updates a memtable takes before it is frozen
+#define LSM_MAX_FROZEN 2             // Frozen memtables queued before writers stall
+#define LSM_FANOUT 4                 // Runs per tier, or size ratio between levels
+#define LSM_MAX_RUNS 64
+
+typedef enum { COMPACTION_TIERED, COMPACTION_LEVELED } CompactionPolicy;
+
+const char* policyNames[] = { "tiered", "leveled" };
+
+typedef struct Memtable {
+    RedBlackTree* live;         // Keys inserted since the memtable started
+    RedBlackTree* tombstones;   // Keys deleted since then
+    long updates;
+} Memtable;
+
+typedef struct Run {
+    int* keys;
+    unsigned char* deleted;     // 1 where the entry is a tombstone
+    long count;
+    long tombstoneCount;
+    int level;
+    int compactNow;             // Set by the compactor once many of the run's keys were deleted
+    BloomFilter filter;         // Holds tombstones too: they answer lookups
+} Run;
+
+typedef struct LsmTree {
+    Memtable* active;                    // Only touched by the writer
+    Memtable* frozen[LSM_MAX_FROZEN];    // Oldest first
+    int frozenCount;
+    Run* runs[LSM_MAX_RUNS];             // Newest first; levels never decrease along the array
+    int runCount;
+    CompactionPolicy policy;
+    long memtableUpdates;
+    int busy;                            // The compactor is working outside the lock
+    int stopping;
+    pthread_t compactor;
+    pthread_mutex_t lock;                // Guards frozen, runs, busy and stopping
+    pthread_cond_t work, progress;
+    pthread_rwlock_t view;               // Shared by lookups; exclusive while frozen or runs change
+
+    long updates;
+    long stalls;
+    uint64_t stallNanos;
+    long flushes;                        // Memtables written out as runs
+    long compactions;
+    long entriesWritten;                 // Run entries written by flushes and compactions
+    uint64_t compactionNanos;
+    long lookups;
+    long runProbes;                      // Runs searched after their filter let the key through
+} LsmTree;
+
+Memtable* memtableCreate() {
+    Memtable* memtable = (Memtable*)malloc(sizeof(Memtable));
+    if (memtable == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(1);
+    }
+    memtable->live = initializeTree();
+    memtable->tombstones = initializeTree();
+    memtable->updates = 0;
+    return memtable;
+}
+
+void memtableFree(Memtable* memtable) {
+    destroyTree(memtable->live);
+    destroyTree(memtable->tombstones);
+    free(memtable);
+}
+
+// Remove key from tree if it is there
+void removeKey(RedBlackTree* tree, int key) {
+    Node* node = search(tree, tree->root, key);
+    if (node != tree->NIL) deleteNode(tree, node);
+}
+
+void memtablePut(Memtable* memtable, int key) {
+    if (memtable->tombstones->root != memtable->tombstones->NIL) removeKey(memtable->tombstones, key);
+    insert(memtable->live, key);
+    memtable->updates++;
+}
+
+void memtableDelete(Memtable* memtable, int key) {
+    removeKey(memtable->live, key);
+    insert(memtable->tombstones, key);
+    memtable->updates++;
+}
+
+// 1 if the memtable holds key, 0 if it deletes it, -1 if it has no entry
+int memtableFind(Memtable* memtable, int key) {
+    if (search(memtable->live, memtable->live->root, key) != memtable->live->NIL) return 1;
+    if (memtable->tombstones->root == memtable->tombstones->NIL) return -1;
+    return search(memtable->tombstones, memtable->tombstones->root, key) != memtable->tombstones->NIL ? 0 : -1;
+}
+
+Run* runCreate(long capacity, int level) {
+    Run* run = (Run*)calloc(1, sizeof(Run));
+    if (run != NULL) {
+        run->keys = (int*)malloc(sizeof(int) * (capacity > 0 ? capacity : 1));
+        run->deleted = (unsigned char*)malloc(capacity > 0 ? capacity : 1);
+    }
+    if (run == NULL || run->keys == NULL || run->deleted == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(1);
+    }
+    run->level = level;
+    return run;
+}
+
+void runFree(Run* run) {
+    bloomFilterFree(&run->filter);
+    free(run->keys);
+    free(run->deleted);
+    free(run);
+}
+
+// Size the filter to the entries written and fill it
+void runFinish(Run* run) {
+    if (bloomFilterInit(&run->filter, run->count, BLOOM_BITS_PER_KEY) != 0) exit(1);
+    for (long i = 0; i < run->count; i++) bloomFilterAdd(&run->filter, run->keys[i]);
+}
+
+// Append the keys of a memtable tree in order
+void collectKeys(RedBlackTree* tree, Node* node, int* keys, long* count) {
+    if (node == tree->NIL) return;
+    collectKeys(tree, node->left, keys, count);
+    keys[(*count)++] = node->data;
+    collectKeys(tree, node->right, keys, count);
+}
+
+// Position of the first entry not below key
+long runSeek(const Run* run, int key) {
+    long lo = 0, hi = run->count;
+    while (lo < hi) {
+        long mid = lo + (hi - lo) / 2;
+        if (run->keys[mid] < key) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+// Whether run holds a live entry for key. Unlike runFind it leaves the
+// filter's counters alone, so the compactor can use it beside lookups.
+bool runHolds(const Run* run, int key) {
+    if (!bloomFilterTest(&run->filter, key)) return false;
+    long pos = runSeek(run, key);
+    return pos < run->count && run->keys[pos] == key && !run->deleted[pos];
+}
+
+// Write a frozen memtable out as a level 0 run. Its two trees hold
+// different keys, so one merge of their in-order walks sorts the entries.
+// Every run already in the tree is older than the memtable, so each of its
+// tombstones kills the entries the older runs hold for that key; charge
+// them here, off the writer's path, and flag the runs a purge merge is due
+// for. The compactor only acts on the flags once this run is in place, so
+// that merge takes the tombstones along.
+Run* runFromMemtable(LsmTree* lsm, Memtable* memtable) {
+    Run* run = runCreate(memtable->updates, 0);
+    int* live = (int*)malloc(sizeof(int) * (memtable->updates + 1));
+    int* dead = (int*)malloc(sizeof(int) * (memtable->updates + 1));
+    if (live == NULL || dead == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(1);
+    }
+    long liveCount = 0, deadCount = 0;
+    collectKeys(memtable->live, memtable->live->root, live, &liveCount);
+    collectKeys(memtable->tombstones, memtable->tombstones->root, dead, &deadCount);
+    long i = 0, j = 0;
+    while (i < liveCount || j < deadCount) {
+        bool takeDead = i == liveCount || (j < deadCount && dead[j] < live[i]);
+        run->keys[run->count] = takeDead ? dead[j++] : live[i++];
+        run->deleted[run->count++] = takeDead;
+    }
+    run->tombstoneCount = deadCount;
+    for (int r = 0; r < lsm->runCount; r++) {
+        Run* older = lsm->runs[r];
+        for (long k = 0; k < deadCount; k++) {
+            if (runHolds(older, dead[k])) bloomFilterNoteDelete(&older->filter);
+        }
+        if (!older->compactNow && bloomFilterStale(&older->filter)) {
+            __atomic_store_n(&older->compactNow, 1, __ATOMIC_RELAXED);
+        }
+    }
+    free(live);
+    free(dead);
+    runFinish(run);
+    return run;
+}
+
+// Merge runs (newest first) into one run on level; for a key in several
+// runs the newest entry wins. Tombstones are dropped when nothing older
+// than these runs is left for them to shadow. The deletes charged to the
+// runs carry over to the merged run, less the entries this merge purges.
+Run* mergeRuns(Run** runs, int count, int level, bool dropTombstones) {
+    long total = 0, charged = 0, purged = 0;
+    long positions[LSM_MAX_RUNS] = { 0 };
+    for (int r = 0; r < count; r++) {
+        total += runs[r]->count;
+        charged += (long)runs[r]->filter.deleted;
+    }
+    Run* merged = runCreate(total, level);
+    for (;;) {
+        int newest = -1;
+        int key = 0;
+        for (int r = 0; r < count; r++) {
+            if (positions[r] == runs[r]->count) continue;
+            int candidate = runs[r]->keys[positions[r]];
+            if (newest < 0 || candidate < key) {
+                newest = r;
+                key = candidate;
+            }
+        }
+        if (newest < 0) break;
+        bool deleted = runs[newest]->deleted[positions[newest]];
+        // Step past key in every run; the older entries are shadowed
+        for (int r = 0; r < count; r++) {
+            if (positions[r] == runs[r]->count || runs[r]->keys[positions[r]] != key) continue;
+            if (r != newest && !runs[r]->deleted[positions[r]]) purged++;
+            positions[r]++;
+        }
+        if (deleted && dropTombstones) continue;
+        merged->keys[merged->count] = key;
+        merged->deleted[merged->count++] = deleted;
+        merged->tombstoneCount += deleted;
+    }
+    runFinish(merged);
+    merged->filter.deleted = charged > purged ? (size_t)(charged - purged) : 0;
+    merged->compactNow = bloomFilterStale(&merged->filter);
+    return merged;
+}
+
+// Entries a leveled run on level may hold before it is pushed down
+long levelCapacity(const LsmTree* lsm, int level) {
+    long capacity = lsm->memtableUpdates * LSM_FANOUT;
+    for (int l = 0; l < level && capacity < (1L << 40); l++) capacity *= LSM_FANOUT;
+    return capacity;
+}
+
+// Choose the next merge: runs[first, first + count) become one run on
+// level. Returns false when no merge is due. Called with the lock held.
+bool pickCompaction(const LsmTree* lsm, int* first, int* count, int* level) {
+    for (int i = 0; i < lsm->runCount;) {
+        int l = lsm->runs[i]->level;
+        int j = i;
+        bool stale = false;
+        while (j < lsm->runCount && lsm->runs[j]->level == l) {
+            stale |= __atomic_load_n(&lsm->runs[j]->compactNow, __ATOMIC_RELAXED);
+            j++;
+        }
+        if (stale) {
+            // Deleted keys are only purged when the tombstones, which are
+            // in newer runs, are merged into the run holding them
+            *first = 0;
+            *count = j;
+            *level = l;
+            return true;
+        }
+        if (lsm->policy == COMPACTION_TIERED) {
+            if (j - i >= LSM_FANOUT) {
+                *first = i;
+                *count = j - i;
+                *level = l + 1;
+                return true;
+            }
+        } else if (j - i >= 2) {
+            *first = i;
+            *count = j - i;
+            *level = l;
+            return true;
+        } else if (lsm->runs[i]->count > levelCapacity(lsm, l)) {
+            // Push the run into the next level, merging it with that level's run
+            int k = j;
+            while (k < lsm->runCount && lsm->runs[k]->level == l + 1) k++;
+            *first = i;
+            *count = k - i;
+            *level = l + 1;
+            return true;
+        }
+        i = j;
+    }
+    return false;
+}
+
+// Put run in place of runs[first, first + count). Called with the lock held.
+void replaceRuns(LsmTree* lsm, int first, int count, Run* run) {
+    pthread_rwlock_wrlock(&lsm->view);
+    memmove(lsm->runs + first + 1, lsm->runs + first + count, sizeof(Run*) * (lsm->runCount - first - count));
+    lsm->runs[first] = run;
+    lsm->runCount += 1 - count;
+    pthread_rwlock_unlock(&lsm->view);
+}
+
+// Compactor thread: flush frozen memtables first, so writers are not kept
+// waiting, then run whatever merges are due
+void* compactorMain(void* arg) {
+    LsmTree* lsm = (LsmTree*)arg;
+    int first, count, level;
+    pthread_mutex_lock(&lsm->lock);
+    for (;;) {
+        bool due = pickCompaction(lsm, &first, &count, &level);
+        while (lsm->frozenCount == 0 && !due && !lsm->stopping) {
+            pthread_cond_wait(&lsm->work, &lsm->lock);
+            due = pickCompaction(lsm, &first, &count, &level);
+        }
+        if (lsm->stopping && lsm->frozenCount == 0) break;
+        lsm->busy = 1;
+        uint64_t start = nowNanos();
+
+        if (lsm->frozenCount > 0 && (!due || lsm->runCount < LSM_MAX_RUNS / 2)) {
+            Memtable* memtable = lsm->frozen[0];
+            pthread_mutex_unlock(&lsm->lock);
+            Run* run = runFromMemtable(lsm, memtable);
+            pthread_mutex_lock(&lsm->lock);
+            pthread_rwlock_wrlock(&lsm->view);
+            memmove(lsm->runs + 1, lsm->runs, sizeof(Run*) * lsm->runCount);
+            lsm->runs[0] = run;
+            lsm->runCount++;
+            memmove(lsm->frozen, lsm->frozen + 1, sizeof(Memtable*) * (lsm->frozenCount - 1));
+            lsm->frozenCount--;
+            pthread_rwlock_unlock(&lsm->view);
+            lsm->flushes++;
+            lsm->entriesWritten += run->count;
+            pthread_mutex_unlock(&lsm->lock);
+            memtableFree(memtable);
+        } else {
+            // The runs are immutable and only this thread replaces them,
+            // so the merge can read them without the lock
+            Run* old[LSM_MAX_RUNS];
+            memcpy(old, lsm->runs + first, sizeof(Run*) * count);
+            bool oldest = first + count == lsm->runCount;
+            pthread_mutex_unlock(&lsm->lock);
+            Run* merged = mergeRuns(old, count, level, oldest);
+            if (first == 0) {
+                // No run newer than the merged one is left to shadow it
+                merged->filter.deleted = 0;
+                merged->compactNow = 0;
+            }
+            pthread_mutex_lock(&lsm->lock);
+            replaceRuns(lsm, first, count, merged);
+            lsm->compactions++;
+            lsm->entriesWritten += merged->count;
+            pthread_mutex_unlock(&lsm->lock);
+            for (int r = 0; r < count; r++) runFree(old[r]);
+        }
+
+        pthread_mutex_lock(&lsm->lock);
+        lsm->compactionNanos += nowNanos() - start;
+        lsm->busy = 0;
+        pthread_cond_broadcast(&lsm->progress);
+    }
+    pthread_mutex_unlock(&lsm->lock);
+    return NULL;
+}
+
+LsmTree* lsmOpen(CompactionPolicy policy, long memtableUpdates) {
+    LsmTree* lsm = (LsmTree*)calloc(1, sizeof(LsmTree));
+    if (lsm == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return NULL;
+    }
+    lsm->policy = policy;
+    lsm->memtableUpdates = memtableUpdates;
+    lsm->active = memtableCreate();
+    pthread_mutex_init(&lsm->lock, NULL);
+    pthread_cond_init(&lsm->work, NULL);
+    pthread_cond_init(&lsm->progress, NULL);
+    pthread_rwlock_init(&lsm->view, NULL);
+    if (pthread_create(&lsm->compactor, NULL, compactorMain, lsm) != 0) {
+        perror("Error starting compactor");
+        memtableFree(lsm->active);
+        free(lsm);
+        return NULL;
+    }
+    return lsm;
+}
+
+void lsmClose(LsmTree* lsm) {
+    pthread_mutex_lock(&lsm->lock);
+    lsm->stopping = 1;
+    pthread_cond_signal(&lsm->work);
+    pthread_mutex_unlock(&lsm->lock);
+    pthread_join(lsm->compactor, NULL);
+    memtableFree(lsm->active);
+    for (int i = 0; i < lsm->runCount; i++) runFree(lsm->runs[i]);
+    pthread_mutex_destroy(&lsm->lock);
+    pthread_cond_destroy(&lsm->work);
+    pthread_cond_destroy(&lsm->progress);
+    pthread_rwlock_destroy(&lsm->view);
+    free(lsm);
+}
+
+// Hand the active memtable to the compactor, waiting while the queue is
+// full, and start a new one
+void lsmFreeze(LsmTree* lsm) {
+    pthread_mutex_lock(&lsm->lock);
+    if (lsm->frozenCount == LSM_MAX_FROZEN) {
+        uint64_t start = nowNanos();
+        while (lsm->frozenCount == LSM_MAX_FROZEN) pthread_cond_wait(&lsm->progress, &lsm->lock);
+        lsm->stalls++;
+        lsm->stallNanos += nowNanos() - start;
+    }
+    pthread_rwlock_wrlock(&lsm->view);
+    lsm->frozen[lsm->frozenCount++] = lsm->active;
+    pthread_rwlock_unlock(&lsm->view);
+    pthread_cond_signal(&lsm->work);
+    pthread_mutex_unlock(&lsm->lock);
+    lsm->active = memtableCreate();
+}
+
+// Freeze the memtable and wait until every flush and merge due is done
+void lsmWaitIdle(LsmTree* lsm) {
+    if (lsm->active->updates > 0) lsmFreeze(lsm);
+    int first, count, level;
+    pthread_mutex_lock(&lsm->lock);
+    while (lsm->frozenCount > 0 || lsm->busy || pickCompaction(lsm, &first, &count, &level)) {
+        pthread_cond_signal(&lsm->work);
+        pthread_cond_wait(&lsm->progress, &lsm->lock);
+    }
+    pthread_mutex_unlock(&lsm->lock);
+}
+
+void lsmInsert(LsmTree* lsm, int key) {
+    memtablePut(lsm->active, key);
+    lsm->updates++;
+    if (lsm->active->updates >= lsm->memtableUpdates) lsmFreeze(lsm);
+}
+
+// 1 if the run holds key, 0 if it deletes it, -1 if it has no entry;
+// probes counts the binary searches the filter did not save
+int runFind(Run* run, int key, long* probes) {
+    if (!bloomFilterMayContain(&run->filter, key)) return -1;
+    (*probes)++;
+    long pos = runSeek(run, key);
+    if (pos < run->count && run->keys[pos] == key) return !run->deleted[pos];
+    bloomFilterFalsePositive(&run->filter);
+    return -1;
+}
+
+// Blind: the runs the tombstone shadows are charged when it is flushed
+void lsmDelete(LsmTree* lsm, int key) {
+    memtableDelete(lsm->active, key);
+    lsm->updates++;
+    if (lsm->active->updates >= lsm->memtableUpdates) lsmFreeze(lsm);
+}
+
+bool lsmContains(LsmTree* lsm, int key) {
+    lsm->lookups++;
+    int state = memtableFind(lsm->active, key);
+    if (state >= 0) return state;
+    pthread_rwlock_rdlock(&lsm->view);
+    for (int i = lsm->frozenCount - 1; i >= 0 && state < 0; i--) state = memtableFind(lsm->frozen[i], key);
+    for (int i = 0; i < lsm->runCount && state < 0; i++) state = runFind(lsm->runs[i], key, &lsm->runProbes);
+    pthread_rwlock_unlock(&lsm->view);
+    return state == 1;
+}
+
+void printLsmStats(LsmTree* lsm, bool perRun) {
+    pthread_mutex_lock(&lsm->lock);
+    long entries = 0, tombstones = 0;
+    size_t bytes = 0, filterBytes = 0;
+    for (int i = 0; i < lsm->runCount; i++) {
+        Run* run = lsm->runs[i];
+        entries += run->count;
+        tombstones += run->tombstoneCount;
+        bytes += allocationBytes(run->keys, sizeof(int) * run->count) + allocationBytes(run->deleted, run->count);
+        filterBytes += bloomFilterBytes(&run->filter);
+    }
+    printf("LSM (%s): memtable=%ld updates, frozen=%d, runs=%d, run entries=%ld (%ld tombstones), run bytes=%zu, filter bytes=%zu\n",
+           policyNames[lsm->policy], lsm->active->updates, lsm->frozenCount, lsm->runCount, entries, tombstones,
+           bytes, filterBytes);
+    printf("LSM: flushes=%ld, compactions=%ld, write amplification=%.2f, compactor time=%f seconds, "
+           "writer stalls=%ld (%f seconds), runs searched/lookup=%.2f\n",
+           lsm->flushes, lsm->compactions, lsm->updates ? (double)lsm->entriesWritten / lsm->updates : 0.0,
+           lsm->compactionNanos / 1e9, lsm->stalls, lsm->stallNanos / 1e9,
+           lsm->lookups ? (double)lsm->runProbes / lsm->lookups : 0.0);
+    for (int i = 0; perRun && i < lsm->runCount; i++) {
+        printf("Run %d: level %d, %ld entries\n", i, lsm->runs[i]->level, lsm->runs[i]->count);
+        printBloomFilterStats(&lsm->runs[i]->filter);
+    }
+    pthread_mutex_unlock(&lsm->lock);
+}
+
+// Wait for the compactor, merge everything into one ordered view and
+// write its live keys to a snapshot
+int lsmSaveSnapshot(LsmTree* lsm, const char* path) {
+    lsmWaitIdle(lsm);
+    pthread_rwlock_rdlock(&lsm->view);
+    Run* all = mergeRuns(lsm->runs, lsm->runCount, 0, true);
+    pthread_rwlock_unlock(&lsm->view);
+    SnapshotWriter* writer = snapshotBegin(path);
+    if (writer == NULL) {
+        runFree(all);
+        return -1;
+    }
+    for (long i = 0; i < all->count; i++) snapshotAppend(writer, all->keys[i]);
+    runFree(all);
+    return snapshotFinish(writer);
+}
+
+// Ingest count random keys under each policy and into a plain red-black
+// tree, then compare lookups that hit and miss, and a burst of deletes
+void benchmarkIngest(long count) {
+    int* keys = (int*)malloc(sizeof(int) * count);
+    if (keys == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return;
+    }
+    for (long i = 0; i < count; i++) keys[i] = (int)(((uint32_t)rand() << 16) ^ (uint32_t)rand()) & 0x7ffffffe;
+
+    printf("\nRandom ingest: %ld keys\n", count);
+    RedBlackTree* tree = initializeTree();
+    uint64_t start = nowNanos();
+    for (long i = 0; i < count; i++) insert(tree, keys[i]);
+    double treeInsertNanos = (double)(nowNanos() - start) / count;
+    long treeFound = 0;
+    start = nowNanos();
+    for (long i = 0; i < count; i++) treeFound += search(tree, tree->root, keys[(i * 7919) % count] | (int)(i & 1)) != tree->NIL;
+    double treeSearchNanos = (double)(nowNanos() - start) / count;
+    printf("Red-black tree: insert %.1f ns, search %.1f ns (half of them misses)\n", treeInsertNanos, treeSearchNanos);
+    destroyTree(tree);
+
+    for (int policy = COMPACTION_TIERED; policy <= COMPACTION_LEVELED; policy++) {
+        LsmTree* lsm = lsmOpen((CompactionPolicy)policy, LSM_MEMTABLE_UPDATES);
+        if (lsm == NULL) break;
+        printf("\nCompaction: %s\n", policyNames[policy]);
+        start = nowNanos();
+        for (long i = 0; i < count; i++) lsmInsert(lsm, keys[i]);
+        double insertNanos = (double)(nowNanos() - start) / count;
+        start = nowNanos();
+        lsmWaitIdle(lsm);
+        printf("Insert: %.1f ns (%.1fx the red-black tree), compactor caught up %f seconds later\n",
+               insertNanos, treeInsertNanos / insertNanos, (double)(nowNanos() - start) / 1e9);
+
+        // Odd keys are never inserted, so half of the probes miss
+        long found = 0;
+        start = nowNanos();
+        for (long i = 0; i < count; i++) found += lsmContains(lsm, keys[(i * 7919) % count] | (int)(i & 1));
+        printf("Search: %.1f ns%s\n", (double)(nowNanos() - start) / count,
+               found != treeFound ? " (lookup results differ)" : "");
+
+        start = nowNanos();
+        for (long i = 0; i < count; i += 2) lsmDelete(lsm, keys[i]);
+        double deleteNanos = (double)(nowNanos() - start) / ((count + 1) / 2);
+        lsmWaitIdle(lsm);
+        printf("Delete half: %.1f ns\n", deleteNanos);
+        printLsmStats(lsm, policy == COMPACTION_LEVELED);
+        lsmClose(lsm);
+    }
+    free(keys);
+}
+
+// Replay the file's operations on a scratch engine with a clock read around
+// each one, outside the windows the hardware counters cover
+void lsmRecordLatencies(FILE* file, LatencyHistogram latency[]) {
+    LsmTree* lsm = lsmOpen(COMPACTION_TIERED, 128);
+    if (lsm == NULL) return;
+    int number;
+    rewind(file);
+    while (fscanf(file, "%d,", &number) == 1) {
+        uint64_t opStart = nowNanos();
+        lsmInsert(lsm, number);
+        histogramRecord(&latency[OP_INSERT], nowNanos() - opStart);
+    }
+
+    uint64_t opStart = nowNanos();
+    lsmContains(lsm, 500);
+    histogramRecord(&latency[OP_SEARCH], nowNanos() - opStart);
+
+    opStart = nowNanos();
+    lsmDelete(lsm, 500);
+    histogramRecord(&latency[OP_DELETE], nowNanos() - opStart);
+    lsmClose(lsm);
+}
+
+void processFiles(const char* files[], int fileCount) {
+    PerfCounters counters;
+    perfOpen(&counters);
+    static LatencyHistogram latency[OP_TYPE_COUNT], totalLatency[OP_TYPE_COUNT];
+    for (int op = 0; op < OP_TYPE_COUNT; op++) histogramInit(&totalLatency[op]);
+
+    for (int i = 0; i < fileCount; i++) {
+        FILE* file = fopen(files[i], "r");
+        if (file == NULL) {
+            perror("Error opening file");
+            return;
+        }
+
+        printf("\nProcessing file: %s\n", files[i]);
+
+        int number, nodeCount = 0;
+        clock_t start, end;
+        // A small memtable, so the files produce a few runs
+        LsmTree* lsm = lsmOpen(COMPACTION_TIERED, 128);
+        if (lsm == NULL) {
+            fclose(file);
+            return;
+        }
+
+        for (int op = 0; op < OP_TYPE_COUNT; op++) histogramInit(&latency[op]);
+
+        // Insertion time
+        start = clock();
+        perfStart(&counters);
+        while (fscanf(file, "%d,", &number) == 1) {
+            lsmInsert(lsm, number);
+            nodeCount++;
+        }
+        perfStop(&counters);
+        end = clock();
+        printf("Insertion time for %d nodes: %f seconds\n", nodeCount, ((double)(end - start)) / CLOCKS_PER_SEC);
+        perfReport(&counters, "Insertion", nodeCount);
+        TreeStats stats = treeStats(lsm->active->live);
+        printTreeStats(&stats, NULL, 1);
+        printLsmStats(lsm, false);
+
+        // Search time for node with value 500
+        start = clock();
+        perfStart(&counters);
+        bool found = lsmContains(lsm, 500);
+        perfStop(&counters);
+        end = clock();
+        if (found) {
+            printf("Node with value 500 found.\n");
+        } else {
+            printf("Node with value 500 not found.\n");
+        }
+        printf("Search time for node with value 500: %f seconds\n", ((double)(end - start)) / CLOCKS_PER_SEC);
+        perfReport(&counters, "Search", 1);
+
+        // Deletion time for node with value 500
+        start = clock();
+        perfStart(&counters);
+        lsmDelete(lsm, 500);
+        perfStop(&counters);
+        end = clock();
+        printf("Deletion time for node with value 500: %f seconds\n", ((double)(end - start)) / CLOCKS_PER_SEC);
+        perfReport(&counters, "Deletion", 1);
+        printf("Node with value 500 %s after the delete.\n", lsmContains(lsm, 500) ? "still found" : "not found");
+
+        // Snapshot the merged view and serve the same lookups from the mapped image
+        char snapshotPath[256];
+        snprintf(snapshotPath, sizeof(snapshotPath), "%s.snap", files[i]);
+        start = clock();
+        int saved = lsmSaveSnapshot(lsm, snapshotPath);
+        end = clock();
+        printf("Snapshot write time: %f seconds\n", ((double)(end - start)) / CLOCKS_PER_SEC);
+        if (saved == 0) snapshotBenchmark(snapshotPath, 500, 250, 750);
+
+        lsmRecordLatencies(file, latency);
+        for (int op = 0; op < OP_TYPE_COUNT; op++) {
+            histogramPrint(&latency[op], opTypeNames[op]);
+            histogramMerge(&totalLatency[op], &latency[op]);
+        }
+
+        fclose(file);
+        lsmClose(lsm);
+    }
+
+    printf("\nLatency over all files:\n");
+    for (int op = 0; op < OP_TYPE_COUNT; op++) histogramPrint(&totalLatency[op], opTypeNames[op]);
+    perfClose(&counters);
+}
+
+int main() {
+    const char* files[] = {
+        "random_numbers.txt",
+        "mixed_numbers.txt",
+        "increasing_numbers.txt",
+        "decreasing_numbers.txt"
+    };
+
+    processFiles(files, 4);
+    srand(time(NULL));
+    benchmarkIngest(2000000);
+
+    return 0;
+}
@@ -0,0 +1,413 @@
+#ifndef NODE_POOL_H
+#define NODE_POOL_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+
+// Arena of fixed-size tree nodes and the compaction that fills it.
+//
+// After long insert/delete churn a pointer tree's nodes sit wherever malloc
+// had room, so every level of a descent is a fresh cache line and often a
+// fresh page. Compaction copies the live nodes into a new pool in DFS or
+// BFS order, rewriting the child (and parent) pointers as it goes. The top
+// of the tree then shares a handful of lines and pages, and the children
+// of a node are always allocated together, so they share a line as well.
+//
+// A pool only hands out slots from its end and never reuses them: nodes
+// deleted after compaction are counted, and new nodes still come from
+// malloc, until the next compaction moves everything into a fresh pool and
+// drops the old one once its last live node has left. Trees keep their
+// pools in a NodePoolSet, so freeing a node just asks the set whether it
+// owns it.
+//
+// Compaction can run all at once or incrementally, examining a bounded
+// number of nodes per call between ordinary updates. Its work list holds
+// already-moved nodes, never pointers into the tree, so updates in between
+// cannot invalidate it; a pass during which the tree changed may have
+// missed a node that a rotation moved under a visited one, so passes
+// repeat until one runs over an unchanged tree.
+//
+// A pool can ask for 2 MB pages, so a descent through a big tree costs one
+// dTLB entry per 2 MB of nodes instead of one per 4 KB. It first tries
+// transparent huge pages, mapping a 2 MB aligned range and marking it with
+// madvise(MADV_HUGEPAGE); if the kernel has them switched off it maps the
+// pool from the hugetlbfs reserve with MAP_HUGETLB, and if that has no
+// pages either it settles for ordinary ones. The pool records what it got.
+#define NODE_POOL_MAX 8
+#define NODE_POOL_PAGE 4096
+#define NODE_POOL_HUGE_PAGE (2UL << 20)
+
+typedef enum { POOL_PAGES_SMALL, POOL_PAGES_TRANSPARENT, POOL_PAGES_HUGETLB } PoolPages;
+
+static const char* poolPageNames[] = { "4 KB pages", "transparent huge pages", "hugetlbfs pages" };
+
+typedef struct NodePool {
+    char* base;
+    size_t nodeSize;
+    long capacity;
+    long used;           // Slots handed out
+    long released;       // Slots whose node has since been freed
+    uint64_t* live;      // One bit per handed-out slot
+    size_t mappedBytes;
+    PoolPages pages;
+} NodePool;
+
+typedef struct NodePoolSet {
+    NodePool* pools[NODE_POOL_MAX];
+    int count;
+    int hugePages;       // New pools ask for 2 MB pages
+} NodePoolSet;
+
+// Whether madvise(MADV_HUGEPAGE) has any effect: the kernel's mode is
+// "always" or "madvise", not "never"
+static int transparentHugePagesEnabled(void) {
+    FILE* file = fopen("/sys/kernel/mm/transparent_hugepage/enabled", "r");
+    if (file == NULL) return 0;
+    char mode[128];
+    int enabled = fgets(mode, sizeof(mode), file) != NULL && strstr(mode, "[never]") == NULL;
+    fclose(file);
+    return enabled;
+}
+
+// Map the pool's bytes, on 2 MB pages when hugePages is set and the kernel
+// has some to give
+static void nodePoolMap(NodePool* pool, size_t bytes, int hugePages) {
+    size_t hugeBytes = (bytes + NODE_POOL_HUGE_PAGE - 1) / NODE_POOL_HUGE_PAGE * NODE_POOL_HUGE_PAGE;
+#ifdef MADV_HUGEPAGE
+    if (hugePages && transparentHugePagesEnabled()) {
+        // Over-map by a page so the range can start on a 2 MB boundary
+        char* raw = (char*)mmap(NULL, hugeBytes + NODE_POOL_HUGE_PAGE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (raw != MAP_FAILED) {
+            char* aligned = (char*)(((uintptr_t)raw + NODE_POOL_HUGE_PAGE - 1) & ~(uintptr_t)(NODE_POOL_HUGE_PAGE - 1));
+            if (aligned > raw) munmap(raw, aligned - raw);
+            munmap(aligned + hugeBytes, raw + NODE_POOL_HUGE_PAGE - aligned);
+            if (madvise(aligned, hugeBytes, MADV_HUGEPAGE) == 0) {
+                pool->base = aligned;
+                pool->mappedBytes = hugeBytes;
+                pool->pages = POOL_PAGES_TRANSPARENT;
+                return;
+            }
+            munmap(aligned, hugeBytes);
+        }
+    }
+#endif
+#ifdef MAP_HUGETLB
+    if (hugePages) {
+        pool->base = (char*)mmap(NULL, hugeBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (pool->base != MAP_FAILED) {
+            pool->mappedBytes = hugeBytes;
+            pool->pages = POOL_PAGES_HUGETLB;
+            return;
+        }
+    }
+#endif
+    pool->mappedBytes = (bytes + NODE_POOL_PAGE - 1) / NODE_POOL_PAGE * NODE_POOL_PAGE;
+    pool->base = (char*)mmap(NULL, pool->mappedBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    pool->pages = POOL_PAGES_SMALL;
+}
+
+// Reserve room for capacity nodes. The mapping is only address space until
+// the slots are touched, so callers can reserve generously.
+static NodePool* nodePoolCreate(size_t nodeSize, long capacity, int hugePages) {
+    NodePool* pool = (NodePool*)calloc(1, sizeof(NodePool));
+    if (pool == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return NULL;
+    }
+    pool->nodeSize = (nodeSize + 7) & ~(size_t)7;
+    pool->capacity = capacity > 0 ? capacity : 1;
+    nodePoolMap(pool, pool->nodeSize * pool->capacity, hugePages);
+    pool->live = (uint64_t*)calloc((pool->capacity + 63) / 64, sizeof(uint64_t));
+    if (pool->base == MAP_FAILED || pool->live == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        if (pool->base != MAP_FAILED) munmap(pool->base, pool->mappedBytes);
+        free(pool->live);
+        free(pool);
+        return NULL;
+    }
+    return pool;
+}
+
+static void nodePoolDestroy(NodePool* pool) {
+    munmap(pool->base, pool->mappedBytes);
+    free(pool->live);
+    free(pool);
+}
+
+// Next free slot, or NULL once the pool is full
+static void* nodePoolAlloc(NodePool* pool) {
+    if (pool->used == pool->capacity) return NULL;
+    long slot = pool->used++;
+    pool->live[slot / 64] |= 1ULL << (slot % 64);
+    return pool->base + slot * pool->nodeSize;
+}
+
+static int nodePoolOwns(const NodePool* pool, const void* node) {
+    const char* p = (const char*)node;
+    return p >= pool->base && p < pool->base + pool->used * pool->nodeSize;
+}
+
+static int nodePoolIsLive(const NodePool* pool, const void* node) {
+    long slot = (long)(((const char*)node - pool->base) / pool->nodeSize);
+    return (pool->live[slot / 64] >> (slot % 64)) & 1;
+}
+
+static void nodePoolRelease(NodePool* pool, void* node) {
+    long slot = (long)(((char*)node - pool->base) / pool->nodeSize);
+    pool->live[slot / 64] &= ~(1ULL << (slot % 64));
+    pool->released++;
+}
+
+static long nodePoolLiveNodes(const NodePool* pool) {
+    return pool->used - pool->released;
+}
+
+// Pool of set holding node, or NULL when the node came from malloc
+static NodePool* nodePoolSetFind(const NodePoolSet* set, const void* node) {
+    for (int i = 0; i < set->count; i++) {
+        if (nodePoolOwns(set->pools[i], node)) return set->pools[i];
+    }
+    return NULL;
+}
+
+// Count node as freed if one of the pools holds it; returns 0 when it came
+// from malloc and the caller has to free it
+static int nodePoolSetRelease(NodePoolSet* set, void* node) {
+    NodePool* pool = nodePoolSetFind(set, node);
+    if (pool == NULL) return 0;
+    nodePoolRelease(pool, node);
+    return 1;
+}
+
+// Drop the pools, other than keep, that have no live node left
+static void nodePoolSetTrim(NodePoolSet* set, const NodePool* keep) {
+    int kept = 0;
+    for (int i = 0; i < set->count; i++) {
+        if (set->pools[i] != keep && nodePoolLiveNodes(set->pools[i]) == 0) {
+            nodePoolDestroy(set->pools[i]);
+        } else {
+            set->pools[kept++] = set->pools[i];
+        }
+    }
+    set->count = kept;
+}
+
+static void nodePoolSetDestroy(NodePoolSet* set) {
+    for (int i = 0; i < set->count; i++) nodePoolDestroy(set->pools[i]);
+    set->count = 0;
+}
+
+// Bytes of the pools' slots in use, moved-out and freed ones included
+static size_t nodePoolSetBytes(const NodePoolSet* set) {
+    size_t bytes = 0;
+    for (int i = 0; i < set->count; i++) bytes += set->pools[i]->used * set->pools[i]->nodeSize;
+    return bytes;
+}
+
+// Bytes the pools hold besides their live nodes: the slots of nodes freed
+// or moved out since, the live bitmaps and the pool headers
+static size_t nodePoolSetOverhead(const NodePoolSet* set) {
+    size_t bytes = 0;
+    for (int i = 0; i < set->count; i++) {
+        const NodePool* pool = set->pools[i];
+        bytes += pool->released * pool->nodeSize + (pool->capacity + 63) / 64 * sizeof(uint64_t) + sizeof(NodePool);
+    }
+    return bytes;
+}
+
+typedef enum { COMPACT_DFS, COMPACT_BFS } CompactOrder;
+
+static const char* compactOrderNames[] = { "DFS", "BFS" };
+
+// Where a node type keeps its links. parent is -1 for trees without parent
+// pointers; nil is what an empty child points at (NULL or a sentinel).
+// release frees a node that has been copied out, and moved, when set,
+// lets the tree fix up anything else that points at nodes.
+typedef struct NodeLinks {
+    size_t size;
+    size_t left, right;
+    long parent;
+    const void* nil;
+    void (*release)(void* node, void* context);
+    void (*moved)(void* from, void* to, void* context);
+    void* context;
+} NodeLinks;
+
+typedef struct Compaction {
+    NodeLinks links;
+    CompactOrder order;
+    NodePool* target;
+    void** pending;         // Moved nodes whose children are still to be looked at
+    long head, tail, pendingCapacity;
+    long passModCount;      // The tree's modification count when the pass started
+    long moved, visited, passes;
+    int active;
+    int full;               // The target ran out of room; the rest stays put
+} Compaction;
+
+static void* compactionLoad(const void* slot) {
+    void* pointer;
+    memcpy(&pointer, slot, sizeof(pointer));
+    return pointer;
+}
+
+static void compactionStore(void* slot, void* pointer) {
+    memcpy(slot, &pointer, sizeof(pointer));
+}
+
+static int compactionPush(Compaction* c, void* node) {
+    if (c->tail == c->pendingCapacity) {
+        long capacity = c->pendingCapacity ? 2 * c->pendingCapacity : 1024;
+        void** pending = (void**)realloc(c->pending, sizeof(void*) * capacity);
+        if (pending == NULL) {
+            fprintf(stderr, "Memory allocation failed\n");
+            return -1;
+        }
+        c->pending = pending;
+        c->pendingCapacity = capacity;
+    }
+    c->pending[c->tail++] = node;
+    return 0;
+}
+
+// Copy the node that slot points at into the target and point slot, its
+// children's parent links and the tree's other references at the copy.
+// Returns the copy, or NULL when the target is full.
+static void* compactionMove(Compaction* c, void* slot) {
+    const NodeLinks* links = &c->links;
+    void* node = compactionLoad(slot);
+    void* copy = nodePoolAlloc(c->target);
+    if (copy == NULL) {
+        c->full = 1;
+        return NULL;
+    }
+    memcpy(copy, node, links->size);
+    compactionStore(slot, copy);
+    if (links->parent >= 0) {
+        void* left = compactionLoad((char*)copy + links->left);
+        void* right = compactionLoad((char*)copy + links->right);
+        if (left != links->nil) compactionStore((char*)left + links->parent, copy);
+        if (right != links->nil) compactionStore((char*)right + links->parent, copy);
+    }
+    if (links->moved) links->moved(node, copy, links->context);
+    links->release(node, links->context);
+    c->moved++;
+    return copy;
+}
+
+// Start moving a tree of about nodes nodes into a fresh pool, which joins
+// set. Returns -1 if the set is full or the pool cannot be mapped.
+static int compactionBegin(Compaction* c, NodePoolSet* set, const NodeLinks* links, CompactOrder order, long nodes) {
+    if (c->active || set->count == NODE_POOL_MAX) return -1;
+    // Room for the tree to double while an incremental compaction runs
+    NodePool* target = nodePoolCreate(links->size, 2 * nodes + 1024, set->hugePages);
+    if (target == NULL) return -1;
+    set->pools[set->count++] = target;
+    c->links = *links;
+    c->order = order;
+    c->target = target;
+    c->head = c->tail = 0;
+    c->moved = c->visited = c->passes = 0;
+    c->full = 0;
+    c->active = 1;
+    return 0;
+}
+
+// Examine up to budget nodes of the tree whose root pointer is at rootSlot.
+// modCount is the tree's count of structural changes. Returns 1 once the
+// compaction is done, when older pools left empty have been dropped.
+static int compactionStep(Compaction* c, NodePoolSet* set, void* rootSlot, long modCount, long budget) {
+    const NodeLinks* links = &c->links;
+    while (budget-- > 0) {
+        if (c->head == c->tail) {
+            // A pass over an unchanged tree reached every node
+            if ((c->passes > 0 && modCount == c->passModCount) || c->full) {
+                free(c->pending);
+                c->pending = NULL;
+                c->pendingCapacity = 0;
+                c->active = 0;
+                nodePoolSetTrim(set, c->target);
+                return 1;
+            }
+            c->passes++;
+            c->passModCount = modCount;
+            c->head = c->tail = 0;
+            void* root = compactionLoad(rootSlot);
+            if (root == links->nil) continue;
+            if (!nodePoolOwns(c->target, root) && (root = compactionMove(c, rootSlot)) == NULL) continue;
+            if (compactionPush(c, root) != 0) c->full = 1;
+            continue;
+        }
+
+        void* node = c->order == COMPACT_BFS ? c->pending[c->head++] : c->pending[--c->tail];
+        c->visited++;
+        if (!nodePoolIsLive(c->target, node)) continue;  // Deleted since it was moved
+
+        // Move both children before descending, so siblings sit side by side
+        void* children[2];
+        size_t fields[2] = { links->left, links->right };
+        for (int i = 0; i < 2; i++) {
+            void* slot = (char*)node + fields[i];
+            children[i] = compactionLoad(slot);
+            if (children[i] == links->nil) {
+                children[i] = NULL;
+            } else if (!nodePoolOwns(c->target, children[i])) {
+                children[i] = compactionMove(c, slot);
+            }
+        }
+        // The stack pops the left child first; the queue keeps level order
+        int first = c->order == COMPACT_BFS ? 0 : 1;
+        for (int i = 0; i < 2; i++) {
+            void* child = children[first ^ i];
+            if (child != NULL && compactionPush(c, child) != 0) c->full = 1;
+        }
+    }
+    return 0;
+}
+
+// Abandon a running compaction, if any; the nodes moved so far stay in
+// its pool
+static void compactionCancel(Compaction* c) {
+    free(c->pending);
+    c->pending = NULL;
+    c->pendingCapacity = 0;
+    c->active = 0;
+}
+
+// Bytes of the pool the kernel has backed with huge pages so far: all of
+// them for hugetlbfs, what /proc/self/smaps reports for transparent ones
+static size_t nodePoolHugeBytes(const NodePool* pool) {
+    if (pool->pages != POOL_PAGES_TRANSPARENT) return pool->pages == POOL_PAGES_HUGETLB ? pool->mappedBytes : 0;
+    FILE* file = fopen("/proc/self/smaps", "r");
+    if (file == NULL) return 0;
+    char line[256];
+    int inPool = 0;
+    size_t kilobytes = 0;
+    while (fgets(line, sizeof(line), file) != NULL) {
+        unsigned long start, end, value;
+        if (sscanf(line, "%lx-%lx ", &start, &end) == 2) {
+            // Mapping header: "start-end perms offset dev inode path"
+            inPool = (char*)start >= pool->base && (char*)end <= pool->base + pool->mappedBytes;
+        } else if (inPool && sscanf(line, "AnonHugePages: %lu kB", &value) == 1) {
+            kilobytes += value;
+        }
+    }
+    fclose(file);
+    return kilobytes * 1024;
+}
+
+static void printCompactionStats(const Compaction* c, const NodePoolSet* set) {
+    printf("Compaction (%s): moved=%ld, visited=%ld, passes=%ld%s, pools=%d, pool bytes=%zu",
+           compactOrderNames[c->order], c->moved, c->visited, c->passes, c->full ? ", target full" : "",
+           set->count, nodePoolSetBytes(set));
+    if (c->target != NULL) {
+        printf(", target on %s (%.1f MB of them huge)", poolPageNames[c->target->pages],
+               nodePoolHugeBytes(c->target) / 1048576.0);
+    }
+    printf("\n");
+}
+
+#endif
@@ -0,0 +1,50 @@
+#ifndef OP_COUNTERS_H
+#define OP_COUNTERS_H
+
+#include <stdio.h>
+#include <string.h>
+
+// Structural work done by a tree, accumulated per tree instance.
+// The COUNT_OP macros compile to nothing unless built with -DOP_COUNTERS,
+// so the default benchmark pays nothing for the hooks.
+typedef struct OpCounters {
+    long comparisons;  // Key comparisons against a node
+    long rotations;    // Single rotations (a double rotation counts as two)
+    long recolors;     // Red-black color changes
+    long fixups;       // Iterations of an insert/delete fixup loop
+    long splits;       // Multiway node splits
+    long merges;       // Multiway node merges
+    long borrows;      // Multiway key transfers between siblings
+} OpCounters;
+
+#ifdef OP_COUNTERS
+#define COUNT_OP(counters, field) ((counters).field++)
+#define COUNT_OPS(counters, field, n) ((counters).field += (n))
+#else
+#define COUNT_OP(counters, field) ((void)0)
+#define COUNT_OPS(counters, field, n) ((void)0)
+#endif
+
+static void resetOpCounters(OpCounters* counters) {
+    memset(counters, 0, sizeof(*counters));
+}
+
+// Print the counters accumulated since the last reset, per operation
+static void printOpCounters(const char* phase, const OpCounters* counters, long ops) {
+#ifdef OP_COUNTERS
+    if (ops <= 0) ops = 1;
+    printf("%s structural work per operation: comparisons=%.2f, rotations=%.2f, recolors=%.2f, "
+           "fixups=%.2f, splits=%.2f, merges=%.2f, borrows=%.2f\n",
+           phase,
+           (double)counters->comparisons / ops, (double)counters->rotations / ops,
+           (double)counters->recolors / ops, (double)counters->fixups / ops,
+           (double)counters->splits / ops, (double)counters->merges / ops,
+           (double)counters->borrows / ops);
+#else
+    (void)phase;
+    (void)counters;
+    (void)ops;
+#endif
+}
+
+#endif
@@ -0,0 +1,163 @@
+#ifndef PERF_COUNTERS_H
+#define PERF_COUNTERS_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+// Hardware events sampled around each benchmark phase
+typedef enum {
+    PERF_CYCLES,
+    PERF_INSTRUCTIONS,
+    PERF_L1D_MISSES,
+    PERF_LLC_MISSES,
+    PERF_DTLB_MISSES,
+    PERF_BRANCH_MISSES,
+    PERF_EVENT_COUNT
+} PerfEvent;
+
+static const char* perfEventNames[PERF_EVENT_COUNT] = {
+    "cycles", "instructions", "L1d misses", "LLC misses", "dTLB misses", "branch misses"
+};
+
+// One file descriptor per event; fd is -1 when the event could not be opened
+typedef struct PerfCounters {
+    int fd[PERF_EVENT_COUNT];
+    double value[PERF_EVENT_COUNT];
+    int available;  // Number of events that opened successfully
+} PerfCounters;
+
+#ifdef __linux__
+static int perfOpenEvent(uint32_t type, uint64_t config) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static uint64_t perfCacheConfig(uint64_t cache, uint64_t op, uint64_t result) {
+    return cache | (op << 8) | (result << 16);
+}
+#endif
+
+// Open all counters for the calling thread. Events the kernel or the
+// hardware refuses are skipped, so the benchmark still runs in containers
+// and VMs without a PMU; the report then prints "n/a" for them.
+static void perfOpen(PerfCounters* pc) {
+    memset(pc, 0, sizeof(*pc));
+    for (int i = 0; i < PERF_EVENT_COUNT; i++) pc->fd[i] = -1;
+
+#ifdef __linux__
+    pc->fd[PERF_CYCLES] = perfOpenEvent(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+    pc->fd[PERF_INSTRUCTIONS] = perfOpenEvent(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+    pc->fd[PERF_L1D_MISSES] = perfOpenEvent(PERF_TYPE_HW_CACHE,
+        perfCacheConfig(PERF_COUNT_HW_CACHE_L1D, PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS));
+    pc->fd[PERF_LLC_MISSES] = perfOpenEvent(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+    pc->fd[PERF_DTLB_MISSES] = perfOpenEvent(PERF_TYPE_HW_CACHE,
+        perfCacheConfig(PERF_COUNT_HW_CACHE_DTLB, PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS));
+    pc->fd[PERF_BRANCH_MISSES] = perfOpenEvent(PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES);
+
+    for (int i = 0; i < PERF_EVENT_COUNT; i++) {
+        if (pc->fd[i] >= 0) pc->available++;
+    }
+    if (pc->available == 0) {
+        printf("Hardware counters unavailable (%s), reporting wall time only.\n", strerror(errno));
+    }
+#else
+    printf("Hardware counters unavailable on this platform, reporting wall time only.\n");
+#endif
+}
+
+static void perfClose(PerfCounters* pc) {
+#ifdef __linux__
+    for (int i = 0; i < PERF_EVENT_COUNT; i++) {
+        if (pc->fd[i] >= 0) close(pc->fd[i]);
+        pc->fd[i] = -1;
+    }
+#endif
+    pc->available = 0;
+}
+
+static void perfStart(PerfCounters* pc) {
+#ifdef __linux__
+    for (int i = 0; i < PERF_EVENT_COUNT; i++) {
+        if (pc->fd[i] < 0) continue;
+        ioctl(pc->fd[i], PERF_EVENT_IOC_RESET, 0);
+        ioctl(pc->fd[i], PERF_EVENT_IOC_ENABLE, 0);
+    }
+#endif
+}
+
+// Stop counting and read the values, scaling for multiplexing when the
+// kernel had to time-share the PMU between more events than it has slots
+static void perfStop(PerfCounters* pc) {
+#ifdef __linux__
+    for (int i = 0; i < PERF_EVENT_COUNT; i++) {
+        if (pc->fd[i] >= 0) ioctl(pc->fd[i], PERF_EVENT_IOC_DISABLE, 0);
+    }
+    for (int i = 0; i < PERF_EVENT_COUNT; i++) {
+        uint64_t data[3];  // value, time enabled, time running
+        pc->value[i] = 0;
+        if (pc->fd[i] < 0 || read(pc->fd[i], data, sizeof(data)) != sizeof(data)) continue;
+        if (data[2] == 0) continue;
+        pc->value[i] = (double)data[0] * ((double)data[1] / (double)data[2]);
+    }
+#endif
+}
+
+// Print the counters of the last start/stop window divided by the number of
+// operations it covered
+static void perfReport(const PerfCounters* pc, const char* phase, long ops) {
+    if (pc->available == 0) return;
+    if (ops <= 0) ops = 1;
+
+    printf("%s per operation:", phase);
+    for (int i = 0; i < PERF_EVENT_COUNT; i++) {
+        if (pc->fd[i] < 0) {
+            printf(" %s=n/a", perfEventNames[i]);
+        } else {
+            printf(" %s=%.2f", perfEventNames[i], pc->value[i] / ops);
+        }
+        printf(i + 1 < PERF_EVENT_COUNT ? "," : "\n");
+    }
+}
+
+// dTLB misses of the last window as a share of the memory accesses it made,
+// or -1 when the counter could not be opened. Printed as a rate so phases
+// that touch different numbers of nodes can be compared.
+static inline double perfDtlbMissRate(const PerfCounters* pc, const char* phase, double accesses) {
+    if (pc->fd[PERF_DTLB_MISSES] < 0 || accesses <= 0) {
+        printf("%s dTLB miss rate: unavailable\n", phase);
+        return -1;
+    }
+    double rate = pc->value[PERF_DTLB_MISSES] / accesses;
+    printf("%s dTLB miss rate: %.2f%% of %.0f accesses\n", phase, 100.0 * rate, accesses);
+    return rate;
+}
+
+// Line up the rates perfDtlbMissRate returned for the same searches over
+// nodes on 4 KB pages and on huge pages
+static inline void perfCompareDtlbRates(double smallPages, double hugePages) {
+    if (smallPages < 0 || hugePages < 0) {
+        printf("dTLB miss rate with and without huge pages: unavailable\n");
+        return;
+    }
+    printf("dTLB miss rate without huge pages: %.2f%%, with huge pages: %.2f%%\n",
+           100.0 * smallPages, 100.0 * hugePages);
+}
+
+#endif
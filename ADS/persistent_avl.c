@@ -0,0 +1,415 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// AVL tree whose node pool lives inside a memory-mapped file. Nodes refer
+// to each other by slot number instead of by address, so the file can be
+// mapped anywhere, grown with mremap, and reopened after a restart with no
+// rebuild and no pointer fix-ups. Build with -DPAVL_WIDE_REFS for 64-bit
+// slot numbers when a pool may exceed 2^32 nodes.
+//
+// Updates write the nodes and the header in place, and nothing orders
+// those stores on their way to the file, so the file is only consistent
+// after a clean closeTree (or a syncTree with no update in between). A
+// crash in the middle of an update can leave a torn tree; openTree checks
+// the header but cannot vouch for every node.
+#ifdef PAVL_WIDE_REFS
+typedef uint64_t NodeRef;
+#else
+typedef uint32_t NodeRef;
+#endif
+
+#define NULL_REF 0
+#define PAVL_MAGIC "ADSPAVL1"
+#define PAVL_VERSION 1
+#define INITIAL_CAPACITY 1024
+
+typedef struct Node {
+    int32_t data;
+    int32_t height;
+    NodeRef left, right;
+} Node;
+
+// Lives in the first slots of the file; slot 0 doubles as NULL_REF
+typedef struct PoolHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t nodeSize;
+    uint64_t capacity;   // Slots the file has room for
+    uint64_t used;       // Slots handed out so far, header included
+    uint64_t count;      // Keys in the tree
+    NodeRef root;
+    NodeRef freeList;    // Released slots, chained through left
+} PoolHeader;
+
+#define HEADER_SLOTS ((sizeof(PoolHeader) + sizeof(Node) - 1) / sizeof(Node))
+
+typedef struct PersistentTree {
+    int fd;
+    char* base;
+    size_t mapSize;
+} PersistentTree;
+
+// Address of a slot. Only valid until the next allocation, which may move
+// the mapping, so code re-derives it instead of keeping Node* around.
+#define NODE(tree, ref) ((Node*)(tree)->base + (ref))
+#define HEADER(tree) ((PoolHeader*)(tree)->base)
+
+int max(int a, int b) {
+    return a > b ? a : b;
+}
+
+// Map (creating if needed) the pool file at path
+PersistentTree* openTree(const char* path) {
+    int fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        perror("Error opening tree file");
+        return NULL;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        perror("Error reading tree file");
+        close(fd);
+        return NULL;
+    }
+
+    int fresh = st.st_size == 0;
+    size_t size = (size_t)st.st_size;
+    if (fresh) {
+        size = (HEADER_SLOTS + INITIAL_CAPACITY) * sizeof(Node);
+        if (ftruncate(fd, (off_t)size) != 0) {
+            perror("Error sizing tree file");
+            close(fd);
+            return NULL;
+        }
+    } else if (size < sizeof(PoolHeader)) {
+        fprintf(stderr, "Tree file %s is truncated\n", path);
+        close(fd);
+        return NULL;
+    }
+
+    char* base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED) {
+        perror("Error mapping tree file");
+        close(fd);
+        return NULL;
+    }
+
+    PoolHeader* header = (PoolHeader*)base;
+    if (fresh) {
+        memcpy(header->magic, PAVL_MAGIC, sizeof(header->magic));
+        header->version = PAVL_VERSION;
+        header->nodeSize = sizeof(Node);
+        header->capacity = size / sizeof(Node);
+        header->used = HEADER_SLOTS;
+        header->count = 0;
+        header->root = NULL_REF;
+        header->freeList = NULL_REF;
+    } else if (memcmp(header->magic, PAVL_MAGIC, sizeof(header->magic)) != 0
+               || header->version != PAVL_VERSION
+               || header->nodeSize != sizeof(Node)
+               || header->capacity * sizeof(Node) > size
+               || header->used > header->capacity
+               || header->used < HEADER_SLOTS
+               || header->root >= header->used
+               || header->freeList >= header->used
+               || (header->root != NULL_REF && header->root < HEADER_SLOTS)
+               || (header->freeList != NULL_REF && header->freeList < HEADER_SLOTS)) {
+        fprintf(stderr, "Tree file %s is not a valid pool\n", path);
+        munmap(base, size);
+        close(fd);
+        return NULL;
+    }
+
+    PersistentTree* tree = (PersistentTree*)malloc(sizeof(PersistentTree));
+    if (tree == NULL) {
+        munmap(base, size);
+        close(fd);
+        return NULL;
+    }
+    tree->fd = fd;
+    tree->base = base;
+    tree->mapSize = size;
+    return tree;
+}
+
+// Flush dirty pages of the pool to the file
+int syncTree(PersistentTree* tree) {
+    if (msync(tree->base, tree->mapSize, MS_SYNC) != 0) {
+        perror("Error syncing tree file");
+        return -1;
+    }
+    return 0;
+}
+
+int closeTree(PersistentTree* tree) {
+    int result = syncTree(tree);
+    munmap(tree->base, tree->mapSize);
+    close(tree->fd);
+    free(tree);
+    return result;
+}
+
+// Double the file and the mapping. The mapping may move; slot numbers stay
+// valid. Returns -1 if either step fails, with the old mapping and the
+// header untouched, so the tree is still usable at its current capacity.
+int growPool(PersistentTree* tree) {
+    size_t newSize = tree->mapSize * 2;
+    if (ftruncate(tree->fd, (off_t)newSize) != 0) {
+        perror("Error growing tree file");
+        return -1;
+    }
+#ifdef MREMAP_MAYMOVE
+    char* base = mremap(tree->base, tree->mapSize, newSize, MREMAP_MAYMOVE);
+#else
+    char* base = mmap(NULL, newSize, PROT_READ | PROT_WRITE, MAP_SHARED, tree->fd, 0);
+    if (base != MAP_FAILED) munmap(tree->base, tree->mapSize);
+#endif
+    if (base == MAP_FAILED) {
+        perror("Error remapping tree file");
+        return -1;
+    }
+    tree->base = base;
+    tree->mapSize = newSize;
+    HEADER(tree)->capacity = newSize / sizeof(Node);
+    return 0;
+}
+
+// Take a free slot; the caller has made sure there is one
+NodeRef createNode(PersistentTree* tree, int data) {
+    PoolHeader* header = HEADER(tree);
+    NodeRef ref = header->freeList;
+    if (ref != NULL_REF) {
+        header->freeList = NODE(tree, ref)->left;
+    } else {
+        ref = (NodeRef)header->used++;
+    }
+
+    Node* node = NODE(tree, ref);
+    node->data = data;
+    node->height = 1;
+    node->left = NULL_REF;
+    node->right = NULL_REF;
+    return ref;
+}
+
+void freeNode(PersistentTree* tree, NodeRef ref) {
+    NODE(tree, ref)->left = HEADER(tree)->freeList;
+    HEADER(tree)->freeList = ref;
+}
+
+int height(PersistentTree* tree, NodeRef ref) {
+    if (ref == NULL_REF) return 0;
+    return NODE(tree, ref)->height;
+}
+
+void updateHeight(PersistentTree* tree, NodeRef ref) {
+    Node* node = NODE(tree, ref);
+    node->height = 1 + max(height(tree, node->left), height(tree, node->right));
+}
+
+int getBalance(PersistentTree* tree, NodeRef ref) {
+    if (ref == NULL_REF) return 0;
+    return height(tree, NODE(tree, ref)->left) - height(tree, NODE(tree, ref)->right);
+}
+
+NodeRef rightRotate(PersistentTree* tree, NodeRef y) {
+    NodeRef x = NODE(tree, y)->left;
+    NodeRef T2 = NODE(tree, x)->right;
+
+    NODE(tree, x)->right = y;
+    NODE(tree, y)->left = T2;
+
+    updateHeight(tree, y);
+    updateHeight(tree, x);
+    return x;
+}
+
+NodeRef leftRotate(PersistentTree* tree, NodeRef x) {
+    NodeRef y = NODE(tree, x)->right;
+    NodeRef T2 = NODE(tree, y)->left;
+
+    NODE(tree, y)->left = x;
+    NODE(tree, x)->right = T2;
+
+    updateHeight(tree, x);
+    updateHeight(tree, y);
+    return y;
+}
+
+NodeRef rebalance(PersistentTree* tree, NodeRef ref) {
+    updateHeight(tree, ref);
+    int balance = getBalance(tree, ref);
+
+    if (balance > 1) {
+        if (getBalance(tree, NODE(tree, ref)->left) < 0)
+            NODE(tree, ref)->left = leftRotate(tree, NODE(tree, ref)->left);
+        return rightRotate(tree, ref);
+    }
+    if (balance < -1) {
+        if (getBalance(tree, NODE(tree, ref)->right) > 0)
+            NODE(tree, ref)->right = rightRotate(tree, NODE(tree, ref)->right);
+        return leftRotate(tree, ref);
+    }
+    return ref;
+}
+
+NodeRef insertNode(PersistentTree* tree, NodeRef ref, int data) {
+    if (ref == NULL_REF) {
+        HEADER(tree)->count++;
+        return createNode(tree, data);
+    }
+
+    NodeRef child;
+    if (data < NODE(tree, ref)->data) {
+        child = insertNode(tree, NODE(tree, ref)->left, data);
+        NODE(tree, ref)->left = child;
+    } else if (data > NODE(tree, ref)->data) {
+        child = insertNode(tree, NODE(tree, ref)->right, data);
+        NODE(tree, ref)->right = child;
+    } else {
+        return ref;
+    }
+
+    return rebalance(tree, ref);
+}
+
+NodeRef minValueNode(PersistentTree* tree, NodeRef ref) {
+    while (NODE(tree, ref)->left != NULL_REF)
+        ref = NODE(tree, ref)->left;
+    return ref;
+}
+
+NodeRef deleteNode(PersistentTree* tree, NodeRef ref, int data) {
+    if (ref == NULL_REF) return ref;
+
+    Node* node = NODE(tree, ref);
+    if (data < node->data) {
+        node->left = deleteNode(tree, node->left, data);
+    } else if (data > node->data) {
+        node->right = deleteNode(tree, node->right, data);
+    } else if (node->left == NULL_REF || node->right == NULL_REF) {
+        NodeRef child = node->left != NULL_REF ? node->left : node->right;
+        freeNode(tree, ref);
+        HEADER(tree)->count--;
+        return child;
+    } else {
+        NodeRef successor = minValueNode(tree, node->right);
+        node->data = NODE(tree, successor)->data;
+        node->right = deleteNode(tree, node->right, node->data);
+    }
+
+    return rebalance(tree, ref);
+}
+
+// Returns -1, leaving the tree as it was, if the pool is full and cannot grow
+int insert(PersistentTree* tree, int data) {
+    // Make room before the descent, so a failed grow happens before any
+    // node changes and the mapping cannot move under it
+    PoolHeader* header = HEADER(tree);
+    if (header->freeList == NULL_REF && header->used == header->capacity && growPool(tree) != 0)
+        return -1;
+    NodeRef root = insertNode(tree, HEADER(tree)->root, data);
+    HEADER(tree)->root = root;
+    return 0;
+}
+
+void delete(PersistentTree* tree, int data) {
+    HEADER(tree)->root = deleteNode(tree, HEADER(tree)->root, data);
+}
+
+NodeRef search(PersistentTree* tree, int data) {
+    NodeRef ref = HEADER(tree)->root;
+    while (ref != NULL_REF && NODE(tree, ref)->data != data)
+        ref = data < NODE(tree, ref)->data ? NODE(tree, ref)->left : NODE(tree, ref)->right;
+    return ref;
+}
+
+void processFiles(const char* files[], int fileCount) {
+    for (int i = 0; i < fileCount; i++) {
+        FILE* file = fopen(files[i], "r");
+        if (file == NULL) {
+            perror("Error opening file");
+            return;
+        }
+
+        printf("\nProcessing file: %s\n", files[i]);
+
+        char treePath[256];
+        snprintf(treePath, sizeof(treePath), "%s.pavl", files[i]);
+        remove(treePath);
+
+        PersistentTree* tree = openTree(treePath);
+        if (tree == NULL) {
+            fclose(file);
+            return;
+        }
+
+        int number, nodeCount = 0;
+        clock_t start, end;
+
+        // Insertion time
+        start = clock();
+        while (fscanf(file, "%d,", &number) == 1) {
+            if (insert(tree, number) != 0) break;
+            nodeCount++;
+        }
+        end = clock();
+        printf("Insertion time for %d nodes: %f seconds\n", nodeCount, ((double)(end - start)) / CLOCKS_PER_SEC);
+        fclose(file);
+
+        start = clock();
+        closeTree(tree);
+        end = clock();
+        printf("Sync and close time: %f seconds\n", ((double)(end - start)) / CLOCKS_PER_SEC);
+
+        // Restart: map the same file again and use the tree as it is
+        start = clock();
+        tree = openTree(treePath);
+        end = clock();
+        if (tree == NULL) return;
+        printf("Reopen time for %llu keys: %f seconds, file size %zu bytes (%.2f bytes/key)\n",
+               (unsigned long long)HEADER(tree)->count, ((double)(end - start)) / CLOCKS_PER_SEC,
+               tree->mapSize, HEADER(tree)->count ? (double)tree->mapSize / HEADER(tree)->count : 0.0);
+
+        // Search time for node with value 500
+        start = clock();
+        NodeRef found = search(tree, 500);
+        end = clock();
+        if (found != NULL_REF) {
+            printf("Node with value 500 found.\n");
+        } else {
+            printf("Node with value 500 not found.\n");
+        }
+        printf("Search time for node with value 500: %f seconds\n", ((double)(end - start)) / CLOCKS_PER_SEC);
+
+        // Deletion time for node with value 500
+        start = clock();
+        delete(tree, 500);
+        end = clock();
+        printf("Deletion time for node with value 500: %f seconds\n", ((double)(end - start)) / CLOCKS_PER_SEC);
+
+        closeTree(tree);
+    }
+}
+
+int main() {
+    const char* files[] = {
+        "random_numbers.txt",
+        "mixed_numbers.txt",
+        "increasing_numbers.txt",
+        "decreasing_numbers.txt"
+    };
+
+    processFiles(files, 4);
+
+    return 0;
+}
@@ -0,0 +1,511 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include "perf_counters.h"
+#include "latency_histogram.h"
+#include "tree_stats.h"
+#include "snapshot.h"
+#include "avl_template.h"
+
+// Packed memory array: the keys live in one sorted array with gaps, cut
+// into segments of PMA_SEGMENT_SLOTS slots. Each segment keeps its keys
+// packed at its front, so a range scan is a sequential read that only skips
+// the unused tail of each segment. The segments are the leaves of an
+// implicit binary tree of windows; each window level has a density band
+// that is widest at the leaves and tightest at the root. An insert into a
+// full segment (or a delete that leaves one too sparse) climbs to the
+// smallest enclosing window whose density is back inside its band and
+// spreads that window's keys evenly over its segments, which costs
+// O(log^2 n) amortised moves. When even the whole array is out of its
+// band, the array doubles or halves.
+//
+// On top sits a static search index: the smallest key of every segment in
+// a separate fence array. A lookup binary searches the fences (one int per
+// segment, so the index is about 1/40 of the keys) and then one segment.
+// Fences only change for segments a rebalance rewrites.
+#define PMA_SEGMENT_SLOTS 64
+#define PMA_UPPER_LEAF 1.0      // Densest a segment may get
+#define PMA_UPPER_ROOT 0.75     // Densest the whole array may get before it doubles
+#define PMA_LOWER_LEAF 0.125    // Sparsest a segment may get
+#define PMA_LOWER_ROOT 0.25     // Sparsest the whole array may get before it halves
+
+DEFINE_AVL(KeyAvl, int, char, AVL_CMP_SCALAR)
+
+typedef struct PackedMemoryArray {
+    int* slots;           // segmentCount * PMA_SEGMENT_SLOTS keys, packed at the front of each segment
+    int* counts;          // Keys per segment
+    int* fences;          // Smallest key of each segment
+    long segmentCount;    // A power of two
+    int height;           // log2(segmentCount): the root window's level
+    long size;
+    long rebalances;      // Windows respread
+    long resizes;
+    long updates;         // Successful inserts and deletes
+    long moves;           // Keys written by shifts and respreads
+} PackedMemoryArray;
+
+int pmaAllocate(PackedMemoryArray* pma, long segmentCount) {
+    pma->slots = (int*)malloc(sizeof(int) * segmentCount * PMA_SEGMENT_SLOTS);
+    pma->counts = (int*)calloc(segmentCount, sizeof(int));
+    pma->fences = (int*)calloc(segmentCount, sizeof(int));
+    if (pma->slots == NULL || pma->counts == NULL || pma->fences == NULL) {
+        free(pma->slots);
+        free(pma->counts);
+        free(pma->fences);
+        fprintf(stderr, "Memory allocation failed\n");
+        return -1;
+    }
+    pma->segmentCount = segmentCount;
+    pma->height = 0;
+    while ((1L << pma->height) < segmentCount) pma->height++;
+    return 0;
+}
+
+int pmaInit(PackedMemoryArray* pma) {
+    memset(pma, 0, sizeof(*pma));
+    return pmaAllocate(pma, 1);
+}
+
+void pmaFree(PackedMemoryArray* pma) {
+    free(pma->slots);
+    free(pma->counts);
+    free(pma->fences);
+    pma->slots = pma->counts = pma->fences = NULL;
+}
+
+size_t pmaBytes(const PackedMemoryArray* pma) {
+    return pma->segmentCount * (PMA_SEGMENT_SLOTS + 2) * sizeof(int);
+}
+
+// Density bounds, in keys, for a window of 2^level segments
+double pmaUpperBound(const PackedMemoryArray* pma, int level) {
+    double t = pma->height == 0 ? 1.0 : (double)level / pma->height;
+    return (PMA_UPPER_LEAF - (PMA_UPPER_LEAF - PMA_UPPER_ROOT) * t) * ((long)PMA_SEGMENT_SLOTS << level);
+}
+
+double pmaLowerBound(const PackedMemoryArray* pma, int level) {
+    double t = pma->height == 0 ? 1.0 : (double)level / pma->height;
+    return (PMA_LOWER_LEAF + (PMA_LOWER_ROOT - PMA_LOWER_LEAF) * t) * ((long)PMA_SEGMENT_SLOTS << level);
+}
+
+// Segment that holds key if it is present: the last one whose fence is <= key
+long pmaFindSegment(const PackedMemoryArray* pma, int key) {
+    long lo = 1, hi = pma->segmentCount;
+    while (lo < hi) {
+        long mid = lo + (hi - lo) / 2;
+        if (pma->fences[mid] <= key) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo - 1;
+}
+
+// Position of the first key >= key within a segment
+int pmaSegmentLowerBound(const PackedMemoryArray* pma, long segment, int key) {
+    const int* keys = pma->slots + segment * PMA_SEGMENT_SLOTS;
+    int lo = 0, hi = pma->counts[segment];
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (keys[mid] < key) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+bool pmaContains(const PackedMemoryArray* pma, int key) {
+    long segment = pmaFindSegment(pma, key);
+    int pos = pmaSegmentLowerBound(pma, segment, key);
+    return pos < pma->counts[segment] && pma->slots[segment * PMA_SEGMENT_SLOTS + pos] == key;
+}
+
+// Copy the keys of segments [first, first + segments) into out, in order
+long pmaGather(const PackedMemoryArray* pma, long first, long segments, int* out) {
+    long n = 0;
+    for (long s = first; s < first + segments; s++) {
+        memcpy(out + n, pma->slots + s * PMA_SEGMENT_SLOTS, sizeof(int) * pma->counts[s]);
+        n += pma->counts[s];
+    }
+    return n;
+}
+
+// Spread n sorted keys evenly over segments [first, first + segments)
+void pmaSpread(PackedMemoryArray* pma, long first, long segments, const int* keys, long n) {
+    long done = 0;
+    for (long i = 0; i < segments; i++) {
+        long end = n * (i + 1) / segments;
+        int count = (int)(end - done);
+        long s = first + i;
+        memcpy(pma->slots + s * PMA_SEGMENT_SLOTS, keys + done, sizeof(int) * count);
+        pma->counts[s] = count;
+        if (count > 0) pma->fences[s] = keys[done];
+        else pma->fences[s] = s > 0 ? pma->fences[s - 1] : 0;  // Only an empty single segment
+        done = end;
+    }
+    pma->moves += n;
+}
+
+// Rewrite the whole array over segmentCount segments. keys holds all of
+// them in order; returns -1 (keeping the old array) if memory runs out.
+int pmaResize(PackedMemoryArray* pma, long segmentCount, const int* keys, long n) {
+    PackedMemoryArray old = *pma;
+    if (pmaAllocate(pma, segmentCount) != 0) {
+        *pma = old;
+        return -1;
+    }
+    pmaSpread(pma, 0, segmentCount, keys, n);
+    free(old.slots);
+    free(old.counts);
+    free(old.fences);
+    pma->resizes++;
+    return 0;
+}
+
+// Respread the smallest window around segment whose key count, after
+// adding extra (+1 for an insert of key, -1 or 0 after a delete), fits its
+// density band, resizing the array when no window does. Returns -1 if
+// memory runs out.
+int pmaRebalance(PackedMemoryArray* pma, long segment, int extra, int key) {
+    int level = 0;
+    long first = segment, segments = 1, total = pma->counts[segment] + (extra > 0);
+    while (level < pma->height) {
+        level++;
+        first = segment >> level << level;
+        segments = 1L << level;
+        total = extra > 0;
+        for (long s = first; s < first + segments; s++) total += pma->counts[s];
+        if (extra > 0 ? total <= pmaUpperBound(pma, level) : total >= pmaLowerBound(pma, level)) break;
+    }
+
+    int* keys = (int*)malloc(sizeof(int) * (total + 1));
+    if (keys == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return -1;
+    }
+    long n = pmaGather(pma, first, segments, keys);
+    if (extra > 0) {
+        long pos = n;
+        while (pos > 0 && keys[pos - 1] > key) pos--;
+        memmove(keys + pos + 1, keys + pos, sizeof(int) * (n - pos));
+        keys[pos] = key;
+        n++;
+    }
+
+    int result = 0;
+    if (level == pma->height && extra > 0 && n > pmaUpperBound(pma, level)) {
+        result = pmaResize(pma, pma->segmentCount * 2, keys, n);
+    } else if (level == pma->height && extra <= 0 && pma->segmentCount > 1 && n < pmaLowerBound(pma, level)) {
+        result = pmaResize(pma, pma->segmentCount / 2, keys, n);
+    } else {
+        pmaSpread(pma, first, segments, keys, n);
+        pma->rebalances++;
+    }
+    free(keys);
+    return result;
+}
+
+// Returns true if key was added, false if it was already present
+bool pmaInsert(PackedMemoryArray* pma, int key) {
+    long segment = pmaFindSegment(pma, key);
+    int pos = pmaSegmentLowerBound(pma, segment, key);
+    int* keys = pma->slots + segment * PMA_SEGMENT_SLOTS;
+    int count = pma->counts[segment];
+    if (pos < count && keys[pos] == key) return false;
+
+    if (count + 1 > pmaUpperBound(pma, 0)) {
+        if (pmaRebalance(pma, segment, 1, key) != 0) return false;
+    } else {
+        memmove(keys + pos + 1, keys + pos, sizeof(int) * (count - pos));
+        keys[pos] = key;
+        pma->counts[segment]++;
+        if (pos == 0) pma->fences[segment] = key;
+        pma->moves += count - pos + 1;
+    }
+    pma->size++;
+    pma->updates++;
+    return true;
+}
+
+// Returns true if key was removed
+bool pmaDelete(PackedMemoryArray* pma, int key) {
+    long segment = pmaFindSegment(pma, key);
+    int pos = pmaSegmentLowerBound(pma, segment, key);
+    int* keys = pma->slots + segment * PMA_SEGMENT_SLOTS;
+    int count = pma->counts[segment];
+    if (pos >= count || keys[pos] != key) return false;
+
+    memmove(keys + pos, keys + pos + 1, sizeof(int) * (count - pos - 1));
+    pma->counts[segment]--;
+    if (pos == 0 && count > 1) pma->fences[segment] = keys[0];
+    pma->moves += count - pos - 1;
+    pma->size--;
+    pma->updates++;
+    // A single segment may run empty; otherwise every segment keeps a key,
+    // which the fence search relies on
+    if (pma->segmentCount > 1 && pma->counts[segment] < pmaLowerBound(pma, 0)) pmaRebalance(pma, segment, 0, key);
+    return true;
+}
+
+// Visit the keys in [low, high] in order with one sequential pass; returns
+// how many there were
+long pmaRangeScan(const PackedMemoryArray* pma, int low, int high, SnapshotVisitor visit, void* context) {
+    long segment = pmaFindSegment(pma, low);
+    int pos = pmaSegmentLowerBound(pma, segment, low);
+    long visited = 0;
+    for (; segment < pma->segmentCount; segment++, pos = 0) {
+        const int* keys = pma->slots + segment * PMA_SEGMENT_SLOTS;
+        int count = pma->counts[segment];
+        for (; pos < count; pos++) {
+            if (keys[pos] > high) return visited;
+            if (visit != NULL) visit(keys[pos], context);
+            visited++;
+        }
+    }
+    return visited;
+}
+
+void printPmaStats(const PackedMemoryArray* pma) {
+    size_t bytes = pmaBytes(pma);
+    printf("Packed memory array: keys=%ld, segments=%ld x %d slots, density=%.2f, bytes=%zu, bytes/key=%.2f, "
+           "rebalances=%ld, resizes=%ld, moves/update=%.1f\n",
+           pma->size, pma->segmentCount, PMA_SEGMENT_SLOTS,
+           (double)pma->size / (pma->segmentCount * PMA_SEGMENT_SLOTS), bytes,
+           pma->size ? (double)bytes / pma->size : 0.0, pma->rebalances, pma->resizes,
+           pma->updates ? (double)pma->moves / pma->updates : 0.0);
+}
+
+int saveSnapshot(const PackedMemoryArray* pma, const char* path) {
+    SnapshotWriter* writer = snapshotBegin(path);
+    if (writer == NULL) return -1;
+    for (long s = 0; s < pma->segmentCount; s++) {
+        for (int i = 0; i < pma->counts[s]; i++) snapshotAppend(writer, pma->slots[s * PMA_SEGMENT_SLOTS + i]);
+    }
+    return snapshotFinish(writer);
+}
+
+void sumKey(int key, void* context) {
+    *(long long*)context += key;
+}
+
+// In-order walk of the AVL tree limited to [low, high], for comparison
+long treeRangeScan(const KeyAvlNode* node, int low, int high, long long* sum) {
+    if (node == NULL) return 0;
+    long visited = 0;
+    if (node->key > low) visited += treeRangeScan(node->left, low, high, sum);
+    if (node->key >= low && node->key <= high) {
+        *sum += node->key;
+        visited++;
+    }
+    if (node->key < high) visited += treeRangeScan(node->right, low, high, sum);
+    return visited;
+}
+
+void collectTreeStats(const KeyAvlNode* node, int depth, TreeStats* stats) {
+    if (node == NULL) return;
+    treeStatsAddNode(stats, node, sizeof(KeyAvlNode), depth, 1);
+    collectTreeStats(node->left, depth + 1, stats);
+    collectTreeStats(node->right, depth + 1, stats);
+}
+
+// Load count keys into the array and an AVL tree, then compare point
+// lookups and range scans of a few widths, ending with a full scan
+void benchmarkRangeScans(long count, bool sequential) {
+    printf("\n%s keys: %ld\n", sequential ? "Increasing" : "Random", count);
+    PackedMemoryArray pma;
+    if (pmaInit(&pma) != 0) return;
+    KeyAvlNode* avl = NULL;
+    int* keys = (int*)malloc(sizeof(int) * count);
+    if (keys == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        pmaFree(&pma);
+        return;
+    }
+    int range = (int)(4 * count);
+    for (long i = 0; i < count; i++) {
+        keys[i] = sequential ? (int)(4 * i) : (int)((((uint32_t)rand() << 16) ^ (uint32_t)rand()) % (uint32_t)range);
+    }
+
+    uint64_t start = nowNanos();
+    for (long i = 0; i < count; i++) pmaInsert(&pma, keys[i]);
+    double pmaInsertNanos = (double)(nowNanos() - start) / count;
+    start = nowNanos();
+    for (long i = 0; i < count; i++) avl = KeyAvlInsert(avl, keys[i], 0);
+    double avlInsertNanos = (double)(nowNanos() - start) / count;
+    printPmaStats(&pma);
+    TreeStats stats;
+    treeStatsInit(&stats);
+    collectTreeStats(avl, 0, &stats);
+    treeStatsFinish(&stats);
+    printTreeStats(&stats, NULL, 1);
+
+    long pmaFound = 0, avlFound = 0;
+    start = nowNanos();
+    for (long i = 0; i < count; i++) pmaFound += pmaContains(&pma, keys[(i * 7919) % count] + (int)(i & 1));
+    double pmaSearchNanos = (double)(nowNanos() - start) / count;
+    start = nowNanos();
+    for (long i = 0; i < count; i++) avlFound += KeyAvlSearch(avl, keys[(i * 7919) % count] + (int)(i & 1)) != NULL;
+    double avlSearchNanos = (double)(nowNanos() - start) / count;
+    printf("Insert: array %.1f ns, AVL tree %.1f ns; search: array %.1f ns, AVL tree %.1f ns%s\n",
+           pmaInsertNanos, avlInsertNanos, pmaSearchNanos, avlSearchNanos,
+           pmaFound != avlFound ? " (lookup results differ)" : "");
+
+    // Widths in keys; the key range is about four values per key
+    long widths[] = { 100, 10000, 1000000, count };
+    int* lows = (int*)malloc(sizeof(int) * 10000);
+    for (int w = 0; w < 4 && lows != NULL; w++) {
+        long scans = widths[w] >= count ? 3 : 20000000 / widths[w];
+        if (scans > 10000) scans = 10000;
+        for (long i = 0; i < scans; i++) lows[i] = widths[w] >= count ? 0 : rand() % range;
+        long long pmaSum = 0, avlSum = 0;
+        long pmaKeys = 0, avlKeys = 0;
+        start = nowNanos();
+        for (long i = 0; i < scans; i++) pmaKeys += pmaRangeScan(&pma, lows[i], (int)(lows[i] + 4 * widths[w] - 1), sumKey, &pmaSum);
+        double pmaNanos = (double)(nowNanos() - start);
+        start = nowNanos();
+        for (long i = 0; i < scans; i++) avlKeys += treeRangeScan(avl, lows[i], (int)(lows[i] + 4 * widths[w] - 1), &avlSum);
+        double avlNanos = (double)(nowNanos() - start);
+        printf("Range scans of ~%ld keys: %ld scans, array %.2f ns/key, AVL tree %.2f ns/key%s\n",
+               widths[w], scans, pmaKeys ? pmaNanos / pmaKeys : 0.0, avlKeys ? avlNanos / avlKeys : 0.0,
+               pmaSum != avlSum || pmaKeys != avlKeys ? " (scan results differ)" : "");
+    }
+    free(lows);
+
+    // Delete half of the keys to exercise the lower density bounds
+    start = nowNanos();
+    for (long i = 0; i < count; i += 2) pmaDelete(&pma, keys[i]);
+    printf("Deletion of every other key: %.1f ns\n", (double)(nowNanos() - start) / ((count + 1) / 2));
+    printPmaStats(&pma);
+
+    pmaFree(&pma);
+    KeyAvlFree(avl);
+    free(keys);
+}
+
+// Replay the file's operations on a scratch array with a clock read around
+// each one, outside the windows the hardware counters cover
+void recordLatencies(FILE* file, LatencyHistogram latency[]) {
+    PackedMemoryArray pma;
+    if (pmaInit(&pma) != 0) return;
+    int number;
+    rewind(file);
+    while (fscanf(file, "%d,", &number) == 1) {
+        uint64_t opStart = nowNanos();
+        pmaInsert(&pma, number);
+        histogramRecord(&latency[OP_INSERT], nowNanos() - opStart);
+    }
+
+    uint64_t opStart = nowNanos();
+    pmaContains(&pma, 500);
+    histogramRecord(&latency[OP_SEARCH], nowNanos() - opStart);
+
+    opStart = nowNanos();
+    pmaDelete(&pma, 500);
+    histogramRecord(&latency[OP_DELETE], nowNanos() - opStart);
+    pmaFree(&pma);
+}
+
+void processFiles(const char* files[], int fileCount) {
+    PackedMemoryArray pma;
+    PerfCounters counters;
+    perfOpen(&counters);
+    static LatencyHistogram latency[OP_TYPE_COUNT], totalLatency[OP_TYPE_COUNT];
+    for (int op = 0; op < OP_TYPE_COUNT; op++) histogramInit(&totalLatency[op]);
+
+    for (int i = 0; i < fileCount; i++) {
+        FILE* file = fopen(files[i], "r");
+        if (file == NULL) {
+            perror("Error opening file");
+            return;
+        }
+
+        printf("\nProcessing file: %s\n", files[i]);
+
+        int number, nodeCount = 0;
+        clock_t start, end;
+        if (pmaInit(&pma) != 0) {
+            fclose(file);
+            return;
+        }
+
+        for (int op = 0; op < OP_TYPE_COUNT; op++) histogramInit(&latency[op]);
+
+        // Insertion time
+        start = clock();
+        perfStart(&counters);
+        while (fscanf(file, "%d,", &number) == 1) {
+            pmaInsert(&pma, number);
+            nodeCount++;
+        }
+        perfStop(&counters);
+        end = clock();
+        printf("Insertion time for %d nodes: %f seconds\n", nodeCount, ((double)(end - start)) / CLOCKS_PER_SEC);
+        perfReport(&counters, "Insertion", nodeCount);
+        printPmaStats(&pma);
+
+        // Snapshot the array and serve the same lookups from the mapped image
+        char snapshotPath[256];
+        snprintf(snapshotPath, sizeof(snapshotPath), "%s.snap", files[i]);
+        start = clock();
+        int saved = saveSnapshot(&pma, snapshotPath);
+        end = clock();
+        printf("Snapshot write time: %f seconds\n", ((double)(end - start)) / CLOCKS_PER_SEC);
+        if (saved == 0) snapshotBenchmark(snapshotPath, 500, 250, 750);
+
+        // Search time for node with value 500
+        start = clock();
+        perfStart(&counters);
+        bool found = pmaContains(&pma, 500);
+        perfStop(&counters);
+        end = clock();
+        if (found) {
+            printf("Node with value 500 found.\n");
+        } else {
+            printf("Node with value 500 not found.\n");
+        }
+        printf("Search time for node with value 500: %f seconds\n", ((double)(end - start)) / CLOCKS_PER_SEC);
+        perfReport(&counters, "Search", 1);
+
+        long long sum = 0;
+        long inRange = pmaRangeScan(&pma, 250, 750, sumKey, &sum);
+        printf("Keys in [250, 750]: %ld, sum %lld\n", inRange, sum);
+
+        // Deletion time for node with value 500
+        start = clock();
+        perfStart(&counters);
+        pmaDelete(&pma, 500);
+        perfStop(&counters);
+        end = clock();
+        printf("Deletion time for node with value 500: %f seconds\n", ((double)(end - start)) / CLOCKS_PER_SEC);
+        perfReport(&counters, "Deletion", 1);
+
+        recordLatencies(file, latency);
+        for (int op = 0; op < OP_TYPE_COUNT; op++) {
+            histogramPrint(&latency[op], opTypeNames[op]);
+            histogramMerge(&totalLatency[op], &latency[op]);
+        }
+
+        fclose(file);
+        pmaFree(&pma); // Reset the array for the next file
+    }
+
+    printf("\nLatency over all files:\n");
+    for (int op = 0; op < OP_TYPE_COUNT; op++) histogramPrint(&totalLatency[op], opTypeNames[op]);
+    perfClose(&counters);
+}
+
+int main() {
+    const char* files[] = {
+        "random_numbers.txt",
+        "mixed_numbers.txt",
+        "increasing_numbers.txt",
+        "decreasing_numbers.txt"
+    };
+
+    processFiles(files, 4);
+    srand(time(NULL));
+    benchmarkRangeScans(2000000, false);
+    benchmarkRangeScans(2000000, true);
+
+    return 0;
+}
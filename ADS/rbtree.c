@@ -1,8 +1,25 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <stddef.h>
+#include <limits.h>
 #include <time.h>
+#include "perf_counters.h"
+#include "op_counters.h"
+#include "latency_histogram.h"
+#include "tree_stats.h"
+#include "snapshot.h"
+#include "wal.h"
+#include "hash_index.h"
+#include "node_pool.h"
 
 #define FILE_COUNT 4
+#define WAL_GROUP_SIZE 1024      // Fewest updates that share one fdatasync
+#define WAL_TARGET_OVERHEAD 10.0 // Most insert time the log may add, in percent
+#define DURABILITY_KEYS 200000   // Inserts timed by the durability benchmark
+#define DURABILITY_TRIALS 3      // Runs with and without the log; the best of each counts
+#define POINT_LOOKUP_KEYS 1000000  // Tree size for the point lookup benchmark
+#define COMPACTION_KEYS 1000000  // Tree size for the compaction benchmark
+#define COMPACTION_BUDGET 4096   // Nodes examined per incremental compaction step
 
 // Structure for a Red-Black Tree Node
 typedef enum { RED, BLACK } Color;
@@ -16,6 +33,12 @@ typedef struct Node {
 typedef struct RedBlackTree {
     Node *root;
     Node *NIL; // Sentinel node for NIL
+    OpCounters opCounters; // Structural work done on this tree
+    WriteAheadLog *wal; // Optional log of every update, NULL when disabled
+    HashIndex *index; // Optional key -> node map for point lookups, NULL when disabled
+    long modCount; // Structural changes, so an incremental compaction can tell the tree changed
+    NodePoolSet pools; // Pools compaction has moved nodes into
+    Compaction compaction; // The compaction in progress, if any
 } RedBlackTree;
 
 //Function prototypes
@@ -24,29 +47,65 @@ RedBlackTree* initializeTree();
 void leftRotate(RedBlackTree *tree, Node *x);
 void rightRotate(RedBlackTree *tree, Node *y);
 void insertFixup(RedBlackTree *tree, Node *z);
-void insert(RedBlackTree *tree, int data);
+int insert(RedBlackTree *tree, int data);
 void transplant(RedBlackTree *tree, Node *u, Node *v);
 Node* minimum(Node *node, Node* NIL);
 void deleteFixup(RedBlackTree *tree, Node *x);
-void deleteNode(RedBlackTree *tree, Node *z);
+int deleteNode(RedBlackTree *tree, Node *z);
 Node* search(RedBlackTree *tree, Node *node, int data);
+void releaseNode(RedBlackTree *tree, Node *node);
+int compactBegin(RedBlackTree *tree, CompactOrder order);
+int compactStep(RedBlackTree *tree, long budget);
+void compact(RedBlackTree *tree, CompactOrder order);
+int enablePointIndex(RedBlackTree *tree);
+void disablePointIndex(RedBlackTree *tree);
+Node* lookup(RedBlackTree *tree, int data);
+TreeStats treeStats(RedBlackTree *tree);
+int saveSnapshot(RedBlackTree *tree, const char *path);
+void destroyTree(RedBlackTree *tree);
+void bulkLoad(RedBlackTree *tree, const int *keys, long count);
+RedBlackTree* recoverTree(const char *snapshotPath, const char *walPath);
+int checkpointTree(RedBlackTree *tree, const char *snapshotPath);
+void benchmarkDurability(int count, int groupSize);
+void benchmarkPointLookups(int count);
+void benchmarkCompaction(int count, int probes);
 void generateFiles();
-void performOperations(const char *filename, RedBlackTree *tree);
+void recordLatencies(FILE *f, RedBlackTree *tree, LatencyHistogram *latency);
+void performOperations(const char *filename, RedBlackTree *tree, RedBlackTree *timingTree, PerfCounters *counters, LatencyHistogram *totalLatency);
 
 
-// Main function
+// Main function. Engines that build on the tree (lsm.c uses it as its
+// memtable) include this file with RBTREE_NO_MAIN defined.
+#ifndef RBTREE_NO_MAIN
 int main() {
     generateFiles();
     RedBlackTree *tree = initializeTree();
+    enablePointIndex(tree);
+    RedBlackTree *timingTree = initializeTree();
+    enablePointIndex(timingTree);
+    PerfCounters counters;
+    perfOpen(&counters);
+    static LatencyHistogram totalLatency[OP_TYPE_COUNT];
+    for (int op = 0; op < OP_TYPE_COUNT; op++) histogramInit(&totalLatency[op]);
 
     const char *files[FILE_COUNT] = {"increasing.txt", "decreasing.txt", "mixed.txt", "random.txt"};
     for (int i = 0; i < FILE_COUNT; i++) {
         printf("\nProcessing file: %s\n", files[i]);
-        performOperations(files[i], tree);
+        performOperations(files[i], tree, timingTree, &counters, totalLatency);
     }
 
+    perfClose(&counters);
+
+    printf("\nLatency over all files:\n");
+    for (int op = 0; op < OP_TYPE_COUNT; op++) histogramPrint(&totalLatency[op], opTypeNames[op]);
+
+    benchmarkDurability(DURABILITY_KEYS, WAL_GROUP_SIZE);
+    benchmarkPointLookups(POINT_LOOKUP_KEYS);
+    benchmarkCompaction(COMPACTION_KEYS, COMPACTION_KEYS);
+
     return 0;
 }
+#endif
 
 // Create a new node
 Node* createNode(int data, Color color, Node* NIL) {
@@ -64,11 +123,19 @@ RedBlackTree* initializeTree() {
     RedBlackTree *tree = (RedBlackTree *)malloc(sizeof(RedBlackTree));
     tree->NIL = createNode(0, BLACK, NULL);
     tree->root = tree->NIL;
+    resetOpCounters(&tree->opCounters);
+    tree->wal = NULL;
+    tree->index = NULL;
+    tree->modCount = 0;
+    tree->pools.count = 0;
+    tree->pools.hugePages = 0;
+    memset(&tree->compaction, 0, sizeof(tree->compaction));
     return tree;
 }
 
 // Left rotate
 void leftRotate(RedBlackTree *tree, Node *x) {
+    COUNT_OP(tree->opCounters, rotations);
     Node *y = x->right;
     x->right = y->left;
     if (y->left != tree->NIL)
@@ -86,6 +153,7 @@ void leftRotate(RedBlackTree *tree, Node *x) {
 
 // Right rotate
 void rightRotate(RedBlackTree *tree, Node *y) {
+    COUNT_OP(tree->opCounters, rotations);
     Node *x = y->left;
     y->left = x->right;
     if (x->right != tree->NIL)
@@ -104,6 +172,7 @@ void rightRotate(RedBlackTree *tree, Node *y) {
 // Insert fixup
 void insertFixup(RedBlackTree *tree, Node *z) {
     while (z->parent->color == RED) {
+        COUNT_OP(tree->opCounters, fixups);
         if (z->parent == z->parent->parent->left) {
             Node *y = z->parent->parent->right;
             if (y->color == RED) {
@@ -111,6 +180,7 @@ void insertFixup(RedBlackTree *tree, Node *z) {
                 y->color = BLACK;
                 z->parent->parent->color = RED;
                 z = z->parent->parent;
+                COUNT_OPS(tree->opCounters, recolors, 3);
             } else {
                 if (z == z->parent->right) {
                     z = z->parent;
@@ -118,6 +188,7 @@ void insertFixup(RedBlackTree *tree, Node *z) {
                 }
                 z->parent->color = BLACK;
                 z->parent->parent->color = RED;
+                COUNT_OPS(tree->opCounters, recolors, 2);
                 rightRotate(tree, z->parent->parent);
             }
         } else {
@@ -128,6 +199,7 @@ void insertFixup(RedBlackTree *tree, Node *z) {
                 y->color = BLACK;
                 z->parent->parent->color = RED;
                 z = z->parent->parent;
+                COUNT_OPS(tree->opCounters, recolors, 3);
             } else {
                 if (z == z->parent->left) {
                     z = z->parent;
@@ -135,6 +207,7 @@ void insertFixup(RedBlackTree *tree, Node *z) {
                 }
                 z->parent->color = BLACK;
                 z->parent->parent->color = RED;
+                COUNT_OPS(tree->opCounters, recolors, 2);
                 leftRotate(tree, z->parent->parent);
             }
         }
@@ -142,19 +215,28 @@ void insertFixup(RedBlackTree *tree, Node *z) {
     tree->root->color = BLACK;
 }
 
-// Insert a node
-void insert(RedBlackTree *tree, int data) {
-    Node *z = createNode(data, RED, tree->NIL);
+// Insert a node; keys already in the tree are ignored. Returns -1, leaving
+// the tree unchanged, if the write-ahead log refuses the update.
+int insert(RedBlackTree *tree, int data) {
     Node *y = tree->NIL;
     Node *x = tree->root;
 
     while (x != tree->NIL) {
         y = x;
-        if (z->data < x->data)
+        COUNT_OP(tree->opCounters, comparisons);
+        if (data < x->data)
             x = x->left;
-        else
+        else if (data > x->data)
             x = x->right;
+        else
+            return 0;
     }
+
+    if (tree->wal && walAppend(tree->wal, WAL_INSERT, data) != 0)
+        return -1;
+
+    tree->modCount++;
+    Node *z = createNode(data, RED, tree->NIL);
     z->parent = y;
     if (y == tree->NIL)
         tree->root = z;
@@ -163,7 +245,13 @@ void insert(RedBlackTree *tree, int data) {
     else
         y->right = z;
 
+    // An index that cannot take the new node would miss it, so drop it
+    // and let lookup search the tree instead
+    if (tree->index && hashIndexPut(tree->index, data, z) != 0)
+        disablePointIndex(tree);
+
     insertFixup(tree, z);
+    return 0;
 }
 
 // Transplant nodes
@@ -187,27 +275,32 @@ Node* minimum(Node *node, Node* NIL) {
 // Delete fixup
 void deleteFixup(RedBlackTree *tree, Node *x) {
     while (x != tree->root && x->color == BLACK) {
+        COUNT_OP(tree->opCounters, fixups);
         if (x == x->parent->left) {
             Node *w = x->parent->right;
             if (w->color == RED) {
                 w->color = BLACK;
                 x->parent->color = RED;
+                COUNT_OPS(tree->opCounters, recolors, 2);
                 leftRotate(tree, x->parent);
                 w = x->parent->right;
             }
             if (w->left->color == BLACK && w->right->color == BLACK) {
                 w->color = RED;
+                COUNT_OP(tree->opCounters, recolors);
                 x = x->parent;
             } else {
                 if (w->right->color == BLACK) {
                     w->left->color = BLACK;
                     w->color = RED;
+                    COUNT_OPS(tree->opCounters, recolors, 2);
                     rightRotate(tree, w);
                     w = x->parent->right;
                 }
                 w->color = x->parent->color;
                 x->parent->color = BLACK;
                 w->right->color = BLACK;
+                COUNT_OPS(tree->opCounters, recolors, 3);
                 leftRotate(tree, x->parent);
                 x = tree->root;
             }
@@ -216,22 +309,26 @@ void deleteFixup(RedBlackTree *tree, Node *x) {
             if (w->color == RED) {
                 w->color = BLACK;
                 x->parent->color = RED;
+                COUNT_OPS(tree->opCounters, recolors, 2);
                 rightRotate(tree, x->parent);
                 w = x->parent->left;
             }
             if (w->left->color == BLACK && w->right->color == BLACK) {
                 w->color = RED;
+                COUNT_OP(tree->opCounters, recolors);
                 x = x->parent;
             } else {
                 if (w->left->color == BLACK) {
                     w->right->color = BLACK;
                     w->color = RED;
+                    COUNT_OPS(tree->opCounters, recolors, 2);
                     leftRotate(tree, w);
                     w = x->parent->left;
                 }
                 w->color = x->parent->color;
                 x->parent->color = BLACK;
                 w->left->color = BLACK;
+                COUNT_OPS(tree->opCounters, recolors, 3);
                 rightRotate(tree, x->parent);
                 x = tree->root;
             }
@@ -240,8 +337,15 @@ void deleteFixup(RedBlackTree *tree, Node *x) {
     x->color = BLACK;
 }
 
-// Delete a node
-void deleteNode(RedBlackTree *tree, Node *z) {
+// Delete a node and free it. Returns -1, leaving the tree unchanged, if
+// the write-ahead log refuses the update.
+int deleteNode(RedBlackTree *tree, Node *z) {
+    if (tree->wal && walAppend(tree->wal, WAL_DELETE, z->data) != 0)
+        return -1;
+    if (tree->index)
+        hashIndexErase(tree->index, z->data);
+    tree->modCount++;
+
     Node *y = z;
     Node *x;
     Color yOriginalColor = y->color;
@@ -271,11 +375,16 @@ void deleteNode(RedBlackTree *tree, Node *z) {
 
     if (yOriginalColor == BLACK)
         deleteFixup(tree, x);
+    releaseNode(tree, z);
+    return 0;
 }
 
 // Search for a node
 Node* search(RedBlackTree *tree, Node *node, int data) {
-    if (node == tree->NIL || data == node->data)
+    if (node == tree->NIL)
+        return node;
+    COUNT_OP(tree->opCounters, comparisons);
+    if (data == node->data)
         return node;
     if (data < node->data)
         return search(tree, node->left, data);
@@ -283,6 +392,517 @@ Node* search(RedBlackTree *tree, Node *node, int data) {
         return search(tree, node->right, data);
 }
 
+// Add every node below node to the point index. Returns -1 if the index
+// could not grow.
+int indexNodes(RedBlackTree *tree, Node *node) {
+    if (node == tree->NIL) return 0;
+    if (hashIndexPut(tree->index, node->data, node) != 0) return -1;
+    if (indexNodes(tree, node->left) != 0) return -1;
+    return indexNodes(tree, node->right);
+}
+
+// Start maintaining a hash index next to the tree. Deletion relinks nodes
+// rather than copying keys, and compaction updates the index as it moves
+// them, so the node pointer is a stable handle. Returns 0 on success.
+int enablePointIndex(RedBlackTree *tree) {
+    if (tree->index) return 0;
+    tree->index = (HashIndex *)malloc(sizeof(HashIndex));
+    if (tree->index == NULL || hashIndexInit(tree->index, 1024) != 0) {
+        free(tree->index);
+        tree->index = NULL;
+        return -1;
+    }
+    if (indexNodes(tree, tree->root) != 0) {
+        disablePointIndex(tree);
+        return -1;
+    }
+    return 0;
+}
+
+// Stop maintaining the point index and free it; lookup goes back to
+// searching the tree
+void disablePointIndex(RedBlackTree *tree) {
+    if (tree->index == NULL) return;
+    hashIndexFree(tree->index);
+    free(tree->index);
+    tree->index = NULL;
+}
+
+// Exact-match lookup: through the hash index when there is one, otherwise
+// down the tree. Returns tree->NIL when data is absent, like search.
+Node* lookup(RedBlackTree *tree, int data) {
+    if (tree->index) {
+        Node *node = (Node *)hashIndexFind(tree->index, data);
+        return node ? node : tree->NIL;
+    }
+    return search(tree, tree->root, data);
+}
+
+// Walk the tree and report its memory footprint and shape. Nodes that
+// compaction moved into a pool have no heap block of their own.
+void collectTreeStats(RedBlackTree *tree, Node *node, int depth, TreeStats *stats) {
+    if (node == tree->NIL) return;
+    NodePool *pool = nodePoolSetFind(&tree->pools, node);
+    if (pool != NULL)
+        treeStatsAddNodeBytes(stats, pool->nodeSize, depth, 1);
+    else
+        treeStatsAddNode(stats, node, sizeof(Node), depth, 1);
+    collectTreeStats(tree, node->left, depth + 1, stats);
+    collectTreeStats(tree, node->right, depth + 1, stats);
+}
+
+TreeStats treeStats(RedBlackTree *tree) {
+    TreeStats stats;
+    treeStatsInit(&stats);
+    collectTreeStats(tree, tree->root, 0, &stats);
+    // The tree handle, its sentinel and the pools' own overhead are part of
+    // the footprint too
+    stats.bytesAllocated += allocationBytes(tree, sizeof(RedBlackTree));
+    stats.bytesAllocated += allocationBytes(tree->NIL, sizeof(Node));
+    stats.bytesAllocated += nodePoolSetOverhead(&tree->pools);
+    treeStatsFinish(&stats);
+    return stats;
+}
+
+// Stream the keys in order into a snapshot writer
+void writeSnapshot(RedBlackTree *tree, Node *node, SnapshotWriter *writer) {
+    if (node == tree->NIL) return;
+    writeSnapshot(tree, node->left, writer);
+    snapshotAppend(writer, node->data);
+    writeSnapshot(tree, node->right, writer);
+}
+
+int saveSnapshot(RedBlackTree *tree, const char *path) {
+    SnapshotWriter *writer = snapshotBegin(path);
+    if (writer == NULL) return -1;
+    writeSnapshot(tree, tree->root, writer);
+    return snapshotFinish(writer);
+}
+
+// Free every node, the sentinel and the tree itself
+void freeNodes(RedBlackTree *tree, Node *node) {
+    if (node == tree->NIL) return;
+    freeNodes(tree, node->left);
+    freeNodes(tree, node->right);
+    releaseNode(tree, node);
+}
+
+void destroyTree(RedBlackTree *tree) {
+    freeNodes(tree, tree->root);
+    compactionCancel(&tree->compaction);
+    nodePoolSetDestroy(&tree->pools);
+    disablePointIndex(tree);
+    free(tree->NIL);
+    free(tree);
+}
+
+// Free a node, wherever it was allocated
+void releaseNode(RedBlackTree *tree, Node *node) {
+    if (!nodePoolSetRelease(&tree->pools, node))
+        free(node);
+}
+
+void releaseMovedNode(void *node, void *context) {
+    releaseNode((RedBlackTree *)context, (Node *)node);
+}
+
+// Keep the point index on nodes that compaction moved
+void nodeMoved(void *from, void *to, void *context) {
+    (void)from;
+    RedBlackTree *tree = (RedBlackTree *)context;
+    if (tree->index && hashIndexPut(tree->index, ((Node *)to)->data, to) != 0)
+        disablePointIndex(tree);
+}
+
+long countNodes(RedBlackTree *tree, Node *node) {
+    if (node == tree->NIL) return 0;
+    return 1 + countNodes(tree, node->left) + countNodes(tree, node->right);
+}
+
+// Start moving the tree into a fresh pool in the given order; compactStep
+// does the work. Returns -1 if the compaction cannot start.
+int compactBegin(RedBlackTree *tree, CompactOrder order) {
+    NodeLinks links = { sizeof(Node), offsetof(Node, left), offsetof(Node, right), offsetof(Node, parent),
+                        tree->NIL, releaseMovedNode, nodeMoved, tree };
+    return compactionBegin(&tree->compaction, &tree->pools, &links, order, countNodes(tree, tree->root));
+}
+
+// Examine up to budget nodes of the running compaction; the tree may be
+// updated between calls. Returns 1 once it is done.
+int compactStep(RedBlackTree *tree, long budget) {
+    return compactionStep(&tree->compaction, &tree->pools, &tree->root, tree->modCount, budget);
+}
+
+// Move the whole tree into a fresh pool at once
+void compact(RedBlackTree *tree, CompactOrder order) {
+    if (compactBegin(tree, order) != 0) return;
+    while (!compactStep(tree, LONG_MAX)) {}
+}
+
+// Build a balanced subtree over keys[lo, hi). Splitting at the middle keeps
+// every level above redDepth full, so coloring exactly the nodes on the
+// partial last level red gives every path the same number of black nodes.
+Node* buildSubtree(RedBlackTree *tree, const int *keys, long lo, long hi, int depth, int redDepth, Node *parent) {
+    if (lo >= hi) return tree->NIL;
+    long mid = lo + (hi - lo) / 2;
+    Node *node = createNode(keys[mid], depth == redDepth ? RED : BLACK, tree->NIL);
+    node->parent = parent;
+    node->left = buildSubtree(tree, keys, lo, mid, depth + 1, redDepth, node);
+    node->right = buildSubtree(tree, keys, mid + 1, hi, depth + 1, redDepth, node);
+    return node;
+}
+
+// Load sorted keys into an empty tree in O(n), without any rotations
+void bulkLoad(RedBlackTree *tree, const int *keys, long count) {
+    int fullLevels = 0;
+    while ((2L << fullLevels) - 1 <= count) fullLevels++;
+    tree->modCount++;
+    tree->root = buildSubtree(tree, keys, 0, count, 0, fullLevels, tree->NIL);
+    tree->root->parent = tree->NIL;
+    if (tree->index && indexNodes(tree, tree->root) != 0)
+        disablePointIndex(tree);
+}
+
+typedef struct LogEntry {
+    int key;
+    long sequence;
+    WalOp op;
+} LogEntry;
+
+int compareLogEntries(const void *a, const void *b) {
+    const LogEntry *x = (const LogEntry *)a, *y = (const LogEntry *)b;
+    if (x->key != y->key) return x->key < y->key ? -1 : 1;
+    return x->sequence < y->sequence ? -1 : (x->sequence > y->sequence);
+}
+
+// Rebuild a tree from the most recent snapshot plus the write-ahead log.
+// The log is sorted by key once and merged with the snapshot's sorted keys,
+// keeping the last logged operation per key, and the result is bulk loaded,
+// instead of replaying one insert or delete per record. Replay is
+// idempotent, so a crash between publishing a snapshot and truncating the
+// log only replays updates the snapshot already holds.
+RedBlackTree* recoverTree(const char *snapshotPath, const char *walPath) {
+    Snapshot *snapshot = NULL;
+    if (access(snapshotPath, F_OK) == 0) {
+        snapshot = snapshotOpen(snapshotPath);
+        if (snapshot == NULL) return NULL;
+    }
+    long baseCount = snapshot ? snapshot->keyCount : 0;
+
+    WalRecord *records;
+    long recordCount = walReadAll(walPath, &records);
+    // Cut off a torn tail so new records are appended after intact ones
+    if (access(walPath, F_OK) == 0 && truncate(walPath, (off_t)(recordCount * sizeof(WalRecord))) != 0)
+        perror("Error trimming write-ahead log");
+
+    LogEntry *entries = (LogEntry *)malloc(sizeof(LogEntry) * (recordCount ? recordCount : 1));
+    int *keys = (int *)malloc(sizeof(int) * (baseCount + recordCount + 1));
+    if (entries == NULL || keys == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(1);
+    }
+    for (long i = 0; i < recordCount; i++) {
+        entries[i].key = records[i].key;
+        entries[i].sequence = i;
+        entries[i].op = (WalOp)records[i].op;
+    }
+    free(records);
+    qsort(entries, recordCount, sizeof(LogEntry), compareLogEntries);
+
+    // Merge the snapshot with the last operation logged for each key
+    long count = 0, i = 0, j = 0;
+    while (i < baseCount || j < recordCount) {
+        if (j == recordCount || (i < baseCount && snapshot->keys[i] < entries[j].key)) {
+            keys[count++] = snapshot->keys[i++];
+            continue;
+        }
+        int key = entries[j].key;
+        while (j + 1 < recordCount && entries[j + 1].key == key) j++;
+        if (i < baseCount && snapshot->keys[i] == key) i++;
+        if (entries[j].op == WAL_INSERT) keys[count++] = key;
+        j++;
+    }
+
+    RedBlackTree *tree = initializeTree();
+    bulkLoad(tree, keys, count);
+
+    free(entries);
+    free(keys);
+    snapshotClose(snapshot);
+    return tree;
+}
+
+// Publish a snapshot of the tree and drop the log records it covers
+int checkpointTree(RedBlackTree *tree, const char *snapshotPath) {
+    if (tree->wal && walSync(tree->wal) != 0) return -1;
+    if (saveSnapshot(tree, snapshotPath) != 0) return -1;
+    return tree->wal ? walTruncate(tree->wal) : 0;
+}
+
+// Compare insert throughput with and without the log, then drop the tree
+// as a crash would and time recovery from the snapshot and the log
+void benchmarkDurability(int count, int groupSize) {
+    const char *snapshotPath = "rbtree.snap";
+    const char *walPath = "rbtree.wal";
+    remove(snapshotPath);
+    remove(walPath);
+
+    printf("\nDurability: %d random inserts, at least %d updates per log sync\n", count, groupSize);
+    int *keys = (int *)malloc(sizeof(int) * count);
+    if (keys == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(1);
+    }
+    srand(time(NULL));
+    for (int i = 0; i < count; i++)
+        keys[i] = rand();
+
+    // Every key, then a checkpoint, then a tenth as many inserts of
+    // neighbouring keys and deletes, so recovery has to combine a snapshot
+    // with a log. The inserts run DURABILITY_TRIALS times with and without
+    // the log, alternating, and the best of each counts, so one noisy run
+    // does not decide the overhead; the last logged tree is kept.
+    double plainSeconds = 0, loggedSeconds = 0;
+    RedBlackTree *tree = NULL;
+    int failed = 0;
+    uint64_t start;
+    for (int trial = 0; trial < DURABILITY_TRIALS && !failed; trial++) {
+        RedBlackTree *plain = initializeTree();
+        start = nowNanos();
+        for (int i = 0; i < count; i++)
+            insert(plain, keys[i]);
+        double seconds = (nowNanos() - start) / 1e9;
+        if (trial == 0 || seconds < plainSeconds)
+            plainSeconds = seconds;
+        destroyTree(plain);
+
+        if (tree != NULL) {
+            walClose(tree->wal);
+            destroyTree(tree);
+        }
+        remove(walPath);
+        tree = initializeTree();
+        tree->wal = walOpen(walPath, groupSize);
+        if (tree->wal == NULL) {
+            destroyTree(tree);
+            free(keys);
+            return;
+        }
+        start = nowNanos();
+        for (int i = 0; i < count && !failed; i++)
+            failed = insert(tree, keys[i]) != 0;
+        seconds = (nowNanos() - start) / 1e9;
+        if (trial == 0 || seconds < loggedSeconds)
+            loggedSeconds = seconds;
+    }
+    double overhead = 100.0 * (loggedSeconds - plainSeconds) / plainSeconds;
+    printf("Best insertion time without log: %f seconds, with log: %f seconds (%+.1f%%, %ld syncs), %s the %.0f%% target\n",
+           plainSeconds, loggedSeconds, overhead, tree->wal->syncs,
+           overhead <= WAL_TARGET_OVERHEAD ? "meets" : "misses", WAL_TARGET_OVERHEAD);
+
+    start = nowNanos();
+    checkpointTree(tree, snapshotPath);
+    printf("Checkpoint time: %f seconds\n", (nowNanos() - start) / 1e9);
+
+    for (int i = 0; i < count / 10 && !failed; i++) {
+        failed = insert(tree, keys[i] ^ 1) != 0;
+        Node *victim = search(tree, tree->root, keys[i + count / 2]);
+        if (!failed && victim != tree->NIL)
+            failed = deleteNode(tree, victim) != 0;
+    }
+    if (failed)
+        printf("Write-ahead log failed, later updates were refused\n");
+    long expected = treeStats(tree).keyCount;
+
+    // Crash: drop the tree without a checkpoint. Closing the log only
+    // stands in for the group commits that would have happened anyway.
+    walClose(tree->wal);
+    destroyTree(tree);
+
+    start = nowNanos();
+    RedBlackTree *recovered = recoverTree(snapshotPath, walPath);
+    double recoverySeconds = (nowNanos() - start) / 1e9;
+    if (recovered == NULL) {
+        free(keys);
+        return;
+    }
+    TreeStats stats = treeStats(recovered);
+    printf("Recovery time from snapshot and log: %f seconds, %ld keys (expected %ld)\n",
+           recoverySeconds, stats.keyCount, expected);
+    printTreeStats(&stats, NULL, 1);
+
+    destroyTree(recovered);
+    free(keys);
+}
+
+// Exact-match lookups on a large tree, once down the tree and once through
+// the hash index; half of the probes miss
+void benchmarkPointLookups(int count) {
+    printf("\nPoint lookups: %d keys, %d probes\n", count, count);
+    int *keys = (int *)malloc(sizeof(int) * count);
+    if (keys == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(1);
+    }
+    srand(time(NULL));
+    for (int i = 0; i < count; i++)
+        keys[i] = rand() & ~1;  // Even keys; odd probes always miss
+
+    RedBlackTree *tree = initializeTree();
+    for (int i = 0; i < count; i++)
+        insert(tree, keys[i]);
+
+    long hits = 0;
+    uint64_t start = nowNanos();
+    for (int i = 0; i < count; i++)
+        hits += search(tree, tree->root, keys[i] | (i & 1)) != tree->NIL;
+    double treeNanos = (double)(nowNanos() - start) / count;
+
+    start = nowNanos();
+    if (enablePointIndex(tree) != 0) {
+        destroyTree(tree);
+        free(keys);
+        return;
+    }
+    double buildSeconds = (nowNanos() - start) / 1e9;
+
+    long indexHits = 0;
+    start = nowNanos();
+    for (int i = 0; i < count; i++)
+        indexHits += lookup(tree, keys[i] | (i & 1)) != tree->NIL;
+    double indexNanos = (double)(nowNanos() - start) / count;
+
+    printf("Tree search: %.1f ns per lookup, %ld hits\n", treeNanos, hits);
+    printf("Hash index: %.1f ns per lookup, %ld hits, built in %f seconds\n", indexNanos, indexHits, buildSeconds);
+    TreeStats stats = treeStats(tree);
+    printTreeStats(&stats, NULL, 1);
+    printHashIndexStats(tree->index);
+
+    destroyTree(tree);
+    free(keys);
+}
+
+// Replace updates random keys of the tree: delete one, insert a new one
+void churnTree(RedBlackTree *tree, int *keys, int count, long updates) {
+    for (long i = 0; i < updates; i++) {
+        int slot = rand() % count;
+        Node *node = search(tree, tree->root, keys[slot]);
+        if (node != tree->NIL)
+            deleteNode(tree, node);
+        keys[slot] = rand() & ~1;
+        insert(tree, keys[slot]);
+    }
+}
+
+// Nodes a search for data visits
+long searchPathLength(RedBlackTree *tree, int data) {
+    long visited = 0;
+    for (Node *node = tree->root; node != tree->NIL; ) {
+        visited++;
+        if (data == node->data)
+            break;
+        node = data < node->data ? node->left : node->right;
+    }
+    return visited;
+}
+
+// Time probes searches for current keys, every other one made to miss.
+// Returns the dTLB misses per node visited, or -1 without the counter;
+// the visits are counted afterwards, outside the counted window.
+double timeSearches(RedBlackTree *tree, const int *keys, int count, int *queries, int probes, PerfCounters *counters, const char *phase) {
+    for (int i = 0; i < probes; i++)
+        queries[i] = keys[rand() % count] | (i & 1);
+    long found = 0;
+    uint64_t start = nowNanos();
+    perfStart(counters);
+    for (int i = 0; i < probes; i++)
+        found += search(tree, tree->root, queries[i]) != tree->NIL;
+    perfStop(counters);
+    printf("%s: %.1f ns per search, %ld found\n", phase, (double)(nowNanos() - start) / probes, found);
+    perfReport(counters, phase, probes);
+    long visited = 0;
+    for (int i = 0; i < probes; i++)
+        visited += searchPathLength(tree, queries[i]);
+    return perfDtlbMissRate(counters, phase, (double)visited);
+}
+
+// Searches on a tree whose nodes churn has scattered over the heap, then
+// after compacting it in DFS and in BFS order, in DFS order again on huge
+// pages, and after an incremental compaction that runs between further
+// updates
+void benchmarkCompaction(int count, int probes) {
+    printf("\nCompaction: %d keys, %d probes\n", count, probes);
+    int *keys = (int *)malloc(sizeof(int) * count);
+    int *queries = (int *)malloc(sizeof(int) * probes);
+    if (keys == NULL || queries == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(1);
+    }
+    PerfCounters counters;
+    perfOpen(&counters);
+
+    RedBlackTree *tree = initializeTree();
+    for (int i = 0; i < count; i++) {
+        keys[i] = rand() & ~1;
+        insert(tree, keys[i]);
+    }
+    churnTree(tree, keys, count, 2L * count);
+    timeSearches(tree, keys, count, queries, probes, &counters, "Search after churn");
+
+    double smallPageRate = -1;
+    for (int order = COMPACT_DFS; order <= COMPACT_BFS; order++) {
+        uint64_t start = nowNanos();
+        compact(tree, (CompactOrder)order);
+        printf("Compaction time: %f seconds\n", (nowNanos() - start) / 1e9);
+        printCompactionStats(&tree->compaction, &tree->pools);
+        TreeStats stats = treeStats(tree);
+        printTreeStats(&stats, NULL, 1);
+        double rate = timeSearches(tree, keys, count, queries, probes, &counters,
+                                   order == COMPACT_DFS ? "Search after DFS compaction" : "Search after BFS compaction");
+        if (order == COMPACT_DFS)
+            smallPageRate = rate;
+    }
+
+    // The same DFS layout on 2 MB pages, so a descent needs far fewer dTLB entries
+    tree->pools.hugePages = 1;
+    uint64_t hugeStart = nowNanos();
+    compact(tree, COMPACT_DFS);
+    printf("Compaction time: %f seconds\n", (nowNanos() - hugeStart) / 1e9);
+    printCompactionStats(&tree->compaction, &tree->pools);
+    TreeStats hugeStats = treeStats(tree);
+    printTreeStats(&hugeStats, NULL, 1);
+    double hugePageRate = timeSearches(tree, keys, count, queries, probes, &counters, "Search after DFS compaction on huge pages");
+    tree->pools.hugePages = 0;
+    perfCompareDtlbRates(smallPageRate, hugePageRate);
+
+    // Scatter the tree again, then run the first pass of a compaction a
+    // slice at a time between batches of updates, and let it finish once
+    // the updates stop
+    churnTree(tree, keys, count, 2L * count);
+    timeSearches(tree, keys, count, queries, probes, &counters, "Search after more churn");
+    long steps = 0, updates = 0;
+    int done = compactBegin(tree, COMPACT_DFS) != 0;
+    for (; !done && tree->compaction.passes < 2; steps++) {
+        churnTree(tree, keys, count, 64);
+        updates += 64;
+        done = compactStep(tree, COMPACTION_BUDGET);
+    }
+    long finishSteps = 0;
+    for (; !done; finishSteps++)
+        done = compactStep(tree, COMPACTION_BUDGET);
+    printf("Incremental compaction: %ld steps of %d nodes between %ld updates, %ld more to finish\n",
+           steps, COMPACTION_BUDGET, updates, finishSteps);
+    printCompactionStats(&tree->compaction, &tree->pools);
+    TreeStats incrementalStats = treeStats(tree);
+    printTreeStats(&incrementalStats, NULL, 1);
+    timeSearches(tree, keys, count, queries, probes, &counters, "Search after incremental compaction");
+
+    destroyTree(tree);
+    perfClose(&counters);
+    free(keys);
+    free(queries);
+}
+
 // Generate files
 void generateFiles() {
     FILE *f;
@@ -320,38 +940,99 @@ void generateFiles() {
     fclose(f);
 }
 
+// Replay the file's operations on a second tree that has seen the same
+// files, with a clock read around each one. The counted phases of
+// performOperations run without them, so the hardware counters do not
+// include the timer calls.
+void recordLatencies(FILE *f, RedBlackTree *tree, LatencyHistogram *latency) {
+    int num;
+    rewind(f);
+    while (fscanf(f, "%d", &num) != EOF) {
+        uint64_t opStart = nowNanos();
+        insert(tree, num);
+        histogramRecord(&latency[OP_INSERT], nowNanos() - opStart);
+    }
+
+    uint64_t opStart = nowNanos();
+    Node *result = lookup(tree, 50);
+    histogramRecord(&latency[OP_SEARCH], nowNanos() - opStart);
+
+    if (result != tree->NIL) {
+        opStart = nowNanos();
+        deleteNode(tree, result);
+        histogramRecord(&latency[OP_DELETE], nowNanos() - opStart);
+    }
+}
+
 // Perform operations
-void performOperations(const char *filename, RedBlackTree *tree) {
+void performOperations(const char *filename, RedBlackTree *tree, RedBlackTree *timingTree, PerfCounters *counters, LatencyHistogram *totalLatency) {
     FILE *f = fopen(filename, "r");
     if (!f) {
         printf("Error opening file: %s\n", filename);
         return;
     }
 
+    static LatencyHistogram latency[OP_TYPE_COUNT];
+    for (int op = 0; op < OP_TYPE_COUNT; op++) histogramInit(&latency[op]);
+
     // Measure insertion time
     clock_t start, end;
-    int num;
+    int num, count = 0;
+    resetOpCounters(&tree->opCounters);
     start = clock();
+    perfStart(counters);
     while (fscanf(f, "%d", &num) != EOF) {
         insert(tree, num);
+        count++;
     }
+    perfStop(counters);
     end = clock();
     printf("Insertion time: %lf seconds\n", (double)(end - start) / CLOCKS_PER_SEC);
+    perfReport(counters, "Insertion", count);
+    printOpCounters("Insertion", &tree->opCounters, count);
+    TreeStats stats = treeStats(tree);
+    printTreeStats(&stats, NULL, 1);
+    if (tree->index) printHashIndexStats(tree->index);
+
+    // Snapshot the tree and serve the same lookups from the mapped image
+    char snapshotPath[256];
+    snprintf(snapshotPath, sizeof(snapshotPath), "%s.snap", filename);
+    start = clock();
+    int saved = saveSnapshot(tree, snapshotPath);
+    end = clock();
+    printf("Snapshot write time: %lf seconds\n", (double)(end - start) / CLOCKS_PER_SEC);
+    if (saved == 0) snapshotBenchmark(snapshotPath, 50, 25, 75);
+    recordLatencies(f, timingTree, latency);
     fclose(f);
 
     // Measure search time
+    resetOpCounters(&tree->opCounters);
     start = clock();
-    Node *result = search(tree, tree->root, 50);
+    perfStart(counters);
+    Node *result = lookup(tree, 50);
+    perfStop(counters);
     end = clock();
     printf("Search time: %lf seconds\n", (double)(end - start) / CLOCKS_PER_SEC);
+    perfReport(counters, "Search", 1);
+    printOpCounters("Search", &tree->opCounters, 1);
 
     // Measure deletion time
     if (result != tree->NIL) {
+        resetOpCounters(&tree->opCounters);
         start = clock();
+        perfStart(counters);
         deleteNode(tree, result);
+        perfStop(counters);
         end = clock();
         printf("Deletion time: %lf seconds\n", (double)(end - start) / CLOCKS_PER_SEC);
+        perfReport(counters, "Deletion", 1);
+        printOpCounters("Deletion", &tree->opCounters, 1);
     } else {
         printf("Node 50 not found for deletion.\n");
     }
+
+    for (int op = 0; op < OP_TYPE_COUNT; op++) {
+        histogramPrint(&latency[op], opTypeNames[op]);
+        histogramMerge(&totalLatency[op], &latency[op]);
+    }
 }
@@ -0,0 +1,401 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "learned_index.h"
+#include "eytzinger.h"
+
+// On-disk snapshot of a tree's keys. The image holds no pointers, only
+// offsets from the start of the file, so it can be mapped read-only at any
+// address and searched in place:
+//
+//   [SnapshotHeader, 64 bytes][sorted keys][padding to 64][fence keys]
+//
+// The fence array holds every SNAPSHOT_FENCE_STRIDE-th key. A lookup binary
+// searches the small fence array first and then a single block of keys, so
+// the big array is touched in one or two cache lines per level.
+#define SNAPSHOT_MAGIC "ADSSNAP1"
+#define SNAPSHOT_VERSION 1
+#define SNAPSHOT_FENCE_STRIDE 64
+
+typedef struct SnapshotHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t keySize;
+    uint64_t keyCount;
+    uint64_t keysOffset;
+    uint64_t fenceCount;
+    uint64_t fenceOffset;
+    uint32_t fenceStride;
+    uint32_t reserved[3];
+} SnapshotHeader;
+
+typedef struct SnapshotWriter {
+    FILE* file;
+    char* path;
+    char* tmpPath;
+    uint64_t keyCount;
+    int32_t lastKey;
+    int32_t* fences;
+    uint64_t fenceCount, fenceCapacity;
+    int failed;  // A key was rejected; snapshotFinish discards the image
+} SnapshotWriter;
+
+typedef struct Snapshot {
+    void* map;
+    size_t mapSize;
+    const SnapshotHeader* header;
+    const int32_t* keys;
+    const int32_t* fences;
+    long keyCount;
+    long fenceCount;
+} Snapshot;
+
+typedef void (*SnapshotVisitor)(int key, void* context);
+
+// Start a snapshot at path. The image is written to path.tmp and renamed
+// over path by snapshotFinish, so readers never see a partial file.
+static SnapshotWriter* snapshotBegin(const char* path) {
+    SnapshotWriter* writer = (SnapshotWriter*)calloc(1, sizeof(SnapshotWriter));
+    if (writer == NULL) return NULL;
+
+    size_t len = strlen(path);
+    writer->path = (char*)malloc(len + 1);
+    writer->tmpPath = (char*)malloc(len + 5);
+    if (writer->path == NULL || writer->tmpPath == NULL) {
+        free(writer->path);
+        free(writer->tmpPath);
+        free(writer);
+        return NULL;
+    }
+    memcpy(writer->path, path, len + 1);
+    snprintf(writer->tmpPath, len + 5, "%s.tmp", path);
+
+    writer->file = fopen(writer->tmpPath, "wb");
+    if (writer->file == NULL) {
+        perror("Error creating snapshot");
+        free(writer->path);
+        free(writer->tmpPath);
+        free(writer);
+        return NULL;
+    }
+
+    // Placeholder, rewritten once the counts are known
+    SnapshotHeader header;
+    memset(&header, 0, sizeof(header));
+    fwrite(&header, sizeof(header), 1, writer->file);
+    return writer;
+}
+
+// Append the next key of an in-order traversal. Keys must arrive in
+// non-decreasing order; repeats of the previous key are dropped so engines
+// that keep duplicates still produce a set. A key out of order fails the
+// whole snapshot rather than leaving a hole in it.
+static void snapshotAppend(SnapshotWriter* writer, int key) {
+    if (writer->failed) return;
+    if (writer->keyCount > 0) {
+        if (key == writer->lastKey) return;
+        if (key < writer->lastKey) {
+            fprintf(stderr, "Snapshot keys out of order: %d after %d\n", key, writer->lastKey);
+            writer->failed = 1;
+            return;
+        }
+    }
+
+    if (writer->keyCount % SNAPSHOT_FENCE_STRIDE == 0) {
+        if (writer->fenceCount == writer->fenceCapacity) {
+            uint64_t capacity = writer->fenceCapacity ? writer->fenceCapacity * 2 : 64;
+            int32_t* fences = (int32_t*)realloc(writer->fences, capacity * sizeof(int32_t));
+            if (fences == NULL) {
+                fprintf(stderr, "Memory allocation failed\n");
+                writer->failed = 1;
+                return;
+            }
+            writer->fences = fences;
+            writer->fenceCapacity = capacity;
+        }
+        writer->fences[writer->fenceCount++] = key;
+    }
+
+    int32_t value = key;
+    fwrite(&value, sizeof(value), 1, writer->file);
+    writer->lastKey = key;
+    writer->keyCount++;
+}
+
+static void snapshotWriterFree(SnapshotWriter* writer) {
+    free(writer->fences);
+    free(writer->path);
+    free(writer->tmpPath);
+    free(writer);
+}
+
+// Write the fence index and header, flush the image to disk and publish it.
+// Returns 0 on success, -1 on failure, including a key rejected by
+// snapshotAppend; the path is then left as it was.
+static int snapshotFinish(SnapshotWriter* writer) {
+    if (writer->failed) {
+        fclose(writer->file);
+        remove(writer->tmpPath);
+        snapshotWriterFree(writer);
+        return -1;
+    }
+
+    SnapshotHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = SNAPSHOT_VERSION;
+    header.keySize = sizeof(int32_t);
+    header.keyCount = writer->keyCount;
+    header.keysOffset = sizeof(SnapshotHeader);
+    header.fenceStride = SNAPSHOT_FENCE_STRIDE;
+    header.fenceCount = writer->fenceCount;
+
+    uint64_t end = header.keysOffset + writer->keyCount * sizeof(int32_t);
+    header.fenceOffset = (end + 63) & ~(uint64_t)63;
+    static const char zeros[64];
+    fwrite(zeros, 1, header.fenceOffset - end, writer->file);
+    fwrite(writer->fences, sizeof(int32_t), writer->fenceCount, writer->file);
+
+    int ok = !ferror(writer->file)
+          && fseek(writer->file, 0, SEEK_SET) == 0
+          && fwrite(&header, sizeof(header), 1, writer->file) == 1
+          && fflush(writer->file) == 0
+          && fsync(fileno(writer->file)) == 0;
+    ok = (fclose(writer->file) == 0) && ok;
+    if (ok && rename(writer->tmpPath, writer->path) != 0) ok = 0;
+    if (!ok) {
+        perror("Error writing snapshot");
+        remove(writer->tmpPath);
+    }
+
+    snapshotWriterFree(writer);
+    return ok ? 0 : -1;
+}
+
+// Whether an array of count keys at offset lies inside a file of size bytes
+// and is aligned for the key type. Written as subtractions so that a
+// crafted header cannot overflow the sums.
+static int snapshotArrayFits(uint64_t offset, uint64_t count, size_t size) {
+    return offset % sizeof(int32_t) == 0 && offset <= size && count <= (size - offset) / sizeof(int32_t);
+}
+
+// Map a snapshot read-only. Nothing is copied or rebuilt: the returned
+// handle points straight into the mapping.
+static Snapshot* snapshotOpen(const char* path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        perror("Error opening snapshot");
+        return NULL;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(SnapshotHeader)) {
+        fprintf(stderr, "Snapshot %s is truncated\n", path);
+        close(fd);
+        return NULL;
+    }
+
+    void* map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        perror("Error mapping snapshot");
+        return NULL;
+    }
+
+    const SnapshotHeader* header = (const SnapshotHeader*)map;
+    size_t size = (size_t)st.st_size;
+    if (memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(header->magic)) != 0
+        || header->version != SNAPSHOT_VERSION
+        || header->keySize != sizeof(int32_t)
+        || header->fenceStride != SNAPSHOT_FENCE_STRIDE
+        || !snapshotArrayFits(header->keysOffset, header->keyCount, size)
+        || !snapshotArrayFits(header->fenceOffset, header->fenceCount, size)
+        || header->fenceCount != (header->keyCount + SNAPSHOT_FENCE_STRIDE - 1) / SNAPSHOT_FENCE_STRIDE) {
+        fprintf(stderr, "Snapshot %s is not a valid image\n", path);
+        munmap(map, size);
+        return NULL;
+    }
+
+    Snapshot* snapshot = (Snapshot*)malloc(sizeof(Snapshot));
+    if (snapshot == NULL) {
+        munmap(map, size);
+        return NULL;
+    }
+    snapshot->map = map;
+    snapshot->mapSize = size;
+    snapshot->header = header;
+    snapshot->keys = (const int32_t*)((const char*)map + header->keysOffset);
+    snapshot->fences = (const int32_t*)((const char*)map + header->fenceOffset);
+    snapshot->keyCount = (long)header->keyCount;
+    snapshot->fenceCount = (long)header->fenceCount;
+    return snapshot;
+}
+
+static void snapshotClose(Snapshot* snapshot) {
+    if (snapshot == NULL) return;
+    munmap(snapshot->map, snapshot->mapSize);
+    free(snapshot);
+}
+
+// Position of the first key >= key, or keyCount if there is none
+static long snapshotLowerBound(const Snapshot* snapshot, int key) {
+    // Last fence <= key picks the block
+    long lo = 0, hi = snapshot->fenceCount;
+    while (lo < hi) {
+        long mid = lo + (hi - lo) / 2;
+        if (snapshot->fences[mid] <= key) lo = mid + 1;
+        else hi = mid;
+    }
+    long begin = lo == 0 ? 0 : (lo - 1) * SNAPSHOT_FENCE_STRIDE;
+    long end = begin + SNAPSHOT_FENCE_STRIDE;
+    if (end > snapshot->keyCount) end = snapshot->keyCount;
+
+    while (begin < end) {
+        long mid = begin + (end - begin) / 2;
+        if (snapshot->keys[mid] < key) begin = mid + 1;
+        else end = mid;
+    }
+    return begin;
+}
+
+// Position of key in the snapshot, or -1 if it is absent
+static long snapshotSearch(const Snapshot* snapshot, int key) {
+    long pos = snapshotLowerBound(snapshot, key);
+    if (pos < snapshot->keyCount && snapshot->keys[pos] == key) return pos;
+    return -1;
+}
+
+// Visit every key in [low, high] in order; returns the number of keys.
+// visit may be NULL to only count them.
+static long snapshotRangeScan(const Snapshot* snapshot, int low, int high, SnapshotVisitor visit, void* context) {
+    long count = 0;
+    for (long pos = snapshotLowerBound(snapshot, low); pos < snapshot->keyCount && snapshot->keys[pos] <= high; pos++) {
+        if (visit) visit(snapshot->keys[pos], context);
+        count++;
+    }
+    return count;
+}
+
+static double snapshotSeconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Time a batch of point lookups, alternating stored keys and keys just past
+// them, through the fence search and through the learned index
+static void snapshotCompareLearned(const Snapshot* snapshot, const LearnedIndex* learned) {
+    long probes = snapshot->keyCount < 200000 ? 200000 : snapshot->keyCount;
+    long fenceFound = 0, learnedFound = 0, mismatches = 0;
+
+    double start = snapshotSeconds();
+    for (long i = 0; i < probes; i++) {
+        int key = snapshot->keys[(i * 7919) % snapshot->keyCount];
+        if ((i & 1) && key < INT32_MAX) key++;
+        fenceFound += snapshotSearch(snapshot, key) >= 0;
+    }
+    double fenceNanos = (snapshotSeconds() - start) * 1e9 / probes;
+
+    start = snapshotSeconds();
+    for (long i = 0; i < probes; i++) {
+        int key = snapshot->keys[(i * 7919) % snapshot->keyCount];
+        if ((i & 1) && key < INT32_MAX) key++;
+        learnedFound += learnedIndexSearch(learned, key) >= 0;
+    }
+    double learnedNanos = (snapshotSeconds() - start) * 1e9 / probes;
+
+    for (long i = 0; i < snapshot->keyCount; i += 1 + snapshot->keyCount / 4096) {
+        if (learnedIndexLowerBound(learned, snapshot->keys[i]) != snapshotLowerBound(snapshot, snapshot->keys[i])) mismatches++;
+    }
+    printf("Snapshot point lookups: %ld probes, fence search %.1f ns (%ld found), learned index %.1f ns (%ld found)%s\n",
+           probes, fenceNanos, fenceFound, learnedNanos, learnedFound, mismatches ? ", RESULTS DIFFER" : "");
+}
+
+// The same probes against an Eytzinger copy of the keys, the layout a
+// read-only replica would serve from: one key at a time, then in batches
+// of eight
+static void snapshotCompareEytzinger(const Snapshot* snapshot, const Eytzinger* tree) {
+    long probes = snapshot->keyCount < 200000 ? 200000 : snapshot->keyCount;
+    int* keys = (int*)malloc(sizeof(int) * probes);
+    int* found = (int*)malloc(sizeof(int) * probes);
+    if (keys == NULL || found == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        free(keys);
+        free(found);
+        return;
+    }
+    for (long i = 0; i < probes; i++) {
+        keys[i] = snapshot->keys[(i * 7919) % snapshot->keyCount];
+        if ((i & 1) && keys[i] < INT32_MAX) keys[i]++;
+    }
+
+    long scalarFound = 0, mismatches = 0;
+    double start = snapshotSeconds();
+    for (long i = 0; i < probes; i++) scalarFound += eytzingerContains(tree, keys[i]);
+    double scalarNanos = (snapshotSeconds() - start) * 1e9 / probes;
+
+    start = snapshotSeconds();
+    long batchFound = eytzingerContainsBatch(tree, keys, found, probes);
+    double batchNanos = (snapshotSeconds() - start) * 1e9 / probes;
+
+    for (long i = 0; i < probes; i += 1 + probes / 4096) {
+        if (found[i] != (snapshotSearch(snapshot, keys[i]) >= 0)) mismatches++;
+    }
+    printf("Eytzinger copy: bytes=%zu, branchless search %.1f ns (%ld found), %s batches of %d %.1f ns (%ld found)%s\n",
+           eytzingerBytes(tree), scalarNanos, scalarFound, eytzingerBatchPath(), EYTZINGER_BATCH, batchNanos, batchFound,
+           mismatches || scalarFound != batchFound ? ", RESULTS DIFFER" : "");
+    free(keys);
+    free(found);
+}
+
+// Reopen a freshly written snapshot and serve a point lookup and a range
+// scan from the mapping, printing the timings next to the tree's own
+static void snapshotBenchmark(const char* path, int key, int low, int high) {
+    clock_t start = clock();
+    Snapshot* snapshot = snapshotOpen(path);
+    clock_t end = clock();
+    if (snapshot == NULL) return;
+    printf("Snapshot open time for %ld keys: %f seconds\n", snapshot->keyCount, ((double)(end - start)) / CLOCKS_PER_SEC);
+
+    start = clock();
+    long pos = snapshotSearch(snapshot, key);
+    end = clock();
+    printf("Snapshot search for value %d: %s, %f seconds\n", key, pos >= 0 ? "found" : "not found", ((double)(end - start)) / CLOCKS_PER_SEC);
+
+    start = clock();
+    long count = snapshotRangeScan(snapshot, low, high, NULL, NULL);
+    end = clock();
+    printf("Snapshot range scan [%d, %d]: %ld keys, %f seconds\n", low, high, count, ((double)(end - start)) / CLOCKS_PER_SEC);
+
+    if (snapshot->keyCount > 0) {
+        LearnedIndex learned;
+        start = clock();
+        int built = learnedIndexBuild(&learned, snapshot->keys, snapshot->keyCount);
+        end = clock();
+        if (built == 0) {
+            printf("Learned index build time: %f seconds\n", ((double)(end - start)) / CLOCKS_PER_SEC);
+            printLearnedIndexStats(&learned);
+            snapshotCompareLearned(snapshot, &learned);
+            learnedIndexFree(&learned);
+        }
+
+        Eytzinger tree;
+        if (eytzingerBuild(&tree, snapshot->keys, snapshot->keyCount) == 0) {
+            snapshotCompareEytzinger(snapshot, &tree);
+            eytzingerFree(&tree);
+        }
+    }
+
+    snapshotClose(snapshot);
+}
+
+#endif
@@ -1,6 +1,12 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <time.h>
+#include "perf_counters.h"
+#include "op_counters.h"
+#include "latency_histogram.h"
+#include "tree_stats.h"
+#include "snapshot.h"
+#include "bloom_filter.h"
 
 // Node structure for the splay tree
 typedef struct Node {
@@ -8,6 +14,9 @@ typedef struct Node {
     struct Node *left, *right;
 } Node;
 
+OpCounters opCounters;  // Structural counters for the tree being benchmarked
+BloomFilter* missFilter;  // Screens out absent keys before splaying; NULL when disabled
+
 // Function to create a new node
 Node* createNode(int key) {
     Node* newNode = (Node*)malloc(sizeof(Node));
@@ -18,6 +27,7 @@ Node* createNode(int key) {
 
 // Right rotate function
 Node* rightRotate(Node* x) {
+    COUNT_OP(opCounters, rotations);
     Node* y = x->left;
     x->left = y->right;
     y->right = x;
@@ -26,6 +36,7 @@ Node* rightRotate(Node* x) {
 
 // Left rotate function
 Node* leftRotate(Node* x) {
+    COUNT_OP(opCounters, rotations);
     Node* y = x->right;
     x->right = y->left;
     y->left = x;
@@ -34,13 +45,17 @@ Node* leftRotate(Node* x) {
 
 // Splay function to bring a key to the root
 Node* splay(Node* root, int key) {
-    if (root == NULL || root->key == key)
+    if (root == NULL) return root;
+
+    COUNT_OP(opCounters, comparisons);
+    if (root->key == key)
         return root;
 
     // Key lies in the left subtree
     if (key < root->key) {
         if (root->left == NULL) return root;
 
+        COUNT_OP(opCounters, comparisons);
         // Zig-Zig (Left Left)
         if (key < root->left->key) {
             root->left->left = splay(root->left->left, key);
@@ -58,6 +73,7 @@ Node* splay(Node* root, int key) {
     else { // Key lies in the right subtree
         if (root->right == NULL) return root;
 
+        COUNT_OP(opCounters, comparisons);
         // Zag-Zig (Right Left)
         if (key < root->right->key) {
             root->right->left = splay(root->right->left, key);
@@ -76,12 +92,16 @@ Node* splay(Node* root, int key) {
 
 // Insert a key into the splay tree
 Node* insert(Node* root, int key) {
-    if (root == NULL) return createNode(key);
+    if (root == NULL) {
+        if (missFilter != NULL) bloomFilterAdd(missFilter, key);
+        return createNode(key);
+    }
 
     root = splay(root, key);
 
     if (root->key == key) return root;
 
+    if (missFilter != NULL) bloomFilterAdd(missFilter, key);
     Node* newNode = createNode(key);
 
     if (key < root->key) {
@@ -105,6 +125,7 @@ Node* delete(Node* root, int key) {
 
     if (root->key != key) return root;
 
+    if (missFilter != NULL) bloomFilterNoteDelete(missFilter);
     if (root->left == NULL) {
         Node* temp = root->right;
         free(root);
@@ -122,6 +143,44 @@ Node* search(Node* root, int key) {
     return splay(root, key);
 }
 
+void addFilterKeys(Node* node, BloomFilter* filter) {
+    if (node == NULL) return;
+    addFilterKeys(node->left, filter);
+    bloomFilterAdd(filter, node->key);
+    addFilterKeys(node->right, filter);
+}
+
+int countNodes(Node* node) {
+    if (node == NULL) return 0;
+    return 1 + countNodes(node->left) + countNodes(node->right);
+}
+
+// Drop the bits of deleted keys by refilling the filter from the tree
+void rebuildMissFilter(Node* root) {
+    if (bloomFilterReset(missFilter, countNodes(root)) != 0) return;
+    addFilterKeys(root, missFilter);
+    missFilter->rebuilds++;
+}
+
+// Search through the filter. Like search, returns the new root, which holds
+// key when it is present; a key ruled out by the filter leaves the tree as
+// it was instead of splaying its nearest neighbour up
+Node* lookup(Node* root, int key) {
+    if (missFilter == NULL) return search(root, key);
+    if (bloomFilterStale(missFilter)) rebuildMissFilter(root);
+    if (!bloomFilterMayContain(missFilter, key)) return root;
+    root = search(root, key);
+    if (root == NULL || root->key != key) bloomFilterFalsePositive(missFilter);
+    return root;
+}
+
+void freeTree(Node* node) {
+    if (node == NULL) return;
+    freeTree(node->left);
+    freeTree(node->right);
+    free(node);
+}
+
 // In-order traversal to display the tree
 void inOrder(Node* root) {
     if (root == NULL) return;
@@ -130,8 +189,105 @@ void inOrder(Node* root) {
     inOrder(root->right);
 }
 
+// Walk the tree and report its memory footprint and shape
+void collectTreeStats(Node* node, int depth, TreeStats* stats) {
+    if (node == NULL) return;
+    treeStatsAddNode(stats, node, sizeof(Node), depth, 1);
+    collectTreeStats(node->left, depth + 1, stats);
+    collectTreeStats(node->right, depth + 1, stats);
+}
+
+TreeStats treeStats(Node* root) {
+    TreeStats stats;
+    treeStatsInit(&stats);
+    collectTreeStats(root, 0, &stats);
+    treeStatsFinish(&stats);
+    return stats;
+}
+
+// Stream the keys in order into a snapshot writer
+void writeSnapshot(Node* node, SnapshotWriter* writer) {
+    if (node == NULL) return;
+    writeSnapshot(node->left, writer);
+    snapshotAppend(writer, node->key);
+    writeSnapshot(node->right, writer);
+}
+
+int saveSnapshot(Node* root, const char* path) {
+    SnapshotWriter* writer = snapshotBegin(path);
+    if (writer == NULL) return -1;
+    writeSnapshot(root, writer);
+    return snapshotFinish(writer);
+}
+
+// Probe keys over four times the key range, so most of them miss, once
+// with a plain splay and once through the filter
+Node* benchmarkMissLookups(Node* root, int range, int probes) {
+    int* keys = (int*)malloc(sizeof(int) * probes);
+    if (keys == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return root;
+    }
+    for (int i = 0; i < probes; i++) keys[i] = rand() % (4 * range);
+
+    long found = 0;
+    uint64_t start = nowNanos();
+    for (int i = 0; i < probes; i++) {
+        root = search(root, keys[i]);
+        found += root != NULL && root->key == keys[i];
+    }
+    double searchNanos = (double)(nowNanos() - start) / probes;
+
+    long filteredFound = 0;
+    start = nowNanos();
+    for (int i = 0; i < probes; i++) {
+        root = lookup(root, keys[i]);
+        filteredFound += root != NULL && root->key == keys[i];
+    }
+    double lookupNanos = (double)(nowNanos() - start) / probes;
+
+    printf("Miss-heavy lookups: %d probes, %ld hits, search %.1f ns, filtered %.1f ns (%ld hits)\n",
+           probes, found, searchNanos, lookupNanos, filteredFound);
+    free(keys);
+    return root;
+}
+
+// Replay the file's operations on a scratch tree, with a miss filter of its
+// own and a clock read around each one, outside the windows the hardware
+// counters cover
+void recordLatencies(FILE* file, LatencyHistogram latency[]) {
+    BloomFilter* measuredFilter = missFilter;
+    BloomFilter filter;
+    missFilter = bloomFilterInit(&filter, 1024, BLOOM_BITS_PER_KEY) == 0 ? &filter : NULL;
+    Node* root = NULL;
+    int number;
+    rewind(file);
+    while (fscanf(file, "%d,", &number) == 1) {
+        uint64_t opStart = nowNanos();
+        root = insert(root, number);
+        histogramRecord(&latency[OP_INSERT], nowNanos() - opStart);
+    }
+
+    uint64_t opStart = nowNanos();
+    root = lookup(root, 500);
+    histogramRecord(&latency[OP_SEARCH], nowNanos() - opStart);
+
+    opStart = nowNanos();
+    root = delete(root, 500);
+    histogramRecord(&latency[OP_DELETE], nowNanos() - opStart);
+
+    freeTree(root);
+    if (missFilter != NULL) bloomFilterFree(missFilter);
+    missFilter = measuredFilter;
+}
+
 void processFiles(const char* files[], int fileCount) {
     Node* root = NULL;
+    BloomFilter filter;
+    PerfCounters counters;
+    perfOpen(&counters);
+    static LatencyHistogram latency[OP_TYPE_COUNT], totalLatency[OP_TYPE_COUNT];
+    for (int op = 0; op < OP_TYPE_COUNT; op++) histogramInit(&totalLatency[op]);
 
     for (int i = 0; i < fileCount; i++) {
         FILE* file = fopen(files[i], "r");
@@ -145,36 +301,81 @@ void processFiles(const char* files[], int fileCount) {
         int number, nodeCount = 0;
         clock_t start, end;
 
+        for (int op = 0; op < OP_TYPE_COUNT; op++) histogramInit(&latency[op]);
+        missFilter = bloomFilterInit(&filter, 1024, BLOOM_BITS_PER_KEY) == 0 ? &filter : NULL;
+
         // Insertion time
+        resetOpCounters(&opCounters);
         start = clock();
+        perfStart(&counters);
         while (fscanf(file, "%d,", &number) == 1) {
             root = insert(root, number);
             nodeCount++;
         }
+        perfStop(&counters);
         end = clock();
         printf("Insertion time for %d nodes: %f seconds\n", nodeCount, ((double)(end - start)) / CLOCKS_PER_SEC);
+        perfReport(&counters, "Insertion", nodeCount);
+        printOpCounters("Insertion", &opCounters, nodeCount);
+        TreeStats stats = treeStats(root);
+        printTreeStats(&stats, NULL, 1);
+
+        // Snapshot the tree and serve the same lookups from the mapped image
+        char snapshotPath[256];
+        snprintf(snapshotPath, sizeof(snapshotPath), "%s.snap", files[i]);
+        start = clock();
+        int saved = saveSnapshot(root, snapshotPath);
+        end = clock();
+        printf("Snapshot write time: %f seconds\n", ((double)(end - start)) / CLOCKS_PER_SEC);
+        if (saved == 0) snapshotBenchmark(snapshotPath, 500, 250, 750);
 
         // Search time for node with value 500
         // note: for random number file value 500 may not be present everytime so please change this value depending on the elemen you want to delete
+        resetOpCounters(&opCounters);
         start = clock();
-        Node* foundNode = search(root, 500);
+        perfStart(&counters);
+        // Splaying moves the root, and a miss still returns a node
+        root = lookup(root, 500);
+        perfStop(&counters);
         end = clock();
-        if (foundNode != NULL) {
+        if (root != NULL && root->key == 500) {
             printf("Node with value 500 found.\n");
         } else {
             printf("Node with value 500 not found.\n");
         }
         printf("Search time for node with value 500: %f seconds\n", ((double)(end - start)) / CLOCKS_PER_SEC);
+        perfReport(&counters, "Search", 1);
+        printOpCounters("Search", &opCounters, 1);
 
         // Deletion time for node with value 500
+        resetOpCounters(&opCounters);
         start = clock();
+        perfStart(&counters);
         root = delete(root, 500);
+        perfStop(&counters);
         end = clock();
         printf("Deletion time for node with value 500: %f seconds\n", ((double)(end - start)) / CLOCKS_PER_SEC);
+        perfReport(&counters, "Deletion", 1);
+        printOpCounters("Deletion", &opCounters, 1);
+
+        root = benchmarkMissLookups(root, 1000, 100000);
+        if (missFilter != NULL) printBloomFilterStats(missFilter);
+
+        recordLatencies(file, latency);
+        for (int op = 0; op < OP_TYPE_COUNT; op++) {
+            histogramPrint(&latency[op], opTypeNames[op]);
+            histogramMerge(&totalLatency[op], &latency[op]);
+        }
 
         fclose(file);
+        if (missFilter != NULL) bloomFilterFree(missFilter);
+        missFilter = NULL;
         root = NULL; // Reset the tree for the next file
     }
+
+    printf("\nLatency over all files:\n");
+    for (int op = 0; op < OP_TYPE_COUNT; op++) histogramPrint(&totalLatency[op], opTypeNames[op]);
+    perfClose(&counters);
 }
 
 int main() {
@@ -0,0 +1,646 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include "tree_stats.h"
+
+// B-tree over string keys, laid out for long keys with heavy shared
+// prefixes such as URLs. Each node stores the prefix its keys have in
+// common once, followed by the remaining suffix of every key, all in a
+// single buffer. Next to that it keeps an 8-byte abbreviation of every
+// suffix, so a binary search inside a node compares integers and only
+// touches the suffix bytes when two abbreviations tie.
+//
+// Updates edit the encoded node in place: a new key moves the suffixes
+// after it up and shifts the offsets and abbreviations, and a removed key
+// closes the gap. The common prefix only has to be recomputed when the
+// first or last key changes, since every key in between shares what those
+// two share; only then are the suffixes rewritten for the new prefix.
+#define MIN_DEGREE 16
+#define MAX_KEYS (2 * MIN_DEGREE - 1)
+#define MAX_KEY_LENGTH 65535
+#define BUFFER_ALIGN 16
+
+typedef struct Node {
+    int keyCount;
+    bool leaf;
+    uint32_t prefixLength;              // Bytes shared by every key in the node
+    uint32_t capacity;                  // Bytes allocated for buffer
+    uint64_t abbrev[MAX_KEYS];          // First 8 suffix bytes, big-endian, zero-padded
+    uint32_t offsets[MAX_KEYS + 1];     // Suffix i is buffer[offsets[i] .. offsets[i + 1])
+    char* buffer;                       // Common prefix followed by the suffixes
+    struct Node* children[MAX_KEYS + 1];
+} Node;
+
+// A key in two pieces, so keys can move between nodes without being
+// copied out first: for a stored key the node's prefix and its suffix, for
+// a caller's key the whole key and nothing
+typedef struct KeyView {
+    const char* head;
+    size_t headLength;
+    const char* tail;
+    size_t tailLength;
+} KeyView;
+
+// Big-endian load of up to 8 bytes so that integer order equals memcmp order
+uint64_t abbreviate(const char* bytes, size_t length) {
+    uint64_t value = 0;
+    for (size_t i = 0; i < 8; i++) {
+        value <<= 8;
+        if (i < length) value |= (unsigned char)bytes[i];
+    }
+    return value;
+}
+
+int compareBytes(const char* a, size_t aLength, const char* b, size_t bLength) {
+    int cmp = memcmp(a, b, aLength < bLength ? aLength : bLength);
+    if (cmp != 0) return cmp;
+    return (aLength > bLength) - (aLength < bLength);
+}
+
+Node* createNode(bool leaf) {
+    Node* node = (Node*)calloc(1, sizeof(Node));
+    if (node == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(1);
+    }
+    node->leaf = leaf;
+    return node;
+}
+
+size_t keyLength(const Node* node, int i) {
+    return node->prefixLength + node->offsets[i + 1] - node->offsets[i];
+}
+
+KeyView wholeKey(const char* key, size_t length) {
+    KeyView view = { key, length, key + length, 0 };
+    return view;
+}
+
+KeyView nodeKey(const Node* node, int i) {
+    KeyView view = { node->buffer, node->prefixLength, node->buffer + node->offsets[i],
+                     node->offsets[i + 1] - node->offsets[i] };
+    return view;
+}
+
+size_t viewLength(const KeyView* key) {
+    return key->headLength + key->tailLength;
+}
+
+char viewByte(const KeyView* key, size_t i) {
+    return i < key->headLength ? key->head[i] : key->tail[i - key->headLength];
+}
+
+// Number of leading bytes a and b have in common
+size_t sharedLength(const KeyView* a, const KeyView* b) {
+    size_t limit = viewLength(a) < viewLength(b) ? viewLength(a) : viewLength(b);
+    size_t i = 0;
+    while (i < limit && viewByte(a, i) == viewByte(b, i)) i++;
+    return i;
+}
+
+// Copy bytes [from, to) of key to out
+void copyBytes(const KeyView* key, size_t from, size_t to, char* out) {
+    if (from < key->headLength) {
+        size_t n = (to < key->headLength ? to : key->headLength) - from;
+        memcpy(out, key->head + from, n);
+        out += n;
+        from += n;
+    }
+    if (from < to) memcpy(out, key->tail + (from - key->headLength), to - from);
+}
+
+// Fresh NUL-terminated copy of key i of node
+char* copyNodeKey(const Node* node, int i, size_t* length) {
+    KeyView key = nodeKey(node, i);
+    *length = viewLength(&key);
+    char* copy = (char*)malloc(*length + 1);
+    if (copy == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(1);
+    }
+    copyBytes(&key, 0, *length, copy);
+    copy[*length] = '\0';
+    return copy;
+}
+
+// Resize the buffer to hold bytes plus an eighth of slack, so a run of
+// inserts into one node reallocates only now and then
+void resizeBuffer(Node* node, size_t bytes) {
+    size_t capacity = (bytes + bytes / 8 + BUFFER_ALIGN - 1) / BUFFER_ALIGN * BUFFER_ALIGN;
+    if (capacity == 0) capacity = BUFFER_ALIGN;
+    char* buffer = (char*)realloc(node->buffer, capacity);
+    if (buffer == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(1);
+    }
+    node->buffer = buffer;
+    node->capacity = (uint32_t)capacity;
+}
+
+void reserveBuffer(Node* node, size_t bytes) {
+    if (node->buffer == NULL || bytes > node->capacity) resizeBuffer(node, bytes);
+}
+
+// Rewrite the suffixes for a new common prefix length. A longer prefix
+// must be shared by every key; its extra bytes are dropped from the front
+// of each suffix. A shorter one moves the bytes it gives up to the front
+// of each suffix.
+void setPrefix(Node* node, size_t prefix) {
+    size_t old = node->prefixLength;
+    if (prefix == old) return;
+    int count = node->keyCount;
+
+    if (prefix > old) {
+        // Suffix 0 follows the prefix, so its first bytes already extend it
+        size_t delta = prefix - old;
+        size_t start = node->offsets[0], write = prefix;
+        for (int i = 0; i < count; i++) {
+            size_t end = node->offsets[i + 1];
+            size_t length = end - start - delta;
+            memmove(node->buffer + write, node->buffer + start + delta, length);
+            node->offsets[i] = (uint32_t)write;
+            node->abbrev[i] = abbreviate(node->buffer + write, length);
+            write += length;
+            start = end;
+        }
+        node->offsets[count] = (uint32_t)write;
+    } else {
+        // Work from the back so every suffix moves up into space that is
+        // free by then; the bytes given up, buffer[prefix .. old), stay put
+        // until suffix 0 absorbs them where they are
+        size_t delta = old - prefix;
+        reserveBuffer(node, node->offsets[count] + delta * count);
+        size_t end = node->offsets[count];
+        node->offsets[count] = (uint32_t)(end + delta * count - delta);
+        for (int i = count - 1; i >= 0; i--) {
+            size_t start = node->offsets[i];
+            size_t length = end - start;
+            size_t write = start + delta * i - delta;
+            memmove(node->buffer + write + delta, node->buffer + start, length);
+            memmove(node->buffer + write, node->buffer + prefix, delta);
+            node->offsets[i] = (uint32_t)write;
+            node->abbrev[i] = abbreviate(node->buffer + write, length + delta);
+            end = start;
+        }
+    }
+    node->prefixLength = (uint32_t)prefix;
+}
+
+// Make the prefix what the first and last key share, or nothing for fewer
+// than two keys
+void refreshPrefix(Node* node) {
+    if (node->keyCount < 2) {
+        setPrefix(node, 0);
+        return;
+    }
+    KeyView first = nodeKey(node, 0);
+    KeyView last = nodeKey(node, node->keyCount - 1);
+    setPrefix(node, sharedLength(&first, &last));
+}
+
+// Put key in at pos; it must sort between the keys around pos
+void insertKey(Node* node, int pos, const KeyView* key) {
+    int count = node->keyCount;
+    size_t prefix = node->prefixLength;
+    if (count == 0) {
+        prefix = 0;
+    } else if (pos == 0 || pos == count) {
+        KeyView other = nodeKey(node, pos == 0 ? count - 1 : 0);
+        prefix = sharedLength(key, &other);
+    }
+    setPrefix(node, prefix);
+
+    size_t suffixLength = viewLength(key) - prefix;
+    size_t end = node->offsets[count];
+    reserveBuffer(node, end + suffixLength);
+    size_t at = node->offsets[pos];
+    memmove(node->buffer + at + suffixLength, node->buffer + at, end - at);
+    copyBytes(key, prefix, viewLength(key), node->buffer + at);
+
+    for (int i = count; i >= pos; i--) node->offsets[i + 1] = node->offsets[i] + (uint32_t)suffixLength;
+    node->offsets[pos] = (uint32_t)at;
+    memmove(&node->abbrev[pos + 1], &node->abbrev[pos], sizeof(uint64_t) * (count - pos));
+    node->abbrev[pos] = abbreviate(node->buffer + at, suffixLength);
+    node->keyCount++;
+}
+
+void removeKey(Node* node, int pos) {
+    int count = node->keyCount;
+    uint32_t suffixLength = node->offsets[pos + 1] - node->offsets[pos];
+    memmove(node->buffer + node->offsets[pos], node->buffer + node->offsets[pos + 1],
+            node->offsets[count] - node->offsets[pos + 1]);
+    for (int i = pos; i < count; i++) node->offsets[i] = node->offsets[i + 1] - suffixLength;
+    memmove(&node->abbrev[pos], &node->abbrev[pos + 1], sizeof(uint64_t) * (count - pos - 1));
+    node->keyCount--;
+    if (pos == 0 || pos == node->keyCount) refreshPrefix(node);
+
+    // Hand back the space once more than a quarter of the buffer is unused
+    size_t used = node->offsets[node->keyCount];
+    if (node->capacity - used > node->capacity / 4) resizeBuffer(node, used);
+}
+
+// Replace the key at pos in node with key
+void replaceKey(Node* node, int pos, const KeyView* key) {
+    removeKey(node, pos);
+    insertKey(node, pos, key);
+}
+
+// Append keys [from, to) of src, which sort after every key of node
+void appendKeys(Node* node, const Node* src, int from, int to) {
+    int count = node->keyCount;
+    if (to <= from) return;
+
+    KeyView first = count > 0 ? nodeKey(node, 0) : nodeKey(src, from);
+    KeyView last = nodeKey(src, to - 1);
+    size_t prefix = count + (to - from) > 1 ? sharedLength(&first, &last) : 0;
+    if (count == 0) {
+        reserveBuffer(node, prefix);
+        copyBytes(&first, 0, prefix, node->buffer);
+        node->prefixLength = (uint32_t)prefix;
+        node->offsets[0] = (uint32_t)prefix;
+    } else {
+        setPrefix(node, prefix);
+    }
+
+    size_t total = node->offsets[count];
+    for (int i = from; i < to; i++) total += keyLength(src, i) - prefix;
+    reserveBuffer(node, total);
+
+    for (int i = from; i < to; i++) {
+        KeyView key = nodeKey(src, i);
+        size_t write = node->offsets[count];
+        size_t suffixLength = viewLength(&key) - prefix;
+        copyBytes(&key, prefix, viewLength(&key), node->buffer + write);
+        node->abbrev[count] = abbreviate(node->buffer + write, suffixLength);
+        node->offsets[++count] = (uint32_t)(write + suffixLength);
+    }
+    node->keyCount = count;
+}
+
+// Drop every key from pos on and give back the buffer they no longer need
+void truncateKeys(Node* node, int pos) {
+    node->keyCount = pos;
+    refreshPrefix(node);
+    resizeBuffer(node, node->offsets[pos]);
+}
+
+void insertChild(Node* node, int pos, Node* child) {
+    memmove(&node->children[pos + 1], &node->children[pos], sizeof(Node*) * (node->keyCount + 1 - pos));
+    node->children[pos] = child;
+}
+
+void removeChild(Node* node, int pos) {
+    memmove(&node->children[pos], &node->children[pos + 1], sizeof(Node*) * (node->keyCount - pos));
+}
+
+// Position of the first key >= key in node; *found tells whether it is equal
+int findPosition(const Node* node, const char* key, size_t length, bool* found) {
+    *found = false;
+
+    // One prefix compare per node places keys outside the node's prefix
+    size_t prefix = node->prefixLength;
+    int cmp = memcmp(key, node->buffer, length < prefix ? length : prefix);
+    if (cmp < 0 || (cmp == 0 && length < prefix)) return 0;
+    if (cmp > 0) return node->keyCount;
+
+    const char* rest = key + prefix;
+    size_t restLength = length - prefix;
+    uint64_t abbrev = abbreviate(rest, restLength);
+
+    int lo = 0, hi = node->keyCount;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (node->abbrev[mid] < abbrev) {
+            lo = mid + 1;
+        } else if (node->abbrev[mid] > abbrev) {
+            hi = mid;
+        } else {
+            // Abbreviations tie: settle it on the suffix bytes
+            const char* suffix = node->buffer + node->offsets[mid];
+            size_t suffixLength = node->offsets[mid + 1] - node->offsets[mid];
+            cmp = compareBytes(suffix, suffixLength, rest, restLength);
+            if (cmp == 0) {
+                *found = true;
+                return mid;
+            }
+            if (cmp < 0) lo = mid + 1;
+            else hi = mid;
+        }
+    }
+    return lo;
+}
+
+bool search(Node* root, const char* key) {
+    size_t length = strlen(key);
+    Node* node = root;
+    while (node != NULL) {
+        bool found;
+        int pos = findPosition(node, key, length, &found);
+        if (found) return true;
+        node = node->leaf ? NULL : node->children[pos];
+    }
+    return false;
+}
+
+// Split the full child at pos; its middle key moves up into parent
+void splitChild(Node* parent, int pos) {
+    Node* child = parent->children[pos];
+    Node* right = createNode(child->leaf);
+
+    appendKeys(right, child, MIN_DEGREE, MAX_KEYS);
+    if (!child->leaf) {
+        memcpy(right->children, &child->children[MIN_DEGREE], sizeof(Node*) * MIN_DEGREE);
+    }
+
+    insertChild(parent, pos + 1, right);
+    KeyView middle = nodeKey(child, MIN_DEGREE - 1);
+    insertKey(parent, pos, &middle);
+    truncateKeys(child, MIN_DEGREE - 1);
+}
+
+void insertNonFull(Node* node, const char* key, size_t length) {
+    for (;;) {
+        bool found;
+        int pos = findPosition(node, key, length, &found);
+        if (found) return;
+
+        if (node->leaf) {
+            KeyView view = wholeKey(key, length);
+            insertKey(node, pos, &view);
+            return;
+        }
+
+        if (node->children[pos]->keyCount == MAX_KEYS) {
+            splitChild(node, pos);
+            // The promoted key now sits at pos; pick the side to descend
+            pos = findPosition(node, key, length, &found);
+            if (found) return;
+        }
+        node = node->children[pos];
+    }
+}
+
+Node* insert(Node* root, const char* key) {
+    size_t length = strlen(key);
+    if (length > MAX_KEY_LENGTH) {
+        fprintf(stderr, "Key too long: %zu bytes\n", length);
+        return root;
+    }
+
+    if (root == NULL) {
+        root = createNode(true);
+        KeyView view = wholeKey(key, length);
+        insertKey(root, 0, &view);
+        return root;
+    }
+
+    if (root->keyCount == MAX_KEYS) {
+        Node* newRoot = createNode(false);
+        newRoot->children[0] = root;
+        splitChild(newRoot, 0);
+        root = newRoot;
+    }
+    insertNonFull(root, key, length);
+    return root;
+}
+
+// Largest key under node (as a fresh copy)
+char* maxKey(Node* node, size_t* length) {
+    while (!node->leaf) node = node->children[node->keyCount];
+    return copyNodeKey(node, node->keyCount - 1, length);
+}
+
+// Smallest key under node (as a fresh copy)
+char* minKey(Node* node, size_t* length) {
+    while (!node->leaf) node = node->children[0];
+    return copyNodeKey(node, 0, length);
+}
+
+// Fold children pos and pos + 1 together with the separating key
+void mergeChildren(Node* node, int pos) {
+    Node* left = node->children[pos];
+    Node* right = node->children[pos + 1];
+
+    int leftCount = left->keyCount;
+    KeyView separator = nodeKey(node, pos);
+    insertKey(left, leftCount, &separator);
+    appendKeys(left, right, 0, right->keyCount);
+    if (!left->leaf) {
+        memcpy(&left->children[leftCount + 1], right->children, sizeof(Node*) * (right->keyCount + 1));
+    }
+
+    removeChild(node, pos + 1);
+    removeKey(node, pos);
+    free(right->buffer);
+    free(right);
+}
+
+// Move one key from the left sibling through the parent into child pos
+void borrowFromLeft(Node* node, int pos) {
+    Node* child = node->children[pos];
+    Node* sibling = node->children[pos - 1];
+
+    if (!child->leaf) {
+        memmove(&child->children[1], child->children, sizeof(Node*) * (child->keyCount + 1));
+        child->children[0] = sibling->children[sibling->keyCount];
+    }
+
+    KeyView separator = nodeKey(node, pos - 1);
+    insertKey(child, 0, &separator);
+    KeyView key = nodeKey(sibling, sibling->keyCount - 1);
+    replaceKey(node, pos - 1, &key);
+    removeKey(sibling, sibling->keyCount - 1);
+}
+
+// Move one key from the right sibling through the parent into child pos
+void borrowFromRight(Node* node, int pos) {
+    Node* child = node->children[pos];
+    Node* sibling = node->children[pos + 1];
+
+    if (!child->leaf) {
+        child->children[child->keyCount + 1] = sibling->children[0];
+        memmove(sibling->children, &sibling->children[1], sizeof(Node*) * sibling->keyCount);
+    }
+
+    KeyView separator = nodeKey(node, pos);
+    insertKey(child, child->keyCount, &separator);
+    KeyView key = nodeKey(sibling, 0);
+    replaceKey(node, pos, &key);
+    removeKey(sibling, 0);
+}
+
+// Make sure child pos has at least MIN_DEGREE keys before descending into
+// it; returns the index of the child that now covers the key range
+int fillChild(Node* node, int pos) {
+    if (pos > 0 && node->children[pos - 1]->keyCount >= MIN_DEGREE) {
+        borrowFromLeft(node, pos);
+    } else if (pos < node->keyCount && node->children[pos + 1]->keyCount >= MIN_DEGREE) {
+        borrowFromRight(node, pos);
+    } else if (pos < node->keyCount) {
+        mergeChildren(node, pos);
+    } else {
+        mergeChildren(node, pos - 1);
+        pos--;
+    }
+    return pos;
+}
+
+void deleteFromNode(Node* node, const char* key, size_t length) {
+    bool found;
+    int pos = findPosition(node, key, length, &found);
+
+    if (found && node->leaf) {
+        removeKey(node, pos);
+        return;
+    }
+
+    if (found) {
+        // Internal node: replace with the predecessor or successor, or merge
+        if (node->children[pos]->keyCount >= MIN_DEGREE) {
+            size_t predLength;
+            char* pred = maxKey(node->children[pos], &predLength);
+            KeyView view = wholeKey(pred, predLength);
+            replaceKey(node, pos, &view);
+            deleteFromNode(node->children[pos], pred, predLength);
+            free(pred);
+        } else if (node->children[pos + 1]->keyCount >= MIN_DEGREE) {
+            size_t succLength;
+            char* succ = minKey(node->children[pos + 1], &succLength);
+            KeyView view = wholeKey(succ, succLength);
+            replaceKey(node, pos, &view);
+            deleteFromNode(node->children[pos + 1], succ, succLength);
+            free(succ);
+        } else {
+            mergeChildren(node, pos);
+            deleteFromNode(node->children[pos], key, length);
+        }
+        return;
+    }
+
+    if (node->leaf) return;
+
+    if (node->children[pos]->keyCount < MIN_DEGREE) pos = fillChild(node, pos);
+    deleteFromNode(node->children[pos], key, length);
+}
+
+Node* delete(Node* root, const char* key) {
+    if (root == NULL) return NULL;
+    deleteFromNode(root, key, strlen(key));
+
+    // Shrink the tree when the root has been emptied by a merge
+    if (root->keyCount == 0) {
+        Node* oldRoot = root;
+        root = root->leaf ? NULL : root->children[0];
+        free(oldRoot->buffer);
+        free(oldRoot);
+    }
+    return root;
+}
+
+void freeTree(Node* node) {
+    if (node == NULL) return;
+    if (!node->leaf) {
+        for (int i = 0; i <= node->keyCount; i++) freeTree(node->children[i]);
+    }
+    free(node->buffer);
+    free(node);
+}
+
+// Walk the tree and report its memory footprint, node buffers included
+void collectTreeStats(Node* node, int depth, TreeStats* stats, size_t* keyBytes) {
+    if (node == NULL) return;
+    treeStatsAddNode(stats, node, sizeof(Node), depth, node->keyCount);
+    stats->bytesAllocated += allocationBytes(node->buffer, node->capacity);
+    for (int i = 0; i < node->keyCount; i++) *keyBytes += keyLength(node, i);
+    if (node->leaf) return;
+    for (int i = 0; i <= node->keyCount; i++) collectTreeStats(node->children[i], depth + 1, stats, keyBytes);
+}
+
+TreeStats treeStats(Node* root, size_t* keyBytes) {
+    TreeStats stats;
+    treeStatsInit(&stats);
+    *keyBytes = 0;
+    collectTreeStats(root, 0, &stats, keyBytes);
+    treeStatsFinish(&stats);
+    return stats;
+}
+
+// Turn an input number into a URL-like key; keys share a long prefix
+void makeKey(int number, char* buffer, size_t size) {
+    snprintf(buffer, size, "https://www.example.com/catalog/products/category-%02d/item-%08d/details",
+             (number / 100) % 100, number);
+}
+
+void processFiles(const char* files[], int fileCount) {
+    Node* root = NULL;
+
+    for (int i = 0; i < fileCount; i++) {
+        FILE* file = fopen(files[i], "r");
+        if (file == NULL) {
+            perror("Error opening file");
+            return;
+        }
+
+        printf("\nProcessing file: %s\n", files[i]);
+
+        int number, nodeCount = 0;
+        char key[128];
+        clock_t start, end;
+
+        // Insertion time
+        start = clock();
+        while (fscanf(file, "%d,", &number) == 1) {
+            makeKey(number, key, sizeof(key));
+            root = insert(root, key);
+            nodeCount++;
+        }
+        end = clock();
+        printf("Insertion time for %d nodes: %f seconds\n", nodeCount, ((double)(end - start)) / CLOCKS_PER_SEC);
+
+        size_t keyBytes;
+        TreeStats stats = treeStats(root, &keyBytes);
+        printTreeStats(&stats, NULL, MAX_KEYS);
+        if (stats.keyCount > 0) {
+            printf("Key bytes: %zu raw (%.2f per key), %.2f stored per key including nodes\n",
+                   keyBytes, (double)keyBytes / stats.keyCount, (double)stats.bytesAllocated / stats.keyCount);
+        }
+
+        // Search time for node with value 500
+        makeKey(500, key, sizeof(key));
+        start = clock();
+        bool found = search(root, key);
+        end = clock();
+        if (found) {
+            printf("Node with value 500 found.\n");
+        } else {
+            printf("Node with value 500 not found.\n");
+        }
+        printf("Search time for node with value 500: %f seconds\n", ((double)(end - start)) / CLOCKS_PER_SEC);
+
+        // Deletion time for node with value 500
+        start = clock();
+        root = delete(root, key);
+        end = clock();
+        printf("Deletion time for node with value 500: %f seconds\n", ((double)(end - start)) / CLOCKS_PER_SEC);
+
+        fclose(file);
+        freeTree(root);
+        root = NULL; // Reset the tree for the next file
+    }
+}
+
+int main() {
+    const char* files[] = {
+        "random_numbers.txt",
+        "mixed_numbers.txt",
+        "increasing_numbers.txt",
+        "decreasing_numbers.txt"
+    };
+
+    processFiles(files, 4);
+
+    return 0;
+}
@@ -0,0 +1,83 @@
+#ifndef TREE_STATS_H
+#define TREE_STATS_H
+
+#include <stdio.h>
+#include <string.h>
+#include <stddef.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+#define TREE_STATS_MAX_NODE_TYPES 4
+
+// Memory footprint and shape of a tree, filled in by each engine's treeStats()
+typedef struct TreeStats {
+    long nodeCount;
+    long keyCount;
+    size_t bytesAllocated;  // Heap bytes the nodes occupy, allocator overhead included
+    int height;             // Number of levels; 0 for an empty tree
+    int maxDepth;           // Depth of the deepest node, the root being at depth 0
+    double avgDepth;        // Mean depth over all nodes
+    long depthSum;
+    int nodeTypeCount;      // Number of NodeType values for multiway trees, 0 otherwise
+    long nodesByType[TREE_STATS_MAX_NODE_TYPES];
+} TreeStats;
+
+static void treeStatsInit(TreeStats* stats) {
+    memset(stats, 0, sizeof(*stats));
+}
+
+// Bytes the allocator really hands out for a block of the requested size:
+// the usable size plus the chunk header glibc keeps in front of it
+static size_t allocationBytes(const void* block, size_t requested) {
+    if (block == NULL) return 0;
+#ifdef __GLIBC__
+    (void)requested;
+    return malloc_usable_size((void*)block) + sizeof(size_t);
+#else
+    return requested;
+#endif
+}
+
+// Account a node that carries keys keys at the given depth and takes bytes
+// bytes; nodes living in an arena rather than a heap block of their own
+// come in this way
+static void treeStatsAddNodeBytes(TreeStats* stats, size_t bytes, int depth, int keys) {
+    stats->nodeCount++;
+    stats->keyCount += keys;
+    stats->bytesAllocated += bytes;
+    stats->depthSum += depth;
+    if (depth > stats->maxDepth) stats->maxDepth = depth;
+}
+
+// Account one heap block of the tree that carries keys keys at the given depth
+static void treeStatsAddNode(TreeStats* stats, const void* node, size_t size, int depth, int keys) {
+    treeStatsAddNodeBytes(stats, allocationBytes(node, size), depth, keys);
+}
+
+static void treeStatsFinish(TreeStats* stats) {
+    if (stats->nodeCount == 0) return;
+    stats->height = stats->maxDepth + 1;
+    stats->avgDepth = (double)stats->depthSum / stats->nodeCount;
+}
+
+// typeNames names the multiway node types and maxKeys is the key capacity of
+// the widest one; binary trees pass NULL and 1
+static void printTreeStats(const TreeStats* stats, const char* typeNames[], int maxKeys) {
+    printf("Tree stats: nodes=%ld, keys=%ld, bytes=%zu, bytes/key=%.2f, height=%d, avg depth=%.2f, max depth=%d\n",
+           stats->nodeCount, stats->keyCount, stats->bytesAllocated,
+           stats->keyCount ? (double)stats->bytesAllocated / stats->keyCount : 0.0,
+           stats->height, stats->avgDepth, stats->maxDepth);
+
+    if (stats->nodeTypeCount == 0 || typeNames == NULL || stats->nodeCount == 0) return;
+
+    long slots = stats->nodeCount * maxKeys;
+    printf("Node fill:");
+    for (int t = 0; t < stats->nodeTypeCount; t++) {
+        printf("%s %s=%ld (%.1f%%)", t ? "," : "", typeNames[t], stats->nodesByType[t],
+               100.0 * stats->nodesByType[t] / stats->nodeCount);
+    }
+    printf(", key slots used=%.1f%%\n", 100.0 * stats->keyCount / slots);
+}
+
+#endif
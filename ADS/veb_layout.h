@@ -0,0 +1,144 @@
+#ifndef VEB_LAYOUT_H
+#define VEB_LAYOUT_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Static search array in van Emde Boas order. The keys of a tree are laid
+// out as a perfect binary search tree of height h, stored recursively: the
+// top h/2 levels first, then each of the subtrees hanging below them, each
+// again in the same order. Whatever the block size of a cache level, a
+// descent reads O(log_B n) blocks of it, so the one array does well in L1,
+// L2, the last-level cache and the TLB alike without a tuned node size.
+//
+// No pointers are stored. A descent keeps the breadth-first index of its
+// node and, for every depth, the array position of the node it passed at
+// that depth; a per-depth table from the recursive split (Brodal, Fagerberg
+// and Jacob) turns those into the position of the next node.
+// Slots past the last key repeat the largest key so the tree stays perfect.
+#define VEB_MAX_HEIGHT 40
+
+// How to find a node at one depth: it is the root of a bottom tree of the
+// split whose top tree is rooted at topDepth
+typedef struct VebLevel {
+    long topSize;
+    long bottomSize;
+    int topDepth;
+} VebLevel;
+
+typedef struct VebLayout {
+    int* keys;
+    long count;  // Keys exported; the array holds 2^height - 1 slots
+    long size;
+    int height;
+    VebLevel levels[VEB_MAX_HEIGHT + 1];  // The entry past the leaves is all zero
+} VebLayout;
+
+// Record the split of the subtree rooted at depth with height levels
+static void vebSplit(VebLayout* layout, int depth, int height) {
+    if (height <= 1) return;
+    int top = height / 2;
+    int bottom = height - top;
+    VebLevel* level = &layout->levels[depth + top];
+    level->topSize = (1L << top) - 1;
+    level->bottomSize = (1L << bottom) - 1;
+    level->topDepth = depth;
+    vebSplit(layout, depth, top);
+    vebSplit(layout, depth + top, bottom);
+}
+
+// Position of the node with breadth-first index node at depth, given the
+// positions of its ancestors
+static inline long vebPosition(const VebLayout* layout, const long* path, long node, int depth) {
+    const VebLevel* level = &layout->levels[depth];
+    return path[level->topDepth] + level->topSize + (node & level->topSize) * level->bottomSize;
+}
+
+// Hand out the sorted keys to the subtree rooted at node in order
+static void vebFill(VebLayout* layout, long* path, long node, int depth, const int* sorted, long* next) {
+    if (depth + 1 < layout->height) {
+        path[depth + 1] = vebPosition(layout, path, 2 * node, depth + 1);
+        vebFill(layout, path, 2 * node, depth + 1, sorted, next);
+    }
+    long index = *next < layout->count ? *next : layout->count - 1;
+    layout->keys[path[depth]] = sorted[index];
+    (*next)++;
+    if (depth + 1 < layout->height) {
+        path[depth + 1] = vebPosition(layout, path, 2 * node + 1, depth + 1);
+        vebFill(layout, path, 2 * node + 1, depth + 1, sorted, next);
+    }
+}
+
+// Export count distinct sorted keys; returns -1 if the array cannot be allocated
+static int vebBuild(VebLayout* layout, const int* sorted, long count) {
+    layout->count = count;
+    layout->height = 0;
+    while (((1L << layout->height) - 1) < count) layout->height++;
+    layout->size = (1L << layout->height) - 1;
+    layout->keys = (int*)malloc(sizeof(int) * (layout->size > 0 ? layout->size : 1));
+    if (layout->keys == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return -1;
+    }
+    memset(layout->levels, 0, sizeof(layout->levels));
+    vebSplit(layout, 0, layout->height);
+    if (count == 0) return 0;
+    long path[VEB_MAX_HEIGHT];
+    long next = 0;
+    path[0] = 0;
+    vebFill(layout, path, 1, 0, sorted, &next);
+    return 0;
+}
+
+static void vebFree(VebLayout* layout) {
+    free(layout->keys);
+    layout->keys = NULL;
+}
+
+// Full-height descent with no data-dependent branches; every level costs
+// the same, and the caches see one path from the root
+static int vebContains(const VebLayout* layout, int key) {
+    long path[VEB_MAX_HEIGHT];
+    const int* keys = layout->keys;
+    int height = layout->height;
+    long node = 1, position = 0;
+    int found = 0;
+    for (int depth = 0; depth < height; depth++) {
+        path[depth] = position;
+        int value = keys[position];
+        found |= value == key;
+        node = 2 * node + (key > value);
+        position = vebPosition(layout, path, node, depth + 1);
+    }
+    return found;
+}
+
+static size_t vebBytes(const VebLayout* layout) {
+    return sizeof(int) * layout->size;
+}
+
+// Key counts for comparing a pointer tree with its exported layout: from
+// an array that fits in L1 up to a tree of nodeBytes per key ten times the
+// last-level cache, growing fourfold, but never a tree over an eighth of
+// physical memory. Returns the number of sizes written.
+static int staticSearchSizes(long sizes[], int maxSizes, size_t nodeBytes) {
+    long l1 = sysconf(_SC_LEVEL1_DCACHE_SIZE);
+    long llc = sysconf(_SC_LEVEL3_CACHE_SIZE);
+    if (llc <= 0) llc = sysconf(_SC_LEVEL2_CACHE_SIZE);
+    if (l1 <= 0) l1 = 32 * 1024;
+    if (llc <= 0) llc = 8 * 1024 * 1024;
+    double limit = 10.0 * llc;
+    double ram = (double)sysconf(_SC_PHYS_PAGES) * sysconf(_SC_PAGESIZE);
+    if (ram > 0 && limit > ram / 8) limit = ram / 8;
+
+    int count = 0;
+    for (long keys = l1 / 2 / sizeof(int); count < maxSizes; keys *= 4) {
+        if (count > 0 && (double)keys * nodeBytes > limit) break;
+        sizes[count++] = keys;
+    }
+    return count;
+}
+
+#endif
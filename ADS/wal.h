@@ -0,0 +1,286 @@
+#ifndef WAL_H
+#define WAL_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+
+// Write-ahead log of tree updates with group commit. Records are buffered
+// in memory and handed over in groups to a log writer thread, which issues
+// one write() + fdatasync() per group while the caller keeps filling the
+// other buffer. A group holds at least groupSize records, and the writer
+// starts a sync no sooner than WAL_COMMIT_INTERVAL after the previous one.
+// Meanwhile the buffer being filled keeps growing instead of waiting, and
+// is handed over whole once the writer is free, so groups grow with the
+// sync latency and the update rate and the syncs cost a bounded share of
+// the time. The sync stays off the update path unless WAL_MAX_BACKLOG
+// groups' worth of records pile up behind one sync. An update is durable
+// once its group has been synced (walSync waits for that, skipping the
+// interval); a crash loses at most the group being synced and the one
+// being filled, and never reorders or corrupts earlier records.
+#ifndef WAL_COMMIT_INTERVAL
+#define WAL_COMMIT_INTERVAL 5000000L  // Nanoseconds between the starts of two syncs
+#endif
+#define WAL_MAX_BACKLOG 64            // Groups' worth of records that may wait on one sync
+typedef enum { WAL_INSERT = 1, WAL_DELETE = 2 } WalOp;
+
+typedef struct WalRecord {
+    uint32_t op;
+    int32_t key;
+    uint32_t checksum;  // Detects a torn record at the end of the log
+} WalRecord;
+
+typedef struct WriteAheadLog {
+    int fd;
+    WalRecord* active;    // Group being filled by walAppend
+    int pending;
+    int activeCapacity;
+    WalRecord* flushing;  // Group owned by the log writer
+    int flushingCapacity;
+    int flushCount;       // Records in the flushing group, 0 when idle
+    int groupSize;
+    int urgent;           // walSync is waiting: sync without the interval
+    struct timespec nextSync;  // Earliest start of the next sync, CLOCK_MONOTONIC
+    long appended;
+    long syncs;
+    int failed;
+    int stopping;
+    pthread_t writer;
+    pthread_mutex_t lock;
+    pthread_cond_t submitted, flushed;
+} WriteAheadLog;
+
+static uint32_t walChecksum(uint32_t op, int32_t key) {
+    // FNV-1a over the op and key bytes
+    uint32_t hash = 2166136261u;
+    uint32_t words[2] = { op, (uint32_t)key };
+    const unsigned char* bytes = (const unsigned char*)words;
+    for (size_t i = 0; i < sizeof(words); i++) {
+        hash ^= bytes[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// Log writer thread: write and sync each submitted group
+static void* walWriterMain(void* arg) {
+    WriteAheadLog* log = (WriteAheadLog*)arg;
+    pthread_mutex_lock(&log->lock);
+    for (;;) {
+        while (log->flushCount == 0 && !log->stopping)
+            pthread_cond_wait(&log->submitted, &log->lock);
+        if (log->flushCount == 0) break;
+        // Space the syncs out; walSync cuts the wait short
+        int waited = 0;
+        while (!log->urgent && !log->stopping && waited != ETIMEDOUT)
+            waited = pthread_cond_timedwait(&log->submitted, &log->lock, &log->nextSync);
+        pthread_mutex_unlock(&log->lock);
+
+        clock_gettime(CLOCK_MONOTONIC, &log->nextSync);
+        log->nextSync.tv_nsec += WAL_COMMIT_INTERVAL;
+        log->nextSync.tv_sec += log->nextSync.tv_nsec / 1000000000L;
+        log->nextSync.tv_nsec %= 1000000000L;
+
+        int ok = 1;
+        const char* data = (const char*)log->flushing;
+        size_t left = sizeof(WalRecord) * log->flushCount;
+        while (ok && left > 0) {
+            ssize_t written = write(log->fd, data, left);
+            if (written < 0 && errno == EINTR) continue;
+            if (written < 0) {
+                perror("Error writing write-ahead log");
+                ok = 0;
+                break;
+            }
+            data += written;
+            left -= (size_t)written;
+        }
+        if (ok && fdatasync(log->fd) != 0) {
+            perror("Error syncing write-ahead log");
+            ok = 0;
+        }
+
+        pthread_mutex_lock(&log->lock);
+        if (!ok) log->failed = 1;
+        // walAppend polls this without the lock to see the writer is free
+        __atomic_store_n(&log->flushCount, 0, __ATOMIC_RELEASE);
+        log->syncs++;
+        pthread_cond_broadcast(&log->flushed);
+    }
+    pthread_mutex_unlock(&log->lock);
+    return NULL;
+}
+
+// Open (or create) a log for appending; groupSize records share one sync
+static WriteAheadLog* walOpen(const char* path, int groupSize) {
+    if (groupSize < 1) groupSize = 1;
+    WriteAheadLog* log = (WriteAheadLog*)calloc(1, sizeof(WriteAheadLog));
+    if (log == NULL) return NULL;
+    log->active = (WalRecord*)malloc(sizeof(WalRecord) * groupSize);
+    log->flushing = (WalRecord*)malloc(sizeof(WalRecord) * groupSize);
+    log->fd = open(path, O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (log->active == NULL || log->flushing == NULL || log->fd < 0) {
+        if (log->fd < 0) perror("Error opening write-ahead log");
+        else close(log->fd);
+        free(log->active);
+        free(log->flushing);
+        free(log);
+        return NULL;
+    }
+    log->groupSize = groupSize;
+    log->activeCapacity = log->flushingCapacity = groupSize;
+    pthread_mutex_init(&log->lock, NULL);
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&log->submitted, &attr);
+    pthread_condattr_destroy(&attr);
+    pthread_cond_init(&log->flushed, NULL);
+    if (pthread_create(&log->writer, NULL, walWriterMain, log) != 0) {
+        perror("Error starting log writer");
+        close(log->fd);
+        free(log->active);
+        free(log->flushing);
+        free(log);
+        return NULL;
+    }
+    return log;
+}
+
+// Hand the filled group to the log writer, waiting only if the previous
+// group is still being synced. Must be called with the lock held.
+static void walSubmitLocked(WriteAheadLog* log) {
+    while (log->flushCount != 0)
+        pthread_cond_wait(&log->flushed, &log->lock);
+    if (log->pending == 0) return;
+    WalRecord* full = log->active;
+    int fullCapacity = log->activeCapacity;
+    log->active = log->flushing;
+    log->activeCapacity = log->flushingCapacity;
+    log->flushing = full;
+    log->flushingCapacity = fullCapacity;
+    log->flushCount = log->pending;
+    log->pending = 0;
+    pthread_cond_signal(&log->submitted);
+}
+
+// Buffer one record. Once the group has groupSize records it is handed
+// over at the first append that finds the log writer free; until then it
+// keeps growing, and only a backlog of WAL_MAX_BACKLOG groups waits for the
+// sync. If any group failed to reach the disk, or the buffer cannot grow,
+// the record is refused and -1 returned, so the caller can leave its update
+// unapplied. Returns 0 once the record is buffered.
+static int walAppend(WriteAheadLog* log, WalOp op, int key) {
+    if (log->pending >= log->groupSize
+        && (__atomic_load_n(&log->flushCount, __ATOMIC_ACQUIRE) == 0
+            || log->pending >= log->groupSize * WAL_MAX_BACKLOG)) {
+        pthread_mutex_lock(&log->lock);
+        while (log->flushCount != 0)
+            pthread_cond_wait(&log->flushed, &log->lock);
+        int failed = log->failed;
+        if (!failed) walSubmitLocked(log);
+        pthread_mutex_unlock(&log->lock);
+        if (failed) return -1;
+    }
+    if (log->pending == log->activeCapacity) {
+        int capacity = 2 * log->activeCapacity;
+        WalRecord* grown = (WalRecord*)realloc(log->active, sizeof(WalRecord) * capacity);
+        if (grown == NULL) {
+            fprintf(stderr, "Memory allocation failed\n");
+            return -1;
+        }
+        log->active = grown;
+        log->activeCapacity = capacity;
+    }
+
+    WalRecord* record = &log->active[log->pending++];
+    record->op = (uint32_t)op;
+    record->key = key;
+    record->checksum = walChecksum(record->op, record->key);
+    log->appended++;
+    return 0;
+}
+
+// Flush every appended record and wait until it is on disk.
+// Returns 0 on success, -1 if any group failed to reach the disk.
+static int walSync(WriteAheadLog* log) {
+    pthread_mutex_lock(&log->lock);
+    log->urgent = 1;
+    pthread_cond_signal(&log->submitted);
+    walSubmitLocked(log);
+    while (log->flushCount != 0)
+        pthread_cond_wait(&log->flushed, &log->lock);
+    log->urgent = 0;
+    int result = log->failed ? -1 : 0;
+    pthread_mutex_unlock(&log->lock);
+    return result;
+}
+
+// Drop every record, e.g. once a snapshot covering them has been published
+static int walTruncate(WriteAheadLog* log) {
+    if (walSync(log) != 0) return -1;
+    if (ftruncate(log->fd, 0) != 0 || fdatasync(log->fd) != 0) {
+        perror("Error truncating write-ahead log");
+        return -1;
+    }
+    return 0;
+}
+
+// Sync the last group, stop the log writer and close the log
+static int walClose(WriteAheadLog* log) {
+    if (log == NULL) return 0;
+    int result = walSync(log);
+    pthread_mutex_lock(&log->lock);
+    log->stopping = 1;
+    pthread_cond_signal(&log->submitted);
+    pthread_mutex_unlock(&log->lock);
+    pthread_join(log->writer, NULL);
+
+    close(log->fd);
+    pthread_mutex_destroy(&log->lock);
+    pthread_cond_destroy(&log->submitted);
+    pthread_cond_destroy(&log->flushed);
+    free(log->active);
+    free(log->flushing);
+    free(log);
+    return result;
+}
+
+// Read every intact record of the log at path. Reading stops at the first
+// short or corrupt record, which is what a crash mid-group leaves behind.
+// Returns the number of records (0 if the log does not exist) and stores a
+// malloc'd array in *records.
+static long walReadAll(const char* path, WalRecord** records) {
+    *records = NULL;
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) return 0;
+
+    long count = 0, capacity = 0;
+    WalRecord record;
+    while (fread(&record, sizeof(record), 1, file) == 1) {
+        if ((record.op != WAL_INSERT && record.op != WAL_DELETE)
+            || record.checksum != walChecksum(record.op, record.key)) {
+            break;
+        }
+        if (count == capacity) {
+            capacity = capacity ? capacity * 2 : 1024;
+            WalRecord* grown = (WalRecord*)realloc(*records, sizeof(WalRecord) * capacity);
+            if (grown == NULL) {
+                fprintf(stderr, "Memory allocation failed\n");
+                exit(1);
+            }
+            *records = grown;
+        }
+        (*records)[count++] = record;
+    }
+    fclose(file);
+    return count;
+}
+
+#endif